@@ -1,9 +1,10 @@
-#include <pthread.h> // pthread_create(), pthread_exit(), pthread_join()
 #include <stdio.h>   // printf(), sprintf(), perror()
 #include <unistd.h>  // sleep(), usleep()
 #include <stdlib.h>  // srand(), exit(), EXIT_FAILURE, EXIT_SUCCESS
 #include <assert.h>  // assert()
 
+#include "pool.h"    // pool_init(), pool_execute(), pool_wait_all(), pool_destroy()
+
 #define NUM_OF_THREADS 4
 #define RANDOM_USLEEP_MIN 20
 #define RANDOM_USLEEP_MAX 1200
@@ -66,9 +67,11 @@ void print_status(data_t *data, char *prefix, int print_result) {
          );
 }
 
-/* Each thread will use this function as start routine. The generic pattern for
-   each thread is to first take a random sleep, print a status message and then
-   execute the designated callback. */
+/* Each job will use this function as start routine. The generic pattern for
+   each job is to first take a random sleep, print a status message and then
+   execute the designated callback. The jobs are executed by the workers of a
+   thread pool, which are created once instead of once per job, and the
+   start routine has the same signature as a pthread_create() one. */
 void* generic_start_routine(void *arg) {
   data_t *data = (data_t*) arg;
 
@@ -153,8 +156,9 @@ int main(int argc, char *argv[]) {
   /* A string for the threads to work on. */
   char string[] = "The string shared among the threads.";
 
-  /* An array of thread identifiers, needed by pthread_join() later... */
-  pthread_t tid[NUM_OF_THREADS];
+  /* A pool with one worker thread for each job, so all jobs run concurrently
+     and get to interfere with each other. */
+  pool_t pool;
 
   /* Seed the pseudo random number generator. */
   srand(time(NULL));
@@ -186,16 +190,10 @@ int main(int argc, char *argv[]) {
     }
   };
 
-  /* Attributes (stack size, scheduling information) for the threads. */
-  pthread_attr_t attr;
-
-  /* Get default attributes for the threads. */
-  if (pthread_attr_init(&attr) != 0) {
-    perror("pthread_attr_init()");
-    exit(EXIT_FAILURE);
-  };
+  /* Start the worker threads. */
+  pool_init(&pool, NUM_OF_THREADS, NUM_OF_THREADS);
 
-  /* Create threads, each executing the generic_start_routine function. */
+  /* Submit the jobs, each executing the generic_start_routine function. */
   for (int i = 0; i < NUM_OF_THREADS; i++) {
     /* Create one data_t structure for each of the threads. */
     arg[i] = (data_t) {
@@ -210,22 +208,18 @@ int main(int argc, char *argv[]) {
       .callback = callback[i]
     };
 
-    /* Create the thread. */
-    if ( pthread_create(&tid[i], &attr, generic_start_routine, &arg[i]) != 0) {
-      perror("pthread_create()");
-      exit(EXIT_FAILURE);
-    };
+    /* Submit the job. */
+    pool_execute(&pool, generic_start_routine, &arg[i]);
   }
 
-  /* Wait for all threads to terminate. */
-  for (int i = 0; i < NUM_OF_THREADS; i++){
-    if (pthread_join(tid[i], NULL) != 0) {
-      perror("pthread_join()");
-      exit(EXIT_FAILURE);
-    };
+  /* Wait for all jobs to finish. */
+  pool_wait_all(&pool);
 
+  for (int i = 0; i < NUM_OF_THREADS; i++){
     print_status(&arg[i], " - ", 1);
   }
 
+  pool_destroy(&pool);
+
   exit(EXIT_SUCCESS);
 }
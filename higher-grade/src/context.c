@@ -0,0 +1,162 @@
+/* On Mac OS (aka OS X) the ucontext.h functions are deprecated and requires the
+   following define.
+*/
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>    /* perror() */
+#include <stdlib.h>   /* exit(), EXIT_FAILURE */
+#include <stdint.h>   /* uintptr_t, uint64_t */
+
+#include "context.h"
+
+#ifdef STHREADS_FAST_CONTEXT
+
+const char *context_kind = "fast";
+
+#ifdef __APPLE__
+#define SYMBOL(name) "_" #name
+#else
+#define SYMBOL(name) #name
+#endif
+
+/* void context_switch_asm(void **from_sp, void *to_sp)
+
+   Pushes the callee-saved registers on the current stack, stores the stack
+   pointer in *from_sp, loads to_sp and pops the callee-saved registers of the
+   context being resumed. The final return jumps to wherever that context last
+   called context_switch_asm(), or to its entry function the first time.
+*/
+void context_switch_asm(void **from_sp, void *to_sp);
+
+#if defined(__x86_64__)
+
+/* System V AMD64: rbx, rbp, r12-r15 and the control bits of MXCSR and the x87
+   control word are callee-saved. */
+__asm__(
+  ".text\n"
+  ".globl " SYMBOL(context_switch_asm) "\n"
+  SYMBOL(context_switch_asm) ":\n"
+  "  pushq %rbp\n"
+  "  pushq %rbx\n"
+  "  pushq %r12\n"
+  "  pushq %r13\n"
+  "  pushq %r14\n"
+  "  pushq %r15\n"
+  "  subq $8, %rsp\n"
+  "  stmxcsr (%rsp)\n"
+  "  fnstcw 4(%rsp)\n"
+  "  movq %rsp, (%rdi)\n"
+  "  movq %rsi, %rsp\n"
+  "  ldmxcsr (%rsp)\n"
+  "  fldcw 4(%rsp)\n"
+  "  addq $8, %rsp\n"
+  "  popq %r15\n"
+  "  popq %r14\n"
+  "  popq %r13\n"
+  "  popq %r12\n"
+  "  popq %rbx\n"
+  "  popq %rbp\n"
+  "  ret\n"
+);
+
+/* Saved words from the stack pointer upwards: MXCSR and x87 control word,
+   r15, r14, r13, r12, rbx, rbp, return address. */
+#define SAVED_WORDS   8
+#define RETURN_SLOT   7
+#define DEFAULT_FPU   ((uint64_t) 0x037F << 32 | 0x1F80)
+
+#elif defined(__aarch64__)
+
+/* AAPCS64: x19-x28, the frame pointer x29, the link register x30 and the low
+   halves of v8-v15 (d8-d15) are callee-saved. */
+__asm__(
+  ".text\n"
+  ".globl " SYMBOL(context_switch_asm) "\n"
+  ".p2align 2\n"
+  SYMBOL(context_switch_asm) ":\n"
+  "  sub sp, sp, #160\n"
+  "  stp x19, x20, [sp, #0]\n"
+  "  stp x21, x22, [sp, #16]\n"
+  "  stp x23, x24, [sp, #32]\n"
+  "  stp x25, x26, [sp, #48]\n"
+  "  stp x27, x28, [sp, #64]\n"
+  "  stp x29, x30, [sp, #80]\n"
+  "  stp d8,  d9,  [sp, #96]\n"
+  "  stp d10, d11, [sp, #112]\n"
+  "  stp d12, d13, [sp, #128]\n"
+  "  stp d14, d15, [sp, #144]\n"
+  "  mov x2, sp\n"
+  "  str x2, [x0]\n"
+  "  mov sp, x1\n"
+  "  ldp x19, x20, [sp, #0]\n"
+  "  ldp x21, x22, [sp, #16]\n"
+  "  ldp x23, x24, [sp, #32]\n"
+  "  ldp x25, x26, [sp, #48]\n"
+  "  ldp x27, x28, [sp, #64]\n"
+  "  ldp x29, x30, [sp, #80]\n"
+  "  ldp d8,  d9,  [sp, #96]\n"
+  "  ldp d10, d11, [sp, #112]\n"
+  "  ldp d12, d13, [sp, #128]\n"
+  "  ldp d14, d15, [sp, #144]\n"
+  "  add sp, sp, #160\n"
+  "  ret\n"
+);
+
+/* Saved words from the stack pointer upwards: x19-x28, x29, x30 (the return
+   address), d8-d15. */
+#define SAVED_WORDS   20
+#define RETURN_SLOT   11
+
+#endif
+
+void context_init(context_t *ctx, void *stack, size_t stack_size, void (*entry)()) {
+  /* The stack grows downwards from a 16 byte aligned top. */
+  uintptr_t top = ((uintptr_t) stack + stack_size) & ~(uintptr_t) 15;
+  uint64_t *sp;
+
+#if defined(__x86_64__)
+  /* Leave a zero fake return address for entry() on top, so that on entry
+     rsp + 8 is 16 byte aligned, exactly as after a call instruction. */
+  sp = (uint64_t *) top - 1 - SAVED_WORDS;
+  sp[SAVED_WORDS] = 0;
+  for (int i = 0; i < SAVED_WORDS; i++) sp[i] = 0;
+  sp[0] = DEFAULT_FPU;
+#else
+  sp = (uint64_t *) top - SAVED_WORDS;
+  for (int i = 0; i < SAVED_WORDS; i++) sp[i] = 0;
+#endif
+
+  sp[RETURN_SLOT] = (uint64_t) (uintptr_t) entry;
+  ctx->sp = sp;
+}
+
+void context_switch(context_t *from, context_t *to) {
+  context_switch_asm(&from->sp, to->sp);
+}
+
+#else
+
+const char *context_kind = "ucontext";
+
+void context_init(context_t *ctx, void *stack, size_t stack_size, void (*entry)()) {
+  if (getcontext(ctx) < 0) {
+    perror("getcontext");
+    exit(EXIT_FAILURE);
+  }
+
+  ctx->uc_link           = NULL;
+  ctx->uc_stack.ss_sp    = stack;
+  ctx->uc_stack.ss_size  = stack_size;
+  ctx->uc_stack.ss_flags = 0;
+
+  makecontext(ctx, entry, 0);
+}
+
+void context_switch(context_t *from, context_t *to) {
+  if (swapcontext(from, to) < 0) {
+    perror("swapcontext");
+    exit(EXIT_FAILURE);
+  }
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+/* Execution contexts for the Simple Threads library.
+
+   On x86-64 and AArch64 a context switch only saves the registers the calling
+   convention requires a function call to preserve (callee-saved registers and
+   the stack pointer), pushing them on the stack of the thread being switched
+   out. This is what makes a switch cost nanoseconds instead of microseconds:
+   unlike swapcontext() there is no sigprocmask() system call and no save of
+   the full register file.
+
+   On other architectures, or when compiled with -DSTHREADS_UCONTEXT, the
+   ucontext.h functions are used instead.
+*/
+
+#include <stddef.h>   /* size_t */
+
+#if !defined(STHREADS_UCONTEXT) && (defined(__x86_64__) || defined(__aarch64__))
+#define STHREADS_FAST_CONTEXT
+#endif
+
+#ifdef STHREADS_FAST_CONTEXT
+
+typedef struct {
+  void *sp; /* Saved stack pointer, the registers are saved on the stack. */
+} context_t;
+
+#else
+
+/* On Mac OS (aka OS X) the ucontext.h functions are deprecated and requires
+   _XOPEN_SOURCE to be defined before any system header is included.
+*/
+#include <ucontext.h>
+
+typedef ucontext_t context_t;
+
+#endif
+
+/* Name of the context switch implementation, for benchmarks and diagnostics. */
+extern const char *context_kind;
+
+/* Prepares ctx to start executing entry() on the given stack the first time
+   it is switched to. entry() must never return. */
+void context_init(context_t *ctx, void *stack, size_t stack_size, void (*entry)());
+
+/* Saves the current execution state in from and resumes to. Returns when some
+   other context switches back to from. */
+void context_switch(context_t *from, context_t *to);
+
+#endif
@@ -0,0 +1,119 @@
+#include <stdlib.h>   /* malloc(), free() */
+#include <stdbool.h>  /* true, false */
+#include <stdint.h>   /* intptr_t */
+
+#include "deque.h"
+
+/* Initial number of slots, always a power of two. */
+#define DEQUE_SIZE 64
+
+struct deque_array {
+  size_t size;           /* Number of slots, a power of two. */
+  deque_array_t *next;   /* Link in the list of retired arrays. */
+  thread_t *slots[];
+};
+
+/*
+  top and bottom grow monotonically, position pos lives in slot pos & (size -
+  1). The deque holds the threads at positions top .. bottom - 1.
+
+  The owner publishes a thread by storing it in its slot before it releases
+  the new bottom. A taker reads top, then bottom, then the slot and finally
+  claims the position with a CAS on top. If the CAS succeeds no one else can
+  have claimed the position, and since the owner never overwrites a slot that
+  is not yet taken, the thread read from the slot is the right one.
+*/
+
+static deque_array_t *array_new(size_t size) {
+  deque_array_t *array = malloc(sizeof(deque_array_t) + size * sizeof(thread_t *));
+
+  if (array != NULL) {
+    array->size = size;
+    array->next = NULL;
+  }
+  return array;
+}
+
+static thread_t *array_get(deque_array_t *array, size_t pos) {
+  return __atomic_load_n(&array->slots[pos & (array->size - 1)], __ATOMIC_RELAXED);
+}
+
+static void array_put(deque_array_t *array, size_t pos, thread_t *thread) {
+  __atomic_store_n(&array->slots[pos & (array->size - 1)], thread, __ATOMIC_RELAXED);
+}
+
+int deque_init(deque_t *deque) {
+  deque->array = array_new(DEQUE_SIZE);
+
+  if (deque->array == NULL) return -1;
+
+  deque->top = 0;
+  deque->bottom = 0;
+  deque->retired = NULL;
+
+  return 1;
+}
+
+void deque_destroy(deque_t *deque) {
+  free(deque->array);
+  deque->array = NULL;
+
+  while (deque->retired != NULL) {
+    deque_array_t *next = deque->retired->next;
+    free(deque->retired);
+    deque->retired = next;
+  }
+}
+
+int deque_push(deque_t *deque, thread_t *thread) {
+  size_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+  size_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  deque_array_t *array = deque->array;
+
+  if (bottom - top >= array->size) {
+    /* Full, copy the live positions to an array twice the size. */
+    deque_array_t *bigger = array_new(array->size * 2);
+
+    if (bigger == NULL) return -1;
+
+    for (size_t pos = top; pos < bottom; pos++) {
+      array_put(bigger, pos, array_get(array, pos));
+    }
+
+    array->next = deque->retired;
+    deque->retired = array;
+
+    __atomic_store_n(&deque->array, bigger, __ATOMIC_RELEASE);
+    array = bigger;
+  }
+
+  array_put(array, bottom, thread);
+  __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+
+  return 1;
+}
+
+thread_t *deque_take(deque_t *deque) {
+  size_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  size_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+  if ((intptr_t) (bottom - top) <= 0) return NULL;
+
+  deque_array_t *array = __atomic_load_n(&deque->array, __ATOMIC_ACQUIRE);
+  thread_t *thread = array_get(array, top);
+
+  if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                   __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    return NULL;
+  }
+
+  return thread;
+}
+
+size_t deque_size(deque_t *deque) {
+  size_t top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+  size_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+
+  return (intptr_t) (bottom - top) > 0 ? bottom - top : 0;
+}
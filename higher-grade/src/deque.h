@@ -0,0 +1,60 @@
+#ifndef DEQUE_H
+#define DEQUE_H
+
+/* Work-stealing ready queue for the Simple Threads library.
+
+   A Chase-Lev deque of threads owned by a single worker. Only the owner pushes
+   threads, at the bottom. Threads are taken from the top, both by the owner
+   and by other workers stealing work, so every worker runs its threads in FIFO
+   order and yield() rotates through them.
+
+   The array grows when the owner pushes onto a full deque. Thieves may still
+   be reading the old array, so old arrays are kept until deque_destroy().
+*/
+
+#include <stddef.h>   /* size_t */
+
+typedef struct thread thread_t;
+
+typedef struct deque_array deque_array_t;
+
+typedef struct {
+  size_t top;            /* Next thread to take, advanced with a CAS. */
+  size_t bottom;         /* Next free slot, only written by the owner. */
+  deque_array_t *array;
+  deque_array_t *retired; /* Arrays replaced by a larger one. */
+} deque_t;
+
+/* deque_init(deque)
+
+   Initializes an empty deque.
+
+   Returns 1 on success and a negative value on failure.
+*/
+int deque_init(deque_t *deque);
+
+void deque_destroy(deque_t *deque);
+
+/* deque_push(deque, thread)
+
+   Adds thread at the bottom of the deque. Must only be called by the owner.
+
+   Returns 1 on success and a negative value if the deque could not grow.
+*/
+int deque_push(deque_t *deque, thread_t *thread);
+
+/* deque_take(deque)
+
+   Removes the thread at the top of the deque. May be called by any worker.
+
+   Return value
+
+   The oldest thread in the deque or NULL if the deque is empty or another
+   worker took the top thread at the same time.
+*/
+thread_t *deque_take(deque_t *deque);
+
+/* Approximate number of threads in the deque. */
+size_t deque_size(deque_t *deque);
+
+#endif
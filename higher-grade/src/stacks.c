@@ -0,0 +1,115 @@
+#include <unistd.h>   /* sysconf(), _SC_PAGESIZE */
+#include <sys/mman.h> /* mmap(), munmap(), mprotect() */
+
+#include "stacks.h"
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+#ifndef MAP_STACK
+#define MAP_STACK 0
+#endif
+
+/* A released stack. The link is stored at the top of the stack itself, which
+   was the first page used by the thread and is already committed. */
+typedef struct free_stack {
+  struct free_stack *next;
+} free_stack_t;
+
+/* Free list of released stacks of one size. A program typically uses a few
+   different stack sizes, so a short array searched linearly is enough. */
+typedef struct {
+  size_t size;
+  free_stack_t *first;
+} size_class_t;
+
+#define SIZE_CLASSES 8
+
+static size_class_t classes[SIZE_CLASSES];
+
+/* Total number of stacks in all free lists. */
+static int pooled = 0;
+
+static size_t page_size = 0;
+
+static size_t page_round(size_t size) {
+  if (page_size == 0) page_size = (size_t) sysconf(_SC_PAGESIZE);
+  return (size + page_size - 1) & ~(page_size - 1);
+}
+
+static free_stack_t *link_of(void *stack, size_t size) {
+  return (free_stack_t *) ((unsigned char *) stack + size - sizeof(free_stack_t));
+}
+
+static void *stack_of(free_stack_t *link, size_t size) {
+  return (unsigned char *) link + sizeof(free_stack_t) - size;
+}
+
+static size_class_t *find_class(size_t size) {
+  for (int i = 0; i < SIZE_CLASSES; i++) {
+    if (classes[i].size == size) return &classes[i];
+  }
+  return NULL;
+}
+
+static void stack_unmap(void *stack, size_t size) {
+  munmap((unsigned char *) stack - page_size, size + page_size);
+}
+
+void *stack_alloc(size_t *size) {
+  *size = page_round(*size);
+
+  size_class_t *class = find_class(*size);
+
+  if (class != NULL && class->first != NULL) {
+    free_stack_t *link = class->first;
+    class->first = link->next;
+    pooled--;
+    return stack_of(link, *size);
+  }
+
+  /* Reserve the stack and its guard page, the kernel commits pages of the
+     stack as they are touched. */
+  unsigned char *base = mmap(NULL, *size + page_size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK,
+                             -1, 0);
+
+  if (base == MAP_FAILED) return NULL;
+
+  /* Stacks grow downwards, the guard page goes below the stack. */
+  if (mprotect(base, page_size, PROT_NONE) < 0) {
+    munmap(base, *size + page_size);
+    return NULL;
+  }
+
+  return base + page_size;
+}
+
+void stack_release(void *stack, size_t size) {
+  size_class_t *class = find_class(size);
+
+  if (class == NULL) {
+    /* Claim an empty size class if there is one. */
+    for (int i = 0; i < SIZE_CLASSES && class == NULL; i++) {
+      if (classes[i].first == NULL) {
+        classes[i].size = size;
+        class = &classes[i];
+      }
+    }
+  }
+
+  if (class == NULL || pooled >= STACK_POOL_MAX) {
+    stack_unmap(stack, size);
+    return;
+  }
+
+  free_stack_t *link = link_of(stack, size);
+  link->next = class->first;
+  class->first = link;
+  pooled++;
+}
+
+int stack_pool_count() {
+  return pooled;
+}
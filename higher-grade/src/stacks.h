@@ -0,0 +1,49 @@
+#ifndef STACKS_H
+#define STACKS_H
+
+/* Thread stacks for the Simple Threads library.
+
+   Every stack is a private anonymous mapping with a PROT_NONE guard page
+   below the lowest usable address, so a thread overflowing its stack gets a
+   segmentation fault instead of silently corrupting the heap. Pages are only
+   committed by the kernel when touched, so a large stack that is never used
+   deeply costs little more than its guard page.
+
+   Released stacks are kept in a pool, one free list per stack size, and are
+   handed out again by the next stack_alloc() of the same size. This keeps the
+   cost of spawn() roughly constant under churn. The pool holds at most
+   STACK_POOL_MAX stacks, stacks released when the pool is full are unmapped,
+   so memory stays bounded no matter how many threads come and go.
+
+   The pool is not thread safe. sthreads only calls these functions with its
+   scheduler lock held.
+*/
+
+#include <stddef.h>   /* size_t */
+
+/* Maximum number of released stacks kept for reuse. */
+#define STACK_POOL_MAX 64
+
+/* stack_alloc(size)
+
+   Allocates a stack with at least *size usable bytes. *size is rounded up to
+   a whole number of pages and updated, the same value must later be passed
+   to stack_release().
+
+   Return value
+
+   The lowest usable address of the stack or NULL on failure.
+*/
+void *stack_alloc(size_t *size);
+
+/* stack_release(stack, size)
+
+   Hands a stack previously returned by stack_alloc() back to the pool. The
+   stack must not be in use.
+*/
+void stack_release(void *stack, size_t size);
+
+/* Number of stacks currently kept in the pool. */
+int stack_pool_count();
+
+#endif
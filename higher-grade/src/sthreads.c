@@ -7,37 +7,555 @@
    flag must also be used to suppress compiler warnings.
 */
 
-#include <signal.h>   /* SIGSTKSZ (default stack size), MINDIGSTKSZ (minimal
+#include <signal.h>   /* SIGSTKSZ (default stack size), MINSIGSTKSZ (minimal
                          stack size) */
 #include <stdio.h>    /* puts(), printf(), fprintf(), perror(), setvbuf(), _IOLBF,
                          stdout, stderr */
-#include <stdlib.h>   /* exit(), EXIT_SUCCESS, EXIT_FAILURE, malloc(), free() */
-#include <ucontext.h> /* ucontext_t, getcontext(), makecontext(),
-                         setcontext(), swapcontext() */
+#include <stdlib.h>   /* exit(), EXIT_SUCCESS, EXIT_FAILURE, malloc(), free(),
+                         posix_memalign() */
 #include <stdbool.h>  /* true, false */
+#include <string.h>   /* memset() */
+#include <errno.h>    /* errno */
+#include <time.h>     /* nanosleep(), struct timespec */
+#include <sched.h>    /* sched_yield() */
+#include <pthread.h>  /* pthread_create(), pthread_detach() */
+#include <sys/time.h> /* ITIMER_VIRTUAL, struct itimerval, setitimer() */
 
 #include "sthreads.h"
+#include "sthreads_internal.h" /* critical_t, spin_lock(), spin_unlock() */
+#include "context.h"  /* context_t, context_init(), context_switch() */
+#include "stacks.h"   /* stack_alloc(), stack_release() */
+#include "deque.h"    /* deque_t, deque_push(), deque_take() */
+#include "trace.h"    /* trace_enabled, trace_start(), trace_switch(), trace_export() */
+#include "timing.h"   /* timing_start(), timing_stop() */
 
-/* Stack size for each context. */
+/* Default stack size for each context. */
 #define STACK_SIZE SIGSTKSZ*100
 
+/* Stack size for the idle context of the worker running main(). */
+#define IDLE_STACK_SIZE (64 * 1024)
+
+/* Timer used for preemption, it counts CPU time spent by the process and
+   generates SIGVTALRM. */
+#define TIMER_TYPE   ITIMER_VIRTUAL
+#define TIMER_SIGNAL SIGVTALRM
+
+/* Every AGING_PERIOD picks, a worker runs a thread from its lowest non-empty
+   level instead of its highest, see pick_ready(). */
+#define AGING_PERIOD   16
+
+/* An idle worker first spins, then yields the processor and finally sleeps
+   between attempts to steal work. */
+#define IDLE_SPINS     64
+#define IDLE_YIELDS    64
+#define IDLE_SLEEP_NS  100000
+
+/* With more than one worker, an idle worker blocks in the reactor for at most
+   IDLE_POLL_MS at a time, since another worker may have threads to steal. */
+#define IDLE_POLL_MS   1
+
+/* Every IO_POLL_PERIOD context switches and yields, a worker polls the reactor
+   without blocking, so threads waiting on I/O are woken even if the worker
+   never runs out of ready threads. */
+#define IO_POLL_PERIOD 64
+
+/* Workers are kept on separate cache lines. */
+#define WORKER_ALIGN   128
+
 /*******************************************************************************
                              Global data structures
-
-                Add data structures to manage the threads here.
 ********************************************************************************/
 
+/* A FIFO queue of threads doubly linked through the next and prev fields, so
+   that any thread can be removed in constant time. A thread is in at most one
+   queue at a time. */
+typedef struct {
+  thread_t *first;
+  thread_t *last;
+} queue_t;
+
+/* What the thread resumed by a context switch must do with the thread that
+   switched to it. These actions cannot be done by the thread switching away,
+   since another worker could then resume it before its context is saved. */
+typedef enum {
+  AFTER_NOTHING,
+  AFTER_READY,  /* Make the previous thread ready. */
+  AFTER_UNLOCK, /* Release a spin lock held by the previous thread. */
+  AFTER_DONE    /* Release the stack of the previous thread, then sched_lock. */
+} after_t;
+
+/* A kernel thread running green threads. */
+typedef struct {
+  int        id;
+  thread_t   *current;   /* The thread executing on this worker, NULL when idle. */
+  deque_t    ready[PRIORITIES]; /* Ready threads by level, other workers
+                                   steal from the top. */
+  unsigned   picks;      /* Number of calls to pick_ready(), for aging. */
+  unsigned   polls;      /* Chances to poll the reactor, see poll_period(). */
+  unsigned long ticks;   /* Timer signals taken, see timer_handler(). */
+  context_t  idle_ctx;   /* Looks for work when there is no ready thread. */
+  void       *idle_stack;
+  size_t     idle_stack_size;
+  thread_t   *prev;      /* The thread that switched away on this worker ... */
+  after_t    after;      /* ... and what to do with it ... */
+  int        *lock;      /* ... and the lock it holds for AFTER_UNLOCK. */
+} __attribute__((aligned(WORKER_ALIGN))) worker_t;
+
+/* All workers, workers[0] runs on the kernel thread that called init(). */
+static worker_t *workers = NULL;
+static int nworkers = 0;
+
+/* The worker executing on this kernel thread. */
+static __thread worker_t *self = NULL;
+
+/* Protects the join and terminated queues, the thread table, next_tid and the
+   stack pool. */
+static int sched_lock = 0;
+
+/* Threads blocked in join(). */
+static queue_t join_queue = {NULL, NULL};
+
+/* Threads that have called done() but have not been joined yet, except those
+   that had threads waiting for them in join_tid(), only these may reap them. */
+static queue_t terminated_queue = {NULL, NULL};
+
+/* Threads that have not been joined yet by thread ID, a hash table chained
+   through the hash_next field. The number of buckets is a power of two and
+   is doubled when there are more threads than buckets. */
+static thread_t **table = NULL;
+static size_t table_size = 0;
+static size_t table_count = 0;
 
+#define TABLE_SIZE 64
 
+/* Thread ID for the next spawned thread. The main thread gets ID 0. */
+static tid_t next_tid = 0;
+
+/* Number of running and ready threads, and of threads waiting on the
+   reactor, see park_io(). A running thread always makes other threads
+   runnable before it stops being runnable itself, so when the count drops to
+   zero no thread can ever run again. */
+static int runnable = 0;
+
+/* Number of threads blocked in park(), on a synchronization primitive or in
+   join(). Tells apart the two ways runnable can drop to zero: every thread
+   has terminated, or the remaining threads wait for each other forever. */
+static int parked = 0;
+
+/* Set if time accounting is turned on. */
+static bool stats = false;
+
+/* Set if preemption is turned on. */
+static bool preemptive = false;
+
+/* The signals blocked inside critical sections. */
+static sigset_t timer_signals;
 
 /*******************************************************************************
                              Auxiliary functions
-
-                      Add internal helper functions here.
 ********************************************************************************/
 
+static void enqueue(queue_t *queue, thread_t *thread) {
+  thread->next = NULL;
+  thread->prev = queue->last;
+
+  if (queue->last == NULL) {
+    queue->first = thread;
+  } else {
+    queue->last->next = thread;
+  }
+  queue->last = thread;
+}
+
+static void remove_from(queue_t *queue, thread_t *thread) {
+  if (thread->prev == NULL) {
+    queue->first = thread->next;
+  } else {
+    thread->prev->next = thread->next;
+  }
+
+  if (thread->next == NULL) {
+    queue->last = thread->prev;
+  } else {
+    thread->next->prev = thread->prev;
+  }
+
+  thread->next = NULL;
+  thread->prev = NULL;
+}
+
+static bool in_queue(queue_t *queue, thread_t *thread) {
+  return thread->prev != NULL || queue->first == thread;
+}
+
+static thread_t *dequeue(queue_t *queue) {
+  thread_t *thread = queue->first;
+
+  if (thread != NULL) remove_from(queue, thread);
+  return thread;
+}
+
+static bool is_empty(queue_t *queue) {
+  return queue->first == NULL;
+}
+
+static thread_t **table_bucket(thread_t **buckets, size_t size, tid_t tid) {
+  return &buckets[(size_t) tid & (size - 1)];
+}
+
+/* Returns 1 on success and a negative value if the table could not grow. */
+static int table_insert(thread_t *thread) {
+  if (table_count >= table_size) {
+    size_t size = table_size == 0 ? TABLE_SIZE : table_size * 2;
+    thread_t **buckets = calloc(size, sizeof(thread_t *));
+
+    if (buckets == NULL) return -1;
+
+    for (size_t i = 0; i < table_size; i++) {
+      thread_t *t = table[i];
+      while (t != NULL) {
+        thread_t *next = t->hash_next;
+        thread_t **bucket = table_bucket(buckets, size, t->tid);
+        t->hash_next = *bucket;
+        *bucket = t;
+        t = next;
+      }
+    }
+
+    free(table);
+    table = buckets;
+    table_size = size;
+  }
+
+  thread_t **bucket = table_bucket(table, table_size, thread->tid);
+  thread->hash_next = *bucket;
+  *bucket = thread;
+  table_count++;
+
+  return 1;
+}
+
+static thread_t *table_find(tid_t tid) {
+  if (table_size == 0) return NULL;
+
+  thread_t *thread = *table_bucket(table, table_size, tid);
+  while (thread != NULL && thread->tid != tid) thread = thread->hash_next;
+  return thread;
+}
+
+static void table_remove(thread_t *thread) {
+  thread_t **link = table_bucket(table, table_size, thread->tid);
+
+  while (*link != thread) link = &(*link)->hash_next;
+  *link = thread->hash_next;
+  thread->hash_next = NULL;
+  table_count--;
+}
+
+static void add_runnable(int n) {
+  __atomic_fetch_add(&runnable, n, __ATOMIC_RELEASE);
+}
+
+/* Green threads move between kernel threads, so the worker must be looked up
+   again after every context switch. The compiler may keep the address of
+   a thread local variable in a register across function calls, which is why
+   the lookup is done in a function it cannot inline or treat as pure. */
+static __attribute__((noinline)) worker_t *this_worker() {
+  worker_t *worker = self;
+  __asm__ __volatile__("" : "+r" (worker) :: "memory");
+  return worker;
+}
+
+void enter_critical(critical_t *cs) {
+  cs->masked = preemptive;
+  if (cs->masked) sigprocmask(SIG_BLOCK, &timer_signals, &cs->old);
+}
+
+void leave_critical(critical_t *cs) {
+  if (cs->masked) sigprocmask(SIG_SETMASK, &cs->old, NULL);
+}
+
+/* Changes the state of thread, adding the time spent in the old state to its
+   statistics. */
+static void set_state(thread_t *thread, state_t state) {
+  if (stats) {
+    double elapsed = timing_stop(&thread->since);
+
+    switch (thread->state) {
+    case running:
+      thread->stats.running += elapsed;
+      break;
+    case ready:
+      thread->stats.ready += elapsed;
+      break;
+    case waiting:
+      thread->stats.waiting += elapsed;
+      break;
+    case terminated:
+      break;
+    }
+
+    timing_start(&thread->since);
+  }
+
+  thread->state = state;
+}
+
+/* Marks next as running on worker after prev, or the idle context if NULL. */
+static void switch_in(worker_t *worker, thread_t *prev, thread_t *next) {
+  if (next != NULL) {
+    set_state(next, running);
+    next->stats.switches++;
+    next->slice = worker->ticks;
+  }
+
+  worker->current = next;
+
+  if (trace_enabled) {
+    trace_switch(worker->id, prev != NULL ? prev->tid : -1, next != NULL ? next->tid : -1);
+  }
+}
+
+/* Puts thread in the ready deque of worker for its level. The worker must be
+   the worker executing the caller. */
+static void make_ready(worker_t *worker, thread_t *thread) {
+  set_state(thread, ready);
+
+  if (deque_push(&worker->ready[thread->level], thread) < 0) {
+    perror("Could not grow the ready deque");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/*
+  Multi-level feedback queue
+
+  Every worker has one ready deque per level, level 0 is served first. A
+  thread starts at the level given by its priority. A thread that is
+  preempted, having used its whole time slice, drops one level. A thread that
+  blocks or yields before that keeps its level.
+
+  To keep threads at low levels from starving, every AGING_PERIOD picks the
+  worker serves its lowest non-empty level instead, and the thread picked is
+  moved back up to the level of its priority.
+*/
+
+/* Takes the ready thread of worker with the lowest level, no higher than
+   max_level, or if steal is set a ready thread of another worker. Returns
+   NULL if no ready thread was found. */
+static thread_t *pick_ready(worker_t *worker, int max_level, bool steal) {
+  thread_t *thread = NULL;
+
+  if (++worker->picks % AGING_PERIOD == 0) {
+    for (int level = PRIORITIES - 1; level > 0 && thread == NULL; level--) {
+      thread = deque_take(&worker->ready[level]);
+    }
+
+    if (thread != NULL) {
+      thread->level = thread->priority;
+      return thread;
+    }
+  }
+
+  for (int level = 0; level <= max_level && thread == NULL; level++) {
+    thread = deque_take(&worker->ready[level]);
+  }
+
+  for (int level = 0; steal && level <= max_level && thread == NULL; level++) {
+    for (int i = 1; thread == NULL && i < nworkers; i++) {
+      thread = deque_take(&workers[(worker->id + i) % nworkers].ready[level]);
+    }
+  }
+  return thread;
+}
+
+/* Takes a ready thread of any level from worker, or steals one from another
+   worker. Returns NULL if no ready thread was found. */
+static thread_t *find_ready(worker_t *worker) {
+  return pick_ready(worker, PRIORITIES - 1, true);
+}
+
+/* Polls the reactor without blocking every IO_POLL_PERIOD calls. Must be
+   called inside a critical section, without any spin lock held. */
+static void poll_period(worker_t *worker) {
+  if (++worker->polls % IO_POLL_PERIOD == 0) io_poll(0);
+}
+
+/* Carries out the action left by the thread that switched to the caller.
+   Must be called right after every context switch. */
+static void finish_switch() {
+  worker_t *worker = this_worker();
+
+  switch (worker->after) {
+  case AFTER_READY:
+    make_ready(worker, worker->prev);
+    break;
+  case AFTER_UNLOCK:
+    spin_unlock(worker->lock);
+    break;
+  case AFTER_DONE:
+    /* The stack is not needed to be joined, only the thread_t. */
+    if (worker->prev->stack != NULL) {
+      stack_release(worker->prev->stack, worker->prev->stack_size);
+      worker->prev->stack = NULL;
+    }
+    spin_unlock(&sched_lock);
+    break;
+  case AFTER_NOTHING:
+    break;
+  }
+
+  worker->after = AFTER_NOTHING;
+  worker->prev = NULL;
+  worker->lock = NULL;
+
+  /* The resumed context holds no spin lock, the one it passed to park() was
+     released by the context that resumed it. */
+  poll_period(worker);
+}
+
+/* Switches from the current thread of worker to next, or to the idle context
+   of worker if next is NULL. The caller must have put the current thread in
+   the queue matching its new state, or ask for it to be made ready with
+   after. With AFTER_UNLOCK, lock is released once the current thread is
+   switched out. Must be called inside a critical section. */
+static void dispatch(worker_t *worker, thread_t *next, after_t after, int *lock) {
+  thread_t *prev = worker->current;
+
+  worker->prev = prev;
+  worker->after = after;
+  worker->lock = lock;
+
+  switch_in(worker, prev, next);
+
+  if (next != NULL) {
+    context_switch(&prev->ctx, &next->ctx);
+  } else {
+    context_switch(&prev->ctx, &worker->idle_ctx);
+  }
+
+  finish_switch();
+}
+
+static void idle_backoff(int round) {
+  if (round < IDLE_SPINS) {
+    cpu_relax();
+  } else if (round < IDLE_SPINS + IDLE_YIELDS) {
+    sched_yield();
+  } else {
+    struct timespec ts = {0, IDLE_SLEEP_NS};
+    nanosleep(&ts, NULL);
+  }
+}
+
+/* Ends the process once no thread can run. It succeeds if every thread has
+   terminated, threads left blocked are deadlocked and reported to stderr. */
+static void stopped() {
+  if (__atomic_load_n(&parked, __ATOMIC_RELAXED) == 0) exit(EXIT_SUCCESS);
+
+  /* Held until exit(), another worker finding the deadlock stops here. */
+  spin_lock(&sched_lock);
+
+  fprintf(stderr, "sthreads: deadlock, %d blocked threads and none can run:",
+          __atomic_load_n(&parked, __ATOMIC_RELAXED));
+
+  for (size_t i = 0; i < table_size; i++) {
+    for (thread_t *thread = table[i]; thread != NULL; thread = thread->hash_next) {
+      if (thread->state == waiting) fprintf(stderr, " %d", thread->tid);
+    }
+  }
+
+  fprintf(stderr, "\n");
+  exit(EXIT_FAILURE);
+}
+
+/* Runs ready threads on worker until there are no runnable threads left. The
+   idle context always stays on the kernel thread of its worker. */
+static void idle(worker_t *worker) {
+  int round = 0;
+
+  while (true) {
+    thread_t *next = find_ready(worker);
+
+    if (next != NULL) {
+      round = 0;
+      switch_in(worker, NULL, next);
+      context_switch(&worker->idle_ctx, &next->ctx);
+      finish_switch();
+      continue;
+    }
+
+    if (__atomic_load_n(&runnable, __ATOMIC_ACQUIRE) == 0) {
+      /* Nothing can ever run again. */
+      stopped();
+    }
+
+    /* A single worker only gets ready threads from the reactor, it can block
+       there until the next event. */
+    int timeout = nworkers == 1 ? -1 : round < IDLE_SPINS + IDLE_YIELDS ? 0 : IDLE_POLL_MS;
+
+    if (io_poll(timeout) > 0) {
+      round = 0;
+      continue;
+    }
+
+    idle_backoff(round++);
+  }
+}
+
+/* The idle context of the worker running main(). */
+static void idle_start() {
+  finish_switch();
+  idle(this_worker());
+}
+
+/* Start routine for the kernel threads of workers 1 .. nworkers - 1. */
+static void *worker_start(void *arg) {
+  self = arg;
+  idle(self);
+  return NULL;
+}
+
+/* Every spawned thread starts executing here. */
+static void trampoline() {
+  finish_switch();
+
+  /* The thread is dispatched from inside a critical section. */
+  if (preemptive) sigprocmask(SIG_UNBLOCK, &timer_signals, NULL);
+
+  this_worker()->current->start();
+  done();
+}
+
+/* Frees a terminated thread that has been taken off the terminated queue.
+   Must be called with sched_lock held, which is released. */
+static void reap(thread_t *thread) {
+  table_remove(thread);
+  spin_unlock(&sched_lock);
+
+  free(thread);
+}
 
+static void timer_handler(int signum) {
+  (void) signum;
+  int saved_errno = errno;
 
+  /* The signal is blocked inside critical sections, so the scheduler data
+     structures are consistent here. */
+  worker_t *worker = this_worker();
+  thread_t *thread = worker->current;
+
+  /* The timer runs freely, a thread dispatched since the previous tick has
+     not used up its time slice yet and runs until the next one. */
+  if (++worker->ticks - thread->slice >= 2) {
+    if (thread->level < PRIORITIES - 1) thread->level++;
+    thread->stats.preemptions++;
+
+    yield();
+  }
+
+  errno = saved_errno;
+}
 
 /*******************************************************************************
                     Implementation of the Simple Threads API
@@ -45,20 +563,420 @@
 
 
 int  init(){
+  return init_workers(1);
+}
+
+int init_workers(int n) {
+  if (n < 1 || workers != NULL) return -1;
+
+  void *memory;
+  if (posix_memalign(&memory, WORKER_ALIGN, n * sizeof(worker_t)) != 0) {
+    return -1;
+  }
+
+  workers = memory;
+  nworkers = n;
+  memset(workers, 0, n * sizeof(worker_t));
+
+  for (int i = 0; i < n; i++) {
+    workers[i].id = i;
+    for (int level = 0; level < PRIORITIES; level++) {
+      if (deque_init(&workers[i].ready[level]) < 0) return -1;
+    }
+  }
+
+  thread_t *main_thread = malloc(sizeof(thread_t));
+
+  if (main_thread == NULL) return -1;
+
+  main_thread->tid = next_tid++;
+  main_thread->state = running;
+  main_thread->start = NULL;
+  main_thread->stack = NULL;
+  main_thread->stack_size = 0;
+  main_thread->next = NULL;
+  main_thread->prev = NULL;
+  main_thread->joiners = NULL;
+  memset(&main_thread->stats, 0, sizeof(thread_stats_t));
+  timing_start(&main_thread->since);
+  main_thread->priority = PRIORITY_HIGH;
+  main_thread->level = PRIORITY_HIGH;
+  main_thread->slice = 0;
+
+  if (table_insert(main_thread) < 0) return -1;
+
+  if (io_init() < 0) return -1;
+
+  runnable = 1;
+
+  /* main() keeps running on the process stack, worker 0 needs a stack of its
+     own to look for work on. */
+  self = &workers[0];
+  self->current = main_thread;
+  self->idle_stack_size = IDLE_STACK_SIZE;
+  self->idle_stack = stack_alloc(&self->idle_stack_size);
+
+  if (self->idle_stack == NULL) return -1;
+
+  context_init(&self->idle_ctx, self->idle_stack, self->idle_stack_size, idle_start);
+
+  sigemptyset(&timer_signals);
+  sigaddset(&timer_signals, TIMER_SIGNAL);
+
+  for (int i = 1; i < n; i++) {
+    pthread_t pthread;
+
+    if (pthread_create(&pthread, NULL, worker_start, &workers[i]) != 0) return -1;
+    pthread_detach(pthread);
+  }
+
   return 1;
 }
 
 
 tid_t spawn(void (*start)()){
-  return -1;
+  return spawn_thread(start, 0, PRIORITY_HIGH);
+}
+
+tid_t spawn_with_stack(void (*start)(), size_t stack_size){
+  return spawn_thread(start, stack_size, PRIORITY_HIGH);
+}
+
+tid_t spawn_with_priority(void (*start)(), int priority){
+  return spawn_thread(start, 0, priority);
+}
+
+tid_t spawn_thread(void (*start)(), size_t stack_size, int priority){
+  if (priority < PRIORITY_HIGH || priority > PRIORITY_LOW) return -1;
+
+  if (stack_size == 0) stack_size = STACK_SIZE;
+  if (stack_size < MINSIGSTKSZ) stack_size = MINSIGSTKSZ;
+
+  critical_t cs;
+  enter_critical(&cs);
+
+  thread_t *thread = malloc(sizeof(thread_t));
+
+  spin_lock(&sched_lock);
+
+  void *stack = thread != NULL ? stack_alloc(&stack_size) : NULL;
+  tid_t tid = next_tid++;
+
+  if (stack != NULL) {
+    thread->tid = tid;
+    thread->joiners = NULL;
+
+    if (table_insert(thread) < 0) {
+      stack_release(stack, stack_size);
+      stack = NULL;
+    }
+  }
+
+  if (stack != NULL) add_runnable(1);
+
+  spin_unlock(&sched_lock);
+
+  if (stack == NULL) {
+    free(thread);
+    leave_critical(&cs);
+    return -1;
+  }
+
+  context_init(&thread->ctx, stack, stack_size, trampoline);
+
+  thread->start = start;
+  thread->stack = stack;
+  thread->stack_size = stack_size;
+  thread->priority = priority;
+  thread->level = priority;
+  thread->slice = 0;
+  thread->state = ready;
+  memset(&thread->stats, 0, sizeof(thread_stats_t));
+  timing_start(&thread->since);
+
+  make_ready(this_worker(), thread);
+
+  leave_critical(&cs);
+
+  return tid;
 }
 
 void yield(){
+  critical_t cs;
+  enter_critical(&cs);
+
+  /* Only the threads of this worker at the same or a lower level take turns,
+     if there are none there is nothing to yield to. */
+  worker_t *worker = this_worker();
+  thread_t *next = pick_ready(worker, worker->current->level, false);
+
+  if (next != NULL) {
+    set_state(worker->current, ready);
+    dispatch(worker, next, AFTER_READY, NULL);
+  } else {
+    /* Without a switch the reactor would never be polled. A thread that
+       keeps running starts a new time slice, same as if redispatched. */
+    worker->current->slice = worker->ticks;
+    poll_period(worker);
+  }
+
+  leave_critical(&cs);
 }
 
 void  done(){
+  critical_t cs;
+  enter_critical(&cs);
+
+  spin_lock(&sched_lock);
+
+  worker_t *worker = this_worker();
+
+  thread_t *thread = worker->current;
+
+  set_state(thread, terminated);
+
+  /* Wake up the threads waiting for this thread in join_tid(), or if there
+     are none every thread waiting in join(). The first joiner to run reaps
+     this thread. A thread with join_tid() waiters is kept off the terminated
+     queue, so that a join() running before them cannot take it. The joiners
+     count as runnable before this thread stops counting, so runnable never
+     drops to zero while there is something left to run. */
+  thread_t *joiner;
+
+  if (thread->joiners != NULL) {
+    thread->next = NULL;
+    thread->prev = NULL;
+
+    while ((joiner = thread->joiners) != NULL) {
+      thread->joiners = joiner->next;
+      unpark(joiner);
+    }
+  } else {
+    enqueue(&terminated_queue, thread);
+
+    while ((joiner = dequeue(&join_queue)) != NULL) {
+      unpark(joiner);
+    }
+  }
+
+  add_runnable(-1);
+
+  /* The stack is released and the lock is released after the switch, when
+     this thread is off its stack and can safely be reaped. */
+  dispatch(worker, find_ready(worker), AFTER_DONE, NULL);
+
+  /* Never reached, a terminated thread is never dispatched again. */
+  leave_critical(&cs);
 }
 
 tid_t join() {
-  return -1;
+  critical_t cs;
+  enter_critical(&cs);
+
+  spin_lock(&sched_lock);
+
+  while (is_empty(&terminated_queue)) {
+    if (__atomic_load_n(&runnable, __ATOMIC_ACQUIRE) == 1) {
+      /* No other thread can run, so no thread can terminate. */
+      spin_unlock(&sched_lock);
+      leave_critical(&cs);
+      return -1;
+    }
+
+    /* done() cannot wake this thread before it is switched out, since the
+       lock is held until then. */
+    enqueue(&join_queue, current_thread());
+    park(&sched_lock);
+
+    spin_lock(&sched_lock);
+  }
+
+  thread_t *thread = dequeue(&terminated_queue);
+  tid_t tid = thread->tid;
+
+  reap(thread);
+  leave_critical(&cs);
+
+  return tid;
+}
+
+tid_t join_tid(tid_t tid) {
+  critical_t cs;
+  enter_critical(&cs);
+
+  spin_lock(&sched_lock);
+
+  thread_t *thread;
+
+  while ((thread = table_find(tid)) != NULL && thread->state != terminated) {
+    if (thread == current_thread() ||
+        __atomic_load_n(&runnable, __ATOMIC_ACQUIRE) == 1) {
+      /* Joining itself, or no other thread can run. */
+      break;
+    }
+
+    /* The next field is free while this thread is waiting. */
+    thread_t *me = current_thread();
+    me->next = thread->joiners;
+    thread->joiners = me;
+
+    park(&sched_lock);
+
+    spin_lock(&sched_lock);
+  }
+
+  if (thread == NULL || thread->state != terminated) {
+    /* Never spawned, already joined by someone else or can never terminate. */
+    spin_unlock(&sched_lock);
+    leave_critical(&cs);
+    return -1;
+  }
+
+  if (in_queue(&terminated_queue, thread)) remove_from(&terminated_queue, thread);
+
+  reap(thread);
+  leave_critical(&cs);
+
+  return tid;
+}
+
+thread_t *current_thread() {
+  return this_worker()->current;
+}
+
+void park(int *lock) {
+  /* Counted as parked before it stops being runnable, see stopped(). */
+  __atomic_fetch_add(&parked, 1, __ATOMIC_RELAXED);
+  add_runnable(-1);
+  park_io(lock);
+}
+
+void unpark(thread_t *thread) {
+  add_runnable(1);
+  __atomic_fetch_sub(&parked, 1, __ATOMIC_RELAXED);
+  unpark_io(thread);
+}
+
+void park_io(int *lock) {
+  worker_t *worker = this_worker();
+
+  set_state(worker->current, waiting);
+
+  dispatch(worker, find_ready(worker), AFTER_UNLOCK, lock);
+}
+
+void unpark_io(thread_t *thread) {
+  make_ready(this_worker(), thread);
+}
+
+int set_timeslice(int ms) {
+  struct itimerval timer;
+  struct sigaction sa;
+
+  if (ms < 0) return -1;
+
+  /* The timer signal would interrupt a random kernel thread, preemption is
+     only supported with a single worker. */
+  if (nworkers > 1 && ms > 0) return -1;
+
+  if (ms == 0) {
+    /* Stop the timer before turning preemption off, a signal in between
+       would otherwise find the scheduler unprotected. */
+    memset(&timer, 0, sizeof(timer));
+    if (setitimer(TIMER_TYPE, &timer, NULL) < 0) return -1;
+    preemptive = false;
+    return 1;
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = timer_handler;
+  sa.sa_flags = SA_RESTART;
+  if (sigaction(TIMER_SIGNAL, &sa, NULL) < 0) return -1;
+
+  preemptive = true;
+
+  timer.it_value.tv_sec = ms / 1000;
+  timer.it_value.tv_usec = (ms % 1000) * 1000;
+  timer.it_interval = timer.it_value;
+
+  if (setitimer(TIMER_TYPE, &timer, NULL) < 0) return -1;
+
+  return 1;
+}
+
+int set_stats(int on) {
+  critical_t cs;
+  enter_critical(&cs);
+  spin_lock(&sched_lock);
+
+  /* Time before accounting was turned on is not counted. */
+  if (on && !stats) {
+    for (size_t i = 0; i < table_size; i++) {
+      for (thread_t *thread = table[i]; thread != NULL; thread = thread->hash_next) {
+        timing_start(&thread->since);
+      }
+    }
+  }
+
+  stats = on != 0;
+
+  spin_unlock(&sched_lock);
+  leave_critical(&cs);
+
+  return 1;
+}
+
+int get_stats(tid_t tid, thread_stats_t *out) {
+  critical_t cs;
+  enter_critical(&cs);
+  spin_lock(&sched_lock);
+
+  thread_t *thread = table_find(tid);
+  if (thread != NULL) *out = thread->stats;
+
+  spin_unlock(&sched_lock);
+  leave_critical(&cs);
+
+  return thread != NULL ? 1 : -1;
+}
+
+static const char *state_name(state_t state) {
+  switch (state) {
+  case running:    return "running";
+  case ready:      return "ready";
+  case waiting:    return "waiting";
+  case terminated: return "terminated";
+  }
+  return "?";
+}
+
+void dump_stats(FILE *out) {
+  critical_t cs;
+  enter_critical(&cs);
+  spin_lock(&sched_lock);
+
+  fprintf(out, "%8s %5s %5s %-10s %10s %10s %12s %12s %12s\n",
+          "tid", "prio", "level", "state", "switches", "preempted",
+          "running (s)", "ready (s)", "waiting (s)");
+
+  /* The table is not sorted, threads are listed in bucket order. */
+  for (size_t i = 0; i < table_size; i++) {
+    for (thread_t *thread = table[i]; thread != NULL; thread = thread->hash_next) {
+      fprintf(out, "%8d %5d %5d %-10s %10lu %10lu %12.6f %12.6f %12.6f\n",
+              thread->tid, thread->priority, thread->level, state_name(thread->state),
+              thread->stats.switches, thread->stats.preemptions,
+              thread->stats.running, thread->stats.ready, thread->stats.waiting);
+    }
+  }
+
+  spin_unlock(&sched_lock);
+  leave_critical(&cs);
+}
+
+int set_trace(int events) {
+  return trace_start(events);
+}
+
+int dump_trace(FILE *out) {
+  return trace_export(out, nworkers) < 0 ? -1 : 1;
 }
@@ -10,7 +10,11 @@
    flag must also be used to suppress compiler warnings.
 */
 
-#include <ucontext.h>
+#include <stddef.h>  /* size_t */
+#include <stdio.h>   /* FILE */
+#include <time.h>    /* struct timespec */
+
+#include "context.h" /* context_t */
 
 /* A thread can be in one of the following states. */
 typedef enum {running, ready, waiting, terminated} state_t;
@@ -18,8 +22,23 @@ typedef enum {running, ready, waiting, terminated} state_t;
 /* Thread ID. */
 typedef int tid_t;
 
+/* Number of priority levels. Level 0 is the highest priority, threads at a
+   level only run when there are no ready threads at the levels above it. */
+#define PRIORITIES    4
+#define PRIORITY_HIGH 0
+#define PRIORITY_LOW  (PRIORITIES - 1)
+
 typedef struct thread thread_t;
 
+/* Scheduler statistics for a single thread, see set_stats(). */
+typedef struct {
+  unsigned long switches;    /* times the thread has been dispatched */
+  unsigned long preemptions; /* times the thread has been preempted */
+  double running;            /* seconds spent in each state */
+  double ready;
+  double waiting;
+} thread_stats_t;
+
 /* Data to manage a single thread should be kept in this structure. Here are a few
    suggestions of data you may want in this structure but you may change this to
    your own liking.
@@ -27,8 +46,20 @@ typedef struct thread thread_t;
 struct thread {
   tid_t tid;
   state_t state;
-  ucontext_t ctx;
+  context_t ctx;
+  void (*start)(); /* the function executed by the thread */
+  void *stack;     /* NULL for the main thread, which runs on the process stack,
+                      and once the thread has terminated */
+  size_t stack_size;
   thread_t *next; /* can use this to create a linked list of threads */
+  thread_t *prev;
+  thread_t *joiners;   /* threads waiting in join_tid() for this thread */
+  thread_t *hash_next; /* chain in the table of threads by thread ID */
+  int priority;        /* the highest level the thread may run at */
+  int level;           /* the current level, priority or lower */
+  unsigned long slice; /* timer ticks of its worker when its time slice began */
+  thread_stats_t stats;
+  struct timespec since; /* when the thread entered its current state */
 };
 
 
@@ -50,6 +81,24 @@ new functions to the API.
 */
 int init();
 
+/* M:N initialization
+
+   Like init(), but threads are run by n kernel threads (workers) instead of
+   one. The calling kernel thread becomes worker 0 and n - 1 new kernel threads
+   are created. Each worker has its own queue of ready threads, a worker
+   without ready threads steals them from the other workers. A thread may
+   continue on another worker after any call to the API.
+
+   spawn() makes the new thread ready on the calling worker and yield() only
+   takes turns with the threads ready on the calling worker. Preemption is not
+   supported with more than one worker.
+
+   A user program must call either init() or init_workers() exactly once.
+
+   Returns 1 on success and a negative value on failure.
+*/
+int init_workers(int n);
+
 /* Creates a new thread executing the start function.
 
    start - a function with zero arguments returning void.
@@ -59,11 +108,47 @@ int init();
 */
 tid_t spawn(void (*start)());
 
+/* Creates a new thread executing the start function on a stack of at least
+   stack_size bytes. A stack_size of zero gives the default stack size used by
+   spawn().
+
+   Stacks are allocated with a guard page below them, a thread overflowing its
+   stack is killed by a segmentation fault. The stacks of joined threads are
+   reused by later spawns.
+
+   On success the positive thread ID of the new thread is returned. On failure a
+   negative value is returned.
+*/
+tid_t spawn_with_stack(void (*start)(), size_t stack_size);
+
+/* Creates a new thread executing the start function at the given priority,
+   from PRIORITY_HIGH (the default for spawn()) to PRIORITY_LOW.
+
+   Threads are scheduled with a multi-level feedback queue. A thread starts at
+   the level of its priority. Each time it is preempted, having used up its
+   whole time slice, it drops one level. A thread that yields or blocks before
+   that keeps its level. Latency sensitive threads that run briefly therefore
+   stay ahead of CPU bound threads. Threads at low levels are periodically
+   given a turn and moved back to the level of their priority, so no thread
+   starves.
+
+   On success the positive thread ID of the new thread is returned. On failure a
+   negative value is returned.
+*/
+tid_t spawn_with_priority(void (*start)(), int priority);
+
+/* Creates a new thread with both the stack size and the priority given, see
+   spawn_with_stack() and spawn_with_priority(). */
+tid_t spawn_thread(void (*start)(), size_t stack_size, int priority);
+
 /* Cooperative scheduling
 
    If there are other threads in the ready state, a thread calling yield() will
    trigger the thread scheduler to dispatch one of the threads in the ready
    state and change the state of the calling thread from running to ready.
+   Only threads at the same or a higher priority level than the calling thread
+   are considered, except when a low level thread is given its turn to keep it
+   from starving.
 */
 void  yield();
 
@@ -86,4 +171,78 @@ void  done();
 */
 tid_t join();
 
+/* Join with a specific thread
+
+   Like join(), but waits for the thread with the given thread ID to terminate.
+   When a thread terminates, threads waiting for it in join_tid() are woken up
+   instead of threads waiting in join(), and one of them returns it, never a
+   join(). A thread can only be joined once.
+
+   Returns tid once the thread has terminated. Returns a negative value if
+   there is no thread with that ID that has not already been joined, if tid is
+   the calling thread, or if no other thread can run.
+*/
+tid_t join_tid(tid_t tid);
+
+/* Preemptive scheduling
+
+   Sets the time slice, in milliseconds of CPU time, after which the running
+   thread is preempted and the scheduler dispatches the next ready thread, as
+   if the running thread had called yield(). A time slice of zero (the
+   default) turns preemption off and gives cooperative scheduling.
+
+   The timer ticks once per time slice independently of the dispatches. A
+   thread dispatched in between the ticks runs until the second tick after
+   its dispatch, so it is only preempted once it has used at least a whole
+   time slice.
+
+   The timer is delivered as SIGVTALRM, which is blocked while the scheduler
+   manipulates its queues. Note that preemption may interrupt a thread inside
+   a library function that is not reentrant.
+
+   Preemption can only be turned on with a single worker.
+
+   Returns 1 on success and a negative value on failure.
+*/
+int set_timeslice(int ms);
+
+/* Statistics
+
+   Turns time accounting on (on != 0) or off (on == 0). While it is on, the
+   time each thread spends running, ready and waiting is measured, which costs
+   two clock readings per state change. The number of times a thread has been
+   dispatched and preempted are always counted.
+
+   Returns 1 on success and a negative value on failure.
+*/
+int set_stats(int on);
+
+/* Copies the statistics of a thread that has not been joined into stats.
+
+   Returns 1 on success and a negative value if there is no such thread.
+*/
+int get_stats(tid_t tid, thread_stats_t *stats);
+
+/* Prints the statistics of every thread that has not been joined to out. */
+void dump_stats(FILE *out);
+
+/* Tracing
+
+   Starts recording every context switch, keeping the last events switches. A
+   value of zero stops recording. Any previous trace is discarded, which is
+   only safe while no other worker is running threads, for instance before
+   the first spawn().
+
+   Returns 1 on success and a negative value on failure.
+*/
+int set_trace(int events);
+
+/* Writes the recorded context switches to out in the Chrome trace viewer
+   format, with one time line per worker. Open the file in chrome://tracing or
+   https://ui.perfetto.dev.
+
+   Returns 1 on success and a negative value on failure.
+*/
+int dump_trace(FILE *out);
+
 #endif
@@ -0,0 +1,151 @@
+/* Context switch microbenchmark for the Simple Threads library.
+
+   Two threads yield to each other in a tight loop, every yield() is one
+   context switch. The benchmark is built twice, bin/sthreads_bench uses the
+   fast context switch and bin/sthreads_bench_ucontext uses swapcontext(), so
+   the two can be compared on the same machine.
+
+   The benchmark also measures the cost of spawning and joining short lived
+   threads, which reuse the stacks of the threads joined before them, and of
+   handing a semaphore back and forth between two blocked threads. Finally
+   MANY threads are spawned, take turns and are joined one by one by thread ID,
+   which shows whether the scheduler operations stay cheap with many threads.
+*/
+
+#include <stdlib.h>   // exit(), atoi(), EXIT_FAILURE, EXIT_SUCCESS
+#include <stdio.h>    // printf(), fprintf(), stderr
+
+#include "sthreads.h" // init(), spawn(), yield(), done(), join()
+#include "sthreads_sync.h" // st_sem_t, st_sem_wait(), st_sem_signal()
+#include "context.h"  // context_kind
+#include "timing.h"   // timing_start(), timing_stop()
+
+/* Number of yields performed by each of the two threads. */
+static int iterations = 1000000;
+
+/* Number of threads spawned and joined by the churn benchmark. */
+#define CHURN 100000
+
+void ping_pong() {
+  for (int i = 0; i < iterations; i++) {
+    yield();
+  }
+  done();
+}
+
+/* Number of threads alive at the same time in the many threads benchmark is
+   MANY_BATCH, each with a stack of MANY_STACK bytes. */
+#define MANY       100000
+#define MANY_BATCH 10000
+#define MANY_STACK (16 * 1024)
+
+void yield_once() {
+  yield();
+  done();
+}
+
+static st_sem_t sem_a, sem_b;
+
+void blocker_a() {
+  for (int i = 0; i < iterations; i++) {
+    st_sem_wait(&sem_a);
+    st_sem_signal(&sem_b);
+  }
+  done();
+}
+
+void blocker_b() {
+  for (int i = 0; i < iterations; i++) {
+    st_sem_signal(&sem_a);
+    st_sem_wait(&sem_b);
+  }
+  done();
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1) iterations = atoi(argv[1]);
+
+  if (iterations <= 0) {
+    fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  init();
+
+  spawn(ping_pong);
+  spawn(ping_pong);
+
+  struct timespec ts;
+  timing_start(&ts);
+
+  /* main joins right away and is out of the way until both threads are
+     done, so every switch is between the two ping_pong() threads. */
+  join();
+  join();
+
+  double seconds = timing_stop(&ts);
+  double switches = 2.0 * iterations;
+
+  printf("%-8s  %.0f switches in %.4f s  %.4e switches/s  %.1f ns/switch\n",
+         context_kind, switches, seconds, switches / seconds, seconds / switches * 1e9);
+
+  timing_start(&ts);
+
+  for (int i = 0; i < CHURN; i++) {
+    spawn(done);
+    join();
+  }
+
+  seconds = timing_stop(&ts);
+
+  printf("%-8s  %d spawn/join in %.4f s  %.1f ns/spawn\n",
+         context_kind, CHURN, seconds, seconds / CHURN * 1e9);
+
+  st_sem_init(&sem_a, 0);
+  st_sem_init(&sem_b, 0);
+
+  timing_start(&ts);
+
+  spawn(blocker_a);
+  spawn(blocker_b);
+  join();
+  join();
+
+  seconds = timing_stop(&ts);
+
+  printf("%-8s  %.0f semaphore handoffs in %.4f s  %.1f ns/handoff\n",
+         context_kind, switches, seconds, seconds / switches * 1e9);
+
+  static tid_t tids[MANY];
+  double spawn_time = 0, run_time = 0;
+
+  for (int i = 0; i < MANY; i += MANY_BATCH) {
+    timing_start(&ts);
+    for (int j = i; j < i + MANY_BATCH; j++) {
+      tids[j] = spawn_with_stack(yield_once, MANY_STACK);
+    }
+    spawn_time += timing_stop(&ts);
+
+    // Every thread in the batch yields once and then terminates.
+    timing_start(&ts);
+    yield();
+    yield();
+    run_time += timing_stop(&ts);
+  }
+
+  // The terminated threads are joined newest first.
+  timing_start(&ts);
+  for (int i = MANY - 1; i >= 0; i--) {
+    if (join_tid(tids[i]) != tids[i]) {
+      fprintf(stderr, "Could not join thread %d\n", tids[i]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  double join_time = timing_stop(&ts);
+
+  printf("%-8s  %d threads  %.1f ns/spawn  %.1f ns/yield+done  %.1f ns/join_tid\n",
+         context_kind, MANY, spawn_time / MANY * 1e9, run_time / MANY * 1e9,
+         join_time / MANY * 1e9);
+
+  exit(EXIT_SUCCESS);
+}
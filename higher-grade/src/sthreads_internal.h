@@ -0,0 +1,102 @@
+#ifndef STHREADS_INTERNAL_H
+#define STHREADS_INTERNAL_H
+
+/* Scheduler interface for synchronization primitives built on top of the
+   Simple Threads library. Not part of the API used by programs.
+
+   A primitive protects its state, including its queue of waiting threads,
+   with a spin lock. A thread that has to wait puts itself on the queue and
+   calls park() with the lock held. The lock is released only once the thread
+   is switched out, so a thread that later takes it off the queue can always
+   call unpark() on it right away.
+
+   Everything is done inside a critical section, so that the preemption timer
+   never interrupts a thread holding a spin lock.
+*/
+
+#include <signal.h>   /* sigset_t */
+#include <stdbool.h>  /* bool */
+
+#include "sthreads.h" /* thread_t */
+#include "atomics.h"  /* cpu_relax(), from ../mandatory/src */
+
+static inline void spin_lock(int *lock) {
+  while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+    while (__atomic_load_n(lock, __ATOMIC_RELAXED)) cpu_relax();
+  }
+}
+
+static inline void spin_unlock(int *lock) {
+  __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+/* The timer signal is blocked while the scheduler data structures are
+   updated. When preemption is off there is no timer and the system calls are
+   skipped. The previous mask is saved so that the critical section can be
+   left with the mask the thread had when it entered, no matter how many
+   context switches happened in between or whether preemption was turned on or
+   off meanwhile. */
+typedef struct {
+  bool masked;
+  sigset_t old;
+} critical_t;
+
+void enter_critical(critical_t *cs);
+
+void leave_critical(critical_t *cs);
+
+/* The calling thread. */
+thread_t *current_thread();
+
+/* park(lock)
+
+   Changes the state of the calling thread from running to waiting and
+   dispatches another thread. The caller must hold lock and have put itself on
+   a queue protected by lock. The lock is released once the calling thread is
+   switched out. Returns after another thread has called unpark() on the
+   calling thread, without the lock held. Must be called inside a critical
+   section.
+*/
+void park(int *lock);
+
+/* unpark(thread)
+
+   Changes the state of a thread suspended by park() from waiting to ready.
+   The thread must have been taken off its wait queue by the caller. Must be
+   called inside a critical section.
+*/
+void unpark(thread_t *thread);
+
+/* park_io(lock), unpark_io(thread)
+
+   Like park() and unpark(), for waits that end without the help of another
+   thread, on a file descriptor or a timer of the reactor. The waiting thread
+   still counts as runnable, so that join() waits for it and the workers do not
+   exit while it is suspended.
+*/
+void park_io(int *lock);
+
+void unpark_io(thread_t *thread);
+
+/*******************************************************************************
+                        Reactor, implemented in sthreads_io.c
+********************************************************************************/
+
+/* Creates the epoll or kqueue descriptor. Called by init_workers().
+
+   Returns 1 on success and a negative value on failure. */
+int io_init();
+
+/* io_poll(timeout_ms)
+
+   Makes the threads whose file descriptor is ready or whose timer has expired
+   ready on the calling worker. Waits up to timeout_ms milliseconds for one,
+   forever if negative, but never past the next timer. Returns at once if no
+   thread is waiting on the reactor. Must be called inside a critical section,
+   without any spin lock held.
+
+   Returns the number of threads made ready.
+*/
+int io_poll(int timeout_ms);
+
+#endif
@@ -0,0 +1,327 @@
+#include "sthreads_io.h"
+#include "sthreads_internal.h" /* critical_t, spin_lock(), park_io(), unpark_io() */
+
+#include <stdlib.h>   /* realloc() */
+#include <stdint.h>   /* uint64_t */
+#include <stdbool.h>  /* bool, true, false */
+#include <errno.h>    /* errno, EAGAIN, EWOULDBLOCK, EINTR, ENOENT */
+#include <fcntl.h>    /* fcntl(), F_GETFL, F_SETFL, O_NONBLOCK */
+#include <unistd.h>   /* read(), write() */
+#include <time.h>     /* clock_gettime(), CLOCK_MONOTONIC */
+#ifdef __APPLE__
+#include <sys/event.h> /* kqueue(), kevent(), EV_SET() */
+#else
+#include <sys/epoll.h> /* epoll_create1(), epoll_ctl(), epoll_wait() */
+#endif
+
+/* Number of events taken from the kernel per poll. */
+#define IO_EVENTS 64
+
+/* Initial capacity of the timer heap. */
+#define TIMERS 64
+
+/* A thread waiting on the reactor, kept on the stack of the thread. */
+typedef struct {
+  int lock;          /* Held by the waiting thread until it is switched out. */
+  thread_t *thread;
+  uint64_t deadline; /* For sthread_sleep(), in nanoseconds of CLOCK_MONOTONIC. */
+} io_wait_t;
+
+/* The epoll or kqueue descriptor. */
+static int reactor = -1;
+
+/* Number of threads waiting on the reactor, file descriptors and timers. */
+static int waiters = 0;
+
+/* Sleeping threads, a binary min-heap by deadline. A sleeping thread holds
+   timer_lock until it is switched out, unlike a thread waiting on a file
+   descriptor, which holds the lock of its own io_wait_t. */
+static int timer_lock = 0;
+static io_wait_t **timers = NULL;
+static int timers_size = 0;
+static int timers_count = 0;
+
+/*******************************************************************************
+                             Auxiliary functions
+********************************************************************************/
+
+static uint64_t now_ns() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Makes the thread of wait ready. The registration may have fired before the
+   thread was switched out, taking its lock waits until it is. */
+static void wake(io_wait_t *wait) {
+  thread_t *thread = wait->thread;
+
+  spin_lock(&wait->lock);
+  spin_unlock(&wait->lock);
+
+  __atomic_fetch_sub(&waiters, 1, __ATOMIC_RELAXED);
+  unpark_io(thread);
+}
+
+static void timer_swap(int i, int j) {
+  io_wait_t *wait = timers[i];
+  timers[i] = timers[j];
+  timers[j] = wait;
+}
+
+/* Adds wait to the heap. Must be called with timer_lock held.
+
+   Returns 1 on success and a negative value if the heap could not grow. */
+static int timer_push(io_wait_t *wait) {
+  if (timers_count == timers_size) {
+    int size = timers_size == 0 ? TIMERS : timers_size * 2;
+    io_wait_t **grown = realloc(timers, size * sizeof(io_wait_t *));
+
+    if (grown == NULL) return -1;
+
+    timers = grown;
+    timers_size = size;
+  }
+
+  int i = timers_count++;
+  timers[i] = wait;
+
+  while (i > 0 && timers[(i - 1) / 2]->deadline > timers[i]->deadline) {
+    timer_swap(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+
+  return 1;
+}
+
+/* Removes the wait with the earliest deadline from the heap. Must be called
+   with timer_lock held. */
+static io_wait_t *timer_pop() {
+  io_wait_t *first = timers[0];
+  int i = 0;
+
+  timers[0] = timers[--timers_count];
+
+  while (true) {
+    int min = i, left = 2 * i + 1, right = 2 * i + 2;
+
+    if (left < timers_count && timers[left]->deadline < timers[min]->deadline) min = left;
+    if (right < timers_count && timers[right]->deadline < timers[min]->deadline) min = right;
+    if (min == i) break;
+
+    timer_swap(i, min);
+    i = min;
+  }
+
+  return first;
+}
+
+/* Wakes the sleeping threads whose deadline has passed. Sets *next_ms to the
+   number of milliseconds until the next deadline, rounded up, or to -1 if no
+   thread is sleeping. Returns the number of threads woken. */
+static int expire_timers(int *next_ms) {
+  uint64_t now = now_ns();
+  int woken = 0;
+
+  *next_ms = -1;
+
+  if (__atomic_load_n(&timers_count, __ATOMIC_RELAXED) == 0) return 0;
+
+  spin_lock(&timer_lock);
+
+  while (timers_count > 0 && timers[0]->deadline <= now) {
+    /* The sleeper released timer_lock only once it was switched out. */
+    io_wait_t *wait = timer_pop();
+
+    __atomic_fetch_sub(&waiters, 1, __ATOMIC_RELAXED);
+    unpark_io(wait->thread);
+    woken++;
+  }
+
+  if (timers_count > 0) *next_ms = (timers[0]->deadline - now + 999999) / 1000000;
+
+  spin_unlock(&timer_lock);
+
+  return woken;
+}
+
+/* Registers a one-shot interest in fd becoming readable, or writable if
+   output is set, for wait. Returns 1 on success and a negative value on
+   failure. */
+static int arm(int fd, bool output, io_wait_t *wait) {
+#ifdef __APPLE__
+  struct kevent change;
+
+  EV_SET(&change, fd, output ? EVFILT_WRITE : EVFILT_READ, EV_ADD | EV_ONESHOT, 0, 0, wait);
+  return kevent(reactor, &change, 1, NULL, 0, NULL) < 0 ? -1 : 1;
+#else
+  struct epoll_event event = {.events = (output ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT,
+                              .data.ptr = wait};
+
+  /* A one-shot registration stays in the set, disabled, after it has fired,
+     and is removed when the descriptor is closed. */
+  if (epoll_ctl(reactor, EPOLL_CTL_MOD, fd, &event) == 0) return 1;
+  if (errno == ENOENT && epoll_ctl(reactor, EPOLL_CTL_ADD, fd, &event) == 0) return 1;
+  return -1;
+#endif
+}
+
+/* Waits up to timeout_ms milliseconds, forever if negative, for registered
+   descriptors to become ready and wakes their threads. Returns the number of
+   threads woken. */
+static int wait_events(int timeout_ms) {
+#ifdef __APPLE__
+  struct kevent events[IO_EVENTS];
+  struct timespec ts = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000};
+  int n = kevent(reactor, NULL, 0, events, IO_EVENTS, timeout_ms < 0 ? NULL : &ts);
+
+  for (int i = 0; i < n; i++) wake(events[i].udata);
+#else
+  struct epoll_event events[IO_EVENTS];
+  int n = epoll_wait(reactor, events, IO_EVENTS, timeout_ms);
+
+  for (int i = 0; i < n; i++) wake(events[i].data.ptr);
+#endif
+
+  /* Interrupted by a signal. */
+  return n < 0 ? 0 : n;
+}
+
+/* Suspends the calling thread until fd is readable, or writable if output is
+   set. Returns 1 once it is and a negative value on failure. */
+static int wait_fd(int fd, bool output) {
+  io_wait_t wait = {.lock = 0};
+  critical_t cs;
+  enter_critical(&cs);
+
+  wait.thread = current_thread();
+
+  /* The reactor can report the descriptor ready as soon as it is armed, wake()
+     only proceeds once this thread has released the lock in park_io(). */
+  spin_lock(&wait.lock);
+
+  if (arm(fd, output, &wait) < 0) {
+    spin_unlock(&wait.lock);
+    leave_critical(&cs);
+    return -1;
+  }
+
+  __atomic_fetch_add(&waiters, 1, __ATOMIC_RELAXED);
+  park_io(&wait.lock);
+
+  leave_critical(&cs);
+  return 1;
+}
+
+static int set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+
+  if (flags < 0) return -1;
+  if (flags & O_NONBLOCK) return 1;
+
+  return fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 ? -1 : 1;
+}
+
+/* True if an operation failed only because it would have blocked. */
+static bool would_block() {
+  return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+/*******************************************************************************
+                                   Reactor
+********************************************************************************/
+
+int io_init() {
+#ifdef __APPLE__
+  reactor = kqueue();
+#else
+  reactor = epoll_create1(EPOLL_CLOEXEC);
+#endif
+
+  return reactor < 0 ? -1 : 1;
+}
+
+int io_poll(int timeout_ms) {
+  int next_ms;
+
+  if (__atomic_load_n(&waiters, __ATOMIC_RELAXED) == 0) return 0;
+
+  int woken = expire_timers(&next_ms);
+
+  /* Don't block when there is something to run, or past the next deadline. */
+  if (woken > 0) timeout_ms = 0;
+  if (next_ms >= 0 && (timeout_ms < 0 || next_ms < timeout_ms)) timeout_ms = next_ms;
+
+  woken += wait_events(timeout_ms);
+
+  if (timeout_ms != 0) woken += expire_timers(&next_ms);
+
+  return woken;
+}
+
+/*******************************************************************************
+                                  Interface
+********************************************************************************/
+
+ssize_t sthread_read(int fd, void *buf, size_t count) {
+  if (set_nonblocking(fd) < 0) return -1;
+
+  while (true) {
+    ssize_t n = read(fd, buf, count);
+
+    if (n >= 0) return n;
+    if (errno == EINTR) continue;
+    if (!would_block() || wait_fd(fd, false) < 0) return -1;
+  }
+}
+
+ssize_t sthread_write(int fd, const void *buf, size_t count) {
+  const char *bytes = buf;
+  size_t written = 0;
+
+  if (set_nonblocking(fd) < 0) return -1;
+
+  while (written < count) {
+    ssize_t n = write(fd, bytes + written, count - written);
+
+    if (n >= 0) {
+      written += n;
+    } else if (errno != EINTR && (!would_block() || wait_fd(fd, true) < 0)) {
+      return written > 0 ? (ssize_t) written : -1;
+    }
+  }
+
+  return written;
+}
+
+int sthread_sleep(int ms) {
+  if (ms < 0) return -1;
+
+  if (ms == 0) {
+    yield();
+    return 1;
+  }
+
+  io_wait_t wait = {.lock = 0, .deadline = now_ns() + (uint64_t) ms * 1000000};
+  critical_t cs;
+  enter_critical(&cs);
+
+  wait.thread = current_thread();
+
+  /* expire_timers() can only take this thread off the heap once it has been
+     switched out, since it holds timer_lock until then. */
+  spin_lock(&timer_lock);
+
+  if (timer_push(&wait) < 0) {
+    spin_unlock(&timer_lock);
+    leave_critical(&cs);
+    return -1;
+  }
+
+  __atomic_fetch_add(&waiters, 1, __ATOMIC_RELAXED);
+  park_io(&timer_lock);
+
+  leave_critical(&cs);
+  return 1;
+}
@@ -0,0 +1,49 @@
+#ifndef STHREADS_IO_H
+#define STHREADS_IO_H
+
+/* Asynchronous I/O for Simple Threads.
+
+   A read() or write() that has to wait blocks the kernel thread, and with it
+   every other thread of its worker. The functions below block the calling
+   thread only. The file descriptor is made non-blocking and the operation is
+   tried right away. If it would block, the thread registers its interest with
+   the reactor of the scheduler (epoll on Linux, kqueue on Mac OS), changes
+   state from running to waiting and the scheduler dispatches another ready
+   thread. Once the descriptor is ready, or for sthread_sleep() once the time
+   is up, the thread becomes ready again and retries.
+
+   Workers poll the reactor when they have no ready threads, blocking in the
+   kernel until the next event or timer if there is nothing else to do, and
+   every few context switches otherwise. A thread waiting on the reactor does
+   not count as blocked forever, join() waits for it and the program keeps
+   running.
+
+   A file descriptor stays non-blocking after it has been used with these
+   functions. Only one thread at a time may wait on a file descriptor. They
+   must only be used by threads created with the Simple Threads API.
+*/
+
+#include <sys/types.h> /* ssize_t */
+
+/* Like read(), but blocks only the calling thread until at least one byte can
+   be read or the end of the file is reached.
+
+   Returns the number of bytes read, 0 at the end of the file and a negative
+   value with errno set on failure. */
+ssize_t sthread_read(int fd, void *buf, size_t count);
+
+/* Like write(), but blocks only the calling thread until all count bytes have
+   been written.
+
+   Returns count on success. On failure returns the number of bytes written
+   before the failure if there were any, otherwise a negative value with errno
+   set. */
+ssize_t sthread_write(int fd, const void *buf, size_t count);
+
+/* Suspends the calling thread for at least ms milliseconds. Other threads run
+   meanwhile.
+
+   Returns 1 on success and a negative value on failure. */
+int sthread_sleep(int ms);
+
+#endif
@@ -0,0 +1,177 @@
+#include <stdlib.h>   /* malloc(), free() */
+
+#include "sthreads_sync.h"
+#include "sthreads_internal.h" /* critical_t, spin_lock(), park(), unpark() */
+
+/*******************************************************************************
+                             Auxiliary functions
+********************************************************************************/
+
+/* The next field of thread_t is free while the thread is waiting. */
+
+static void wait_init(st_wait_queue_t *queue) {
+  queue->first = NULL;
+  queue->last = NULL;
+}
+
+static void wait_enqueue(st_wait_queue_t *queue, thread_t *thread) {
+  thread->next = NULL;
+
+  if (queue->last == NULL) {
+    queue->first = thread;
+  } else {
+    queue->last->next = thread;
+  }
+  queue->last = thread;
+}
+
+static thread_t *wait_dequeue(st_wait_queue_t *queue) {
+  thread_t *thread = queue->first;
+
+  if (thread != NULL) {
+    queue->first = thread->next;
+    if (queue->first == NULL) queue->last = NULL;
+    thread->next = NULL;
+  }
+  return thread;
+}
+
+/*******************************************************************************
+                                     Mutex
+********************************************************************************/
+
+void st_mutex_init(st_mutex_t *mutex) {
+  mutex->lock = 0;
+  mutex->locked = false;
+  wait_init(&mutex->waiting);
+}
+
+void st_mutex_lock(st_mutex_t *mutex) {
+  critical_t cs;
+  enter_critical(&cs);
+
+  spin_lock(&mutex->lock);
+
+  if (!mutex->locked) {
+    mutex->locked = true;
+    spin_unlock(&mutex->lock);
+  } else {
+    /* st_mutex_unlock() hands the mutex over, it is locked when park()
+       returns. */
+    wait_enqueue(&mutex->waiting, current_thread());
+    park(&mutex->lock);
+  }
+
+  leave_critical(&cs);
+}
+
+void st_mutex_unlock(st_mutex_t *mutex) {
+  critical_t cs;
+  enter_critical(&cs);
+
+  spin_lock(&mutex->lock);
+
+  thread_t *thread = wait_dequeue(&mutex->waiting);
+  if (thread == NULL) mutex->locked = false;
+
+  spin_unlock(&mutex->lock);
+
+  if (thread != NULL) unpark(thread);
+
+  leave_critical(&cs);
+}
+
+/*******************************************************************************
+                                   Semaphore
+********************************************************************************/
+
+void st_sem_init(st_sem_t *sem, int value) {
+  sem->lock = 0;
+  sem->value = value;
+  wait_init(&sem->waiting);
+}
+
+void st_sem_wait(st_sem_t *sem) {
+  critical_t cs;
+  enter_critical(&cs);
+
+  spin_lock(&sem->lock);
+
+  if (sem->value > 0) {
+    sem->value--;
+    spin_unlock(&sem->lock);
+  } else {
+    /* st_sem_signal() passes its increment directly to this thread. */
+    wait_enqueue(&sem->waiting, current_thread());
+    park(&sem->lock);
+  }
+
+  leave_critical(&cs);
+}
+
+void st_sem_signal(st_sem_t *sem) {
+  critical_t cs;
+  enter_critical(&cs);
+
+  spin_lock(&sem->lock);
+
+  thread_t *thread = wait_dequeue(&sem->waiting);
+  if (thread == NULL) sem->value++;
+
+  spin_unlock(&sem->lock);
+
+  if (thread != NULL) unpark(thread);
+
+  leave_critical(&cs);
+}
+
+/*******************************************************************************
+                                Bounded buffer
+********************************************************************************/
+
+int st_buffer_init(st_buffer_t *buffer, int size) {
+  if (size < 1) return -1;
+
+  buffer->array = malloc(size * sizeof(void *));
+
+  if (buffer->array == NULL) return -1;
+
+  buffer->size = size;
+  buffer->in = 0;
+  buffer->out = 0;
+
+  st_sem_init(&buffer->empty, size);
+  st_sem_init(&buffer->data, 0);
+  st_mutex_init(&buffer->mutex);
+
+  return 1;
+}
+
+void st_buffer_destroy(st_buffer_t *buffer) {
+  free(buffer->array);
+  buffer->array = NULL;
+}
+
+void st_buffer_put(st_buffer_t *buffer, void *elem) {
+  st_sem_wait(&buffer->empty);
+  st_mutex_lock(&buffer->mutex);
+
+  buffer->array[buffer->in] = elem;
+  buffer->in = (buffer->in + 1) % buffer->size;
+
+  st_mutex_unlock(&buffer->mutex);
+  st_sem_signal(&buffer->data);
+}
+
+void *st_buffer_get(st_buffer_t *buffer) {
+  st_sem_wait(&buffer->data);
+  st_mutex_lock(&buffer->mutex);
+
+  void *elem = buffer->array[buffer->out];
+  buffer->out = (buffer->out + 1) % buffer->size;
+
+  st_mutex_unlock(&buffer->mutex);
+  st_sem_signal(&buffer->empty);
+
+  return elem;
+}
@@ -0,0 +1,98 @@
+#ifndef STHREADS_SYNC_H
+#define STHREADS_SYNC_H
+
+/* Blocking synchronization for Simple Threads.
+
+   The mutex, semaphore and bounded buffer below block the calling thread, not
+   the kernel thread running it. A thread that has to wait changes state from
+   running to waiting, is put on the wait queue of the primitive and the
+   scheduler dispatches another ready thread. Releasing the mutex, signaling
+   the semaphore or putting data into the buffer makes the first waiting
+   thread ready again. No system calls are involved.
+
+   The primitives work with any number of workers, see init_workers(). They
+   must only be used by threads created with the Simple Threads API.
+
+   If the threads left are all blocked on primitives or in join(), they wait
+   for each other forever. The deadlock is reported to stderr with the IDs of
+   the blocked threads and the process exits with EXIT_FAILURE.
+*/
+
+#include <stdbool.h>  /* bool */
+
+#include "sthreads.h" /* thread_t */
+
+/* Threads waiting on a primitive, in FIFO order. */
+typedef struct {
+  thread_t *first;
+  thread_t *last;
+} st_wait_queue_t;
+
+typedef struct {
+  int lock;              /* Spin lock protecting the fields below. */
+  bool locked;
+  st_wait_queue_t waiting;
+} st_mutex_t;
+
+typedef struct {
+  int lock;              /* Spin lock protecting the fields below. */
+  int value;
+  st_wait_queue_t waiting;
+} st_sem_t;
+
+/* A bounded buffer of pointers. */
+typedef struct {
+  void **array;
+  int size;
+  int in;
+  int out;
+  st_sem_t empty;        /* Counts the free slots. */
+  st_sem_t data;         /* Counts the used slots. */
+  st_mutex_t mutex;
+} st_buffer_t;
+
+/*******************************************************************************
+                                     Mutex
+********************************************************************************/
+
+void st_mutex_init(st_mutex_t *mutex);
+
+/* Blocks the calling thread until the mutex can be locked by it. */
+void st_mutex_lock(st_mutex_t *mutex);
+
+/* Unlocks the mutex. If threads are waiting, the mutex is handed over to the
+   first of them, which becomes ready. */
+void st_mutex_unlock(st_mutex_t *mutex);
+
+/*******************************************************************************
+                                   Semaphore
+********************************************************************************/
+
+void st_sem_init(st_sem_t *sem, int value);
+
+/* Blocks the calling thread while the value is zero, then decrements it. */
+void st_sem_wait(st_sem_t *sem);
+
+/* Increments the value, or if threads are waiting makes the first of them
+   ready instead. */
+void st_sem_signal(st_sem_t *sem);
+
+/*******************************************************************************
+                                Bounded buffer
+********************************************************************************/
+
+/* Initializes an empty buffer with room for size elements.
+
+   Returns 1 on success and a negative value on failure. */
+int st_buffer_init(st_buffer_t *buffer, int size);
+
+void st_buffer_destroy(st_buffer_t *buffer);
+
+/* Adds elem to the buffer, blocking the calling thread while it is full. */
+void st_buffer_put(st_buffer_t *buffer, void *elem);
+
+/* Removes the oldest element from the buffer, blocking the calling thread
+   while it is empty. */
+void *st_buffer_get(st_buffer_t *buffer);
+
+#endif
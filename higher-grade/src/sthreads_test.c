@@ -2,8 +2,20 @@
 #include <stdio.h>    // printf(), fprintf(), stdout, stderr, perror(), _IOLBF
 #include <stdbool.h>  // true, false
 #include <limits.h>   // INT_MAX
+#include <assert.h>   // assert()
+#include <string.h>   // strstr()
+#include <time.h>     // clock(), CLOCKS_PER_SEC
 
-#include "sthreads.h" // init(), spawn(), yield(), done()
+#include "sthreads.h" // init(), spawn(), spawn_with_stack(), spawn_with_priority(), yield(),
+                      // done(), join(), join_tid(), set_timeslice(), set_stats(),
+                      // get_stats(), dump_stats(), set_trace(), dump_trace()
+#include "stacks.h"   // stack_alloc(), stack_release(), stack_pool_count(), STACK_POOL_MAX
+#include "sthreads_sync.h" // st_mutex_t, st_sem_t, st_buffer_t
+#include "sthreads_io.h"  // sthread_read(), sthread_write(), sthread_sleep()
+#include "sthreads_internal.h" // current_thread()
+
+#include <unistd.h>   // pipe(), close(), fork()
+#include <sys/wait.h> // waitpid(), WIFEXITED(), WEXITSTATUS()
 
 /*******************************************************************************
                    Functions to be used together with spawn()
@@ -126,8 +138,708 @@ void magic_numbers() {
 ********************************************************************************/
 
 
-int main(){
-  puts("\n==== Test program for the Simple Threads API ====\n");
+#define TEST_HEADER printf("\n==== %s ====\n\n", __FUNCTION__)
+
+/* Two cooperative threads taking turns, joined by main. */
+void cooperative_test() {
+  TEST_HEADER;
+
+  tid_t a = spawn(numbers);
+  tid_t b = spawn(letters);
+
+  assert(a > 0 && b > 0 && a != b);
+
+  tid_t first = join();
+  tid_t second = join();
+
+  assert((first == a && second == b) || (first == b && second == a));
+
+  // Nothing left to join.
+  tid_t none = join();
+  assert(none < 0);
+}
+
+/* A short lived thread using a bit of stack. */
+void short_task() {
+  volatile char buffer[1024];
+  buffer[0] = (char) fib(15);
+  (void) buffer[0];
+  done();
+}
+
+/* Released stacks are handed out again and the pool stays bounded. */
+void stack_test() {
+  TEST_HEADER;
+
+  size_t size = 10000;
+  void *stack = stack_alloc(&size);
+
+  assert(stack != NULL);
+  assert(size >= 10000);
+
+  // The stack is usable from the bottom to the top.
+  ((volatile char *) stack)[0] = 1;
+  ((volatile char *) stack)[size - 1] = 1;
+
+  int count = stack_pool_count();
+  stack_release(stack, size);
+  assert(stack_pool_count() == count + 1);
+
+  size_t again = 10000;
+  void *reused = stack_alloc(&again);
+  assert(reused == stack);
+  assert(again == size);
+  assert(stack_pool_count() == count);
+  stack_release(reused, again);
+
+  // Many short lived threads with different stack sizes.
+  for (int i = 0; i < 1000; i++) {
+    tid_t a = spawn_with_stack(short_task, 16 * 1024);
+    tid_t b = spawn_with_stack(short_task, 64 * 1024);
+    tid_t c = spawn(short_task);
+
+    assert(a > 0 && b > 0 && c > 0);
+
+    join();
+    join();
+    join();
+
+    assert(stack_pool_count() <= STACK_POOL_MAX);
+  }
+
+  tid_t none = join();
+  assert(none < 0);
+}
+
+static volatile int yielders_done = 0;
+
+void yielder() {
+  for (int i = 0; i < 10; i++) yield();
+  __atomic_fetch_add(&yielders_done, 1, __ATOMIC_RELAXED);
+  done();
+}
+
+/* Statistics and a trace of two threads taking turns. Must run first, since
+   the trace is started before any thread is spawned. */
+void stats_test() {
+  TEST_HEADER;
+
+  thread_stats_t stats;
+  int result;
+
+  result = set_trace(1024);
+  assert(result > 0);
+  result = set_stats(1);
+  assert(result > 0);
+
+  tid_t a = spawn(yielder);
+  tid_t b = spawn(yielder);
+
+  // Terminated threads keep their statistics until they are joined.
+  while (yielders_done < 2) yield();
+
+  dump_stats(stdout);
+
+  result = get_stats(a, &stats);
+  assert(result > 0);
+  assert(stats.switches >= 1);
+  assert(stats.running > 0);
+  assert(stats.waiting == 0);
+
+  result = get_stats(0, &stats);
+  assert(result > 0);
+  assert(stats.switches >= 1);
+
+  FILE *out = tmpfile();
+  char json[256];
+
+  assert(out != NULL);
+  result = dump_trace(out);
+  assert(result > 0);
+
+  rewind(out);
+  size_t n = fread(json, 1, sizeof(json) - 1, out);
+  json[n] = '\0';
+  assert(strstr(json, "\"traceEvents\"") != NULL);
+  fclose(out);
+
+  tid_t joined = join_tid(a);
+  assert(joined == a);
+  joined = join_tid(b);
+  assert(joined == b);
+  result = get_stats(a, &stats);
+  assert(result < 0);
+
+  result = set_stats(0);
+  assert(result > 0);
+  result = set_trace(0);
+  assert(result > 0);
+}
+
+static tid_t sibling;
+static bool sibling_joined = false;
+
+/* Runs a while so that it is joined before it terminates. */
+void slow_task() {
+  for (int i = 0; i < 10; i++) yield();
+  done();
+}
+
+/* Waits for another child of main. */
+void sibling_joiner() {
+  tid_t joined = join_tid(sibling);
+  assert(joined == sibling);
+  sibling_joined = true;
+  done();
+}
+
+void join_tid_test() {
+  TEST_HEADER;
+
+  tid_t tids[4];
+  tid_t joined;
+
+  for (int i = 0; i < 4; i++) tids[i] = spawn(slow_task);
+
+  // Joined in the reverse order of termination.
+  for (int i = 3; i >= 0; i--) {
+    joined = join_tid(tids[i]);
+    assert(joined == tids[i]);
+  }
+
+  // Already joined, never spawned and the calling thread itself.
+  joined = join_tid(tids[0]);
+  assert(joined < 0);
+  joined = join_tid(12345678);
+  assert(joined < 0);
+  joined = join_tid(0);
+  assert(joined < 0);
+
+  // Threads other than main can join each other.
+  sibling = spawn(slow_task);
+  tid_t joiner = spawn(sibling_joiner);
+
+  joined = join_tid(joiner);
+  assert(joined == joiner);
+  assert(sibling_joined);
+  joined = join_tid(sibling);
+  assert(joined < 0);
+  joined = join();
+  assert(joined < 0);
+}
+
+static tid_t join_result;
+
+void quick_task() {
+  done();
+}
+
+void join_caller() {
+  join_result = join();
+  done();
+}
+
+/* With a single worker, the target terminates as soon as it runs and wakes
+   up main from join_tid(), but join_caller() is ahead of main in the ready
+   queue and calls join() first. The target is main's to reap, join() waits
+   for the next thread instead. */
+void join_race_test() {
+  TEST_HEADER;
+
+  tid_t target = spawn(quick_task);
+  tid_t caller = spawn(join_caller);
+
+  tid_t joined = join_tid(target);
+  assert(joined == target);
+
+  tid_t other = spawn(slow_task);
+
+  joined = join_tid(caller);
+  assert(joined == caller);
+  assert(join_result == other);
+}
+
+static int order[3];
+static int finished = 0;
+
+void batch_task() {
+  order[finished++] = PRIORITY_LOW;
+  done();
+}
+
+void latency_task() {
+  order[finished++] = PRIORITY_HIGH;
+  done();
+}
+
+/* With a single worker, high priority threads run before low priority threads
+   spawned before them. */
+void priority_test() {
+  TEST_HEADER;
+
+  tid_t invalid = spawn_with_priority(batch_task, PRIORITIES);
+  assert(invalid < 0);
+  invalid = spawn_with_priority(batch_task, -1);
+  assert(invalid < 0);
+
+  spawn_with_priority(batch_task, PRIORITY_LOW);
+  spawn_with_priority(latency_task, PRIORITY_HIGH);
+  spawn_with_priority(latency_task, PRIORITY_HIGH);
+
+  for (int i = 0; i < 3; i++) join();
+
+  assert(finished == 3);
+  assert(order[0] == PRIORITY_HIGH);
+  assert(order[1] == PRIORITY_HIGH);
+  assert(order[2] == PRIORITY_LOW);
+}
+
+static volatile bool starving = true;
+
+void starving_task() {
+  starving = false;
+  done();
+}
+
+void busy_task() {
+  while (starving) yield();
+  done();
+}
+
+/* High priority threads yielding to each other until a low priority thread
+   has run, which only happens thanks to aging. */
+void aging_test() {
+  TEST_HEADER;
+
+  spawn_with_priority(starving_task, PRIORITY_LOW);
+  spawn_with_priority(busy_task, PRIORITY_HIGH);
+  spawn_with_priority(busy_task, PRIORITY_HIGH);
+
+  for (int i = 0; i < 3; i++) join();
+
+  assert(!starving);
+}
+
+#define PARALLEL_THREADS 1000
+#define PARALLEL_YIELDS  10
+
+static int parallel_done = 0;
+
+/* Does a bit of work between yields. */
+void parallel_task() {
+  for (int i = 0; i < PARALLEL_YIELDS; i++) {
+    volatile int f = fib(10);
+    (void) f;
+    yield();
+  }
+
+  __atomic_fetch_add(&parallel_done, 1, __ATOMIC_RELAXED);
+  done();
+}
+
+/* Many threads, each joined exactly once, no matter which worker ran it. */
+void parallel_test() {
+  TEST_HEADER;
+
+  static bool joined[PARALLEL_THREADS + 1];
+  tid_t first = -1;
+
+  for (int i = 0; i < PARALLEL_THREADS; i++) {
+    tid_t tid = spawn(parallel_task);
+    assert(tid > 0);
+    if (first < 0) first = tid;
+  }
+
+  for (int i = 0; i < PARALLEL_THREADS; i++) {
+    tid_t tid = join();
+
+    assert(tid >= first && tid < first + PARALLEL_THREADS);
+    assert(!joined[tid - first]);
+    joined[tid - first] = true;
+  }
+
+  assert(parallel_done == PARALLEL_THREADS);
+  tid_t none = join();
+  assert(none < 0);
+}
+
+#define ROUNDS 1000
+
+static st_sem_t ping_sem, pong_sem;
+static volatile int turn = 0;
+
+void ping() {
+  for (int i = 0; i < ROUNDS; i++) {
+    st_sem_wait(&ping_sem);
+    assert(turn == 0);
+    turn = 1;
+    st_sem_signal(&pong_sem);
+  }
+  done();
+}
+
+void pong() {
+  for (int i = 0; i < ROUNDS; i++) {
+    st_sem_wait(&pong_sem);
+    assert(turn == 1);
+    turn = 0;
+    st_sem_signal(&ping_sem);
+  }
+  done();
+}
+
+/* Two threads in lock-step, each blocked on a semaphore while the other runs. */
+void sem_test() {
+  TEST_HEADER;
+
+  st_sem_init(&ping_sem, 1);
+  st_sem_init(&pong_sem, 0);
+
+  spawn(pong);
+  spawn(ping);
+
+  join();
+  join();
+
+  assert(turn == 0);
+  assert(ping_sem.value == 1 && pong_sem.value == 0);
+}
+
+#define LOCKERS 8
+
+static st_mutex_t mutex;
+static volatile int counter = 0;
+
+/* Yields inside the critical section, without the mutex increments would be
+   lost. */
+void locker() {
+  for (int i = 0; i < ROUNDS; i++) {
+    st_mutex_lock(&mutex);
+    int value = counter;
+    yield();
+    counter = value + 1;
+    st_mutex_unlock(&mutex);
+  }
+  done();
+}
+
+void mutex_test() {
+  TEST_HEADER;
+
+  st_mutex_init(&mutex);
+
+  for (int i = 0; i < LOCKERS; i++) spawn(locker);
+  for (int i = 0; i < LOCKERS; i++) join();
+
+  assert(counter == LOCKERS * ROUNDS);
+  assert(!mutex.locked);
+}
+
+#define PRODUCERS 4
+#define CONSUMERS 4
+
+static st_buffer_t buffer;
+static long consumed_sum = 0;
+
+void producer() {
+  for (long i = 1; i <= ROUNDS; i++) {
+    st_buffer_put(&buffer, (void *) i);
+  }
+  done();
+}
+
+void consumer() {
+  long sum = 0;
+
+  for (int i = 0; i < ROUNDS * PRODUCERS / CONSUMERS; i++) {
+    sum += (long) st_buffer_get(&buffer);
+  }
+
+  __atomic_fetch_add(&consumed_sum, sum, __ATOMIC_RELAXED);
+  done();
+}
+
+/* Producers and consumers blocking on a small buffer. */
+void buffer_test() {
+  TEST_HEADER;
+
+  int initialized = st_buffer_init(&buffer, 4);
+  assert(initialized > 0);
+
+  for (int i = 0; i < CONSUMERS; i++) spawn(consumer);
+  for (int i = 0; i < PRODUCERS; i++) spawn(producer);
+  for (int i = 0; i < PRODUCERS + CONSUMERS; i++) join();
+
+  assert(consumed_sum == (long) PRODUCERS * ROUNDS * (ROUNDS + 1) / 2);
+  assert(buffer.in == buffer.out);
+
+  st_buffer_destroy(&buffer);
+}
+
+#define SLEEPERS 3
+
+static int woken[SLEEPERS];
+static int nstarted = 0, nwoken = 0;
+static volatile bool sleeping = true;
+
+/* Sleeper i sleeps for (SLEEPERS - i) * 10 ms, so they wake in reverse order
+   of starting. */
+void sleeper() {
+  int i = __atomic_fetch_add(&nstarted, 1, __ATOMIC_RELAXED);
+
+  int slept = sthread_sleep((SLEEPERS - i) * 10);
+  assert(slept > 0);
+
+  woken[__atomic_fetch_add(&nwoken, 1, __ATOMIC_RELAXED)] = i;
+  done();
+}
+
+/* Never runs out of work, the reactor must still be polled for the sleepers. */
+void spinner() {
+  while (sleeping) yield();
+  done();
+}
+
+void sleep_test() {
+  TEST_HEADER;
+
+  int slept = sthread_sleep(-1);
+  assert(slept < 0);
+  slept = sthread_sleep(0);
+  assert(slept > 0);
+
+  for (int i = 0; i < SLEEPERS; i++) spawn(sleeper);
+  tid_t spin = spawn(spinner);
+
+  for (int i = 0; i < SLEEPERS; i++) {
+    tid_t tid = join();
+    assert(tid > 0 && tid != spin);
+  }
+
+  sleeping = false;
+  tid_t joined = join_tid(spin);
+  assert(joined == spin);
+
+  for (int i = 0; i < SLEEPERS; i++) assert(woken[i] == SLEEPERS - 1 - i);
+}
+
+/* Much more than the capacity of a pipe, so the writer blocks. */
+#define STREAM_BYTES (1024 * 1024)
+
+static int ping_pipe[2], pong_pipe[2];
+
+void io_ping() {
+  char c = 0;
+
+  for (int i = 0; i < ROUNDS; i++) {
+    ssize_t n = sthread_write(ping_pipe[1], &c, 1);
+    assert(n == 1);
+    n = sthread_read(pong_pipe[0], &c, 1);
+    assert(n == 1);
+    assert(c == (char) (i + 1));
+  }
+  done();
+}
+
+void io_pong() {
+  char c;
+
+  for (int i = 0; i < ROUNDS; i++) {
+    ssize_t n = sthread_read(ping_pipe[0], &c, 1);
+    assert(n == 1);
+    c++;
+    n = sthread_write(pong_pipe[1], &c, 1);
+    assert(n == 1);
+  }
+  done();
+}
+
+void io_writer() {
+  static char bytes[STREAM_BYTES];
+
+  for (int i = 0; i < STREAM_BYTES; i++) bytes[i] = (char) i;
+
+  ssize_t n = sthread_write(ping_pipe[1], bytes, STREAM_BYTES);
+  assert(n == STREAM_BYTES);
+  close(ping_pipe[1]);
+  done();
+}
+
+void io_reader() {
+  char bytes[4096];
+  ssize_t n;
+  long total = 0;
+
+  while ((n = sthread_read(ping_pipe[0], bytes, sizeof(bytes))) > 0) {
+    for (ssize_t i = 0; i < n; i++) assert(bytes[i] == (char) (total + i));
+    total += n;
+  }
+
+  assert(n == 0 && total == STREAM_BYTES);
+  done();
+}
+
+/* Two threads in lock-step over a pair of pipes, then a stream through a pipe
+   that fills up. Every read and write would block the kernel thread. */
+void io_test() {
+  TEST_HEADER;
+
+  int piped = pipe(ping_pipe);
+  assert(piped == 0);
+  piped = pipe(pong_pipe);
+  assert(piped == 0);
+
+  spawn(io_pong);
+  spawn(io_ping);
+  join();
+  join();
+
+  close(ping_pipe[0]);
+  close(ping_pipe[1]);
+  close(pong_pipe[0]);
+  close(pong_pipe[1]);
+
+  piped = pipe(ping_pipe);
+  assert(piped == 0);
+
+  spawn(io_reader);
+  spawn(io_writer);
+  join();
+  join();
+
+  close(ping_pipe[0]);
+
+  char c;
+  ssize_t n = sthread_read(ping_pipe[0], &c, 1);
+  assert(n < 0);
+}
+
+static st_sem_t sem_a, sem_b;
+
+/* Waits for sem_a, which nobody signals. */
+void sem_a_waiter() {
+  st_sem_wait(&sem_a);
+  done();
+}
+
+/* In a child process with a runtime of its own, main and a thread each wait
+   on a semaphore that only the other could signal. The runtime must report
+   the deadlock and fail instead of exiting successfully. */
+void deadlock_test(int workers) {
+  TEST_HEADER;
+
+  // The child would print what is buffered a second time.
+  fflush(stdout);
+
+  pid_t pid = fork();
+  assert(pid != -1);
+
+  if (pid == 0) {
+    int initialized = workers == 1 ? init() : init_workers(workers);
+
+    if (initialized < 0) exit(EXIT_SUCCESS);
+
+    st_sem_init(&sem_a, 0);
+    st_sem_init(&sem_b, 0);
+    spawn(sem_a_waiter);
+    st_sem_wait(&sem_b);
+
+    /* Never reached. */
+    exit(EXIT_SUCCESS);
+  }
+
+  int status;
+  pid_t waited = waitpid(pid, &status, 0);
+
+  assert(waited == pid);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_FAILURE);
+}
+
+#define BRIEF_ROUNDS 256
+
+static int brief_max_level = 0;
+
+/* Runs for many time slices in total, but only for a tenth of one between
+   yields, so the timer keeps going off while it runs. */
+void brief_task() {
+  for (int i = 0; i < BRIEF_ROUNDS; i++) {
+    clock_t start = clock();
+
+    while (clock() - start < CLOCKS_PER_SEC / 1000) {
+      volatile int f = fib(15);
+      (void) f;
+    }
+
+    if (current_thread()->level > brief_max_level) brief_max_level = current_thread()->level;
+    yield();
+  }
+  done();
+}
+
+/* fibonacci_slow() never yields, with preemption the cooperative threads still
+   get to run to completion. A thread that never uses up a whole time slice
+   keeps its priority next to it, however often the timer goes off while it
+   runs. This test leaves fibonacci_slow() running, so it must be the last
+   test. */
+void preemptive_test() {
+  TEST_HEADER;
+
+  int result = set_timeslice(10);
+  assert(result > 0);
+
+  spawn(fibonacci_slow);
+  tid_t a = spawn(numbers);
+  tid_t b = spawn(letters);
+
+  tid_t first = join();
+  tid_t second = join();
+
+  assert((first == a && second == b) || (first == b && second == a));
+
+  tid_t brief = spawn_with_priority(brief_task, PRIORITY_HIGH);
+  tid_t joined = join_tid(brief);
+
+  assert(joined == brief);
+  assert(brief_max_level == PRIORITY_HIGH);
+
+  result = set_timeslice(0);
+  assert(result > 0);
+}
+
+/* Runs the tests with the number of workers given as the first argument, one
+   worker by default. */
+int main(int argc, char *argv[]){
+  int workers = argc > 1 ? atoi(argv[1]) : 1;
+
+  printf("\n==== Test program for the Simple Threads API (%d workers) ====\n\n", workers);
+
+  // Before init(), the deadlock is provoked in a process of its own.
+  deadlock_test(workers);
+
+  int initialized = workers == 1 ? init() : init_workers(workers); // Initialization
+  assert(initialized > 0);
+
+  stats_test();
+  cooperative_test();
+  stack_test();
+  join_tid_test();
+  if (workers == 1) join_race_test();
+  if (workers == 1) priority_test();
+  aging_test();
+  parallel_test();
+  sem_test();
+  mutex_test();
+  buffer_test();
+  sleep_test();
+  io_test();
+
+  if (workers == 1) {
+    preemptive_test();
+  } else {
+    // Preemption needs a single worker.
+    int result = set_timeslice(10);
+    assert(result < 0);
+  }
 
-  init(); // Initialization
+  puts("\n==== All tests passed ====\n");
 }
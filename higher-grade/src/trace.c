@@ -0,0 +1,110 @@
+#include <stdlib.h>   /* malloc(), free() */
+
+#include "trace.h"
+#include "timing.h"   /* timing_start(), timing_stop() */
+
+typedef struct {
+  double time;        /* Seconds since the trace was started. */
+  int    worker;
+  int    from;
+  int    to;
+} event_t;
+
+bool trace_enabled = false;
+
+static event_t *events = NULL;
+static size_t capacity = 0;
+
+/* Number of events recorded so far, event n is kept in events[n % capacity]
+   until it is overwritten. */
+static size_t recorded = 0;
+
+static struct timespec started;
+
+int trace_start(int n) {
+  if (n < 0) return -1;
+
+  trace_enabled = false;
+
+  free(events);
+  events = NULL;
+  capacity = 0;
+  recorded = 0;
+
+  if (n == 0) return 1;
+
+  events = malloc(n * sizeof(event_t));
+  if (events == NULL) return -1;
+
+  capacity = n;
+  timing_start(&started);
+  __atomic_store_n(&trace_enabled, true, __ATOMIC_RELEASE);
+
+  return 1;
+}
+
+void trace_switch(int worker, int from, int to) {
+  size_t n = __atomic_fetch_add(&recorded, 1, __ATOMIC_RELAXED);
+  event_t *event = &events[n % capacity];
+
+  event->time = timing_stop(&started);
+  event->worker = worker;
+  event->from = from;
+  event->to = to;
+}
+
+/* Writes one slice of execution, following the worker names. */
+static void export_slice(FILE *out, int worker, int tid, double start, double end) {
+  fprintf(out, ",\n{\"name\":\"thread %d\",\"cat\":\"sthreads\",\"ph\":\"X\","
+          "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"tid\":%d}}",
+          tid, start * 1e6, (end - start) * 1e6, worker, tid);
+}
+
+int trace_export(FILE *out, int workers) {
+  if (workers < 1) return -1;
+
+  /* The start of the slice currently running on each worker. */
+  event_t *last = calloc(workers, sizeof(event_t));
+  bool *seen = calloc(workers, sizeof(bool));
+
+  if (last == NULL || seen == NULL) {
+    free(last);
+    free(seen);
+    return -1;
+  }
+
+  size_t end = __atomic_load_n(&recorded, __ATOMIC_ACQUIRE);
+  size_t first = end > capacity ? end - capacity : 0;
+  int slices = 0;
+
+  fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+  /* Time lines are named after the workers. */
+  for (int w = 0; w < workers; w++) {
+    fprintf(out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+            "\"args\":{\"name\":\"worker %d\"}}", w > 0 ? "," : "", w, w);
+  }
+
+  for (size_t n = first; n < end; n++) {
+    event_t *event = &events[n % capacity];
+    int w = event->worker;
+
+    if (w < 0 || w >= workers) continue;
+
+    /* Idle time is left empty. */
+    if (seen[w] && last[w].to >= 0) {
+      export_slice(out, w, last[w].to, last[w].time, event->time);
+      slices++;
+    }
+
+    last[w] = *event;
+    seen[w] = true;
+  }
+
+  fprintf(out, "\n]}\n");
+
+  free(last);
+  free(seen);
+
+  return slices;
+}
@@ -0,0 +1,46 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/* Context switch trace for the Simple Threads library.
+
+   Every context switch is recorded in a ring buffer of fixed capacity, once
+   the buffer is full the oldest events are overwritten. The trace can be
+   exported in the JSON format of the Chrome trace viewer (chrome://tracing or
+   https://ui.perfetto.dev), with one timeline per worker showing which thread
+   ran when.
+*/
+
+#include <stdio.h>    /* FILE */
+#include <stdbool.h>  /* bool */
+
+/* Set while events are recorded. */
+extern bool trace_enabled;
+
+/* trace_start(capacity)
+
+   Discards any previous trace and starts recording, keeping the last capacity
+   events. A capacity of zero stops recording.
+
+   Returns 1 on success and a negative value on failure.
+*/
+int trace_start(int capacity);
+
+/* trace_switch(worker, from, to)
+
+   Records a switch on worker from thread from to thread to. A thread ID of -1
+   stands for the idle context of the worker. Only called when trace_enabled is
+   set, may be called by several workers at once.
+*/
+void trace_switch(int worker, int from, int to);
+
+/* trace_export(out, workers)
+
+   Writes the recorded events for worker 0 .. workers - 1 to out in the Chrome
+   trace viewer format. Switches recorded while exporting may or may not be
+   included.
+
+   Returns the number of exported slices or a negative value on failure.
+*/
+int trace_export(FILE *out, int workers);
+
+#endif
@@ -1,10 +1,14 @@
+#include <errno.h>  // errno, EAGAIN
 #include <unistd.h> // mkstemp()
 #include <string.h> // strcpy()
 #include <stdio.h>	// perror()
 #include <stdlib.h>	// malloc()
+#include <time.h>   // clock_gettime(), nanosleep()
 
 #include "psem.h"
 
+#ifndef PSEM_FUTEX
+
 /*
   Unnamed POSIX semaphores are not implemented on macOS (aka OS X).
   Use named semaphores from sempahore.h to implement a generic API to
@@ -34,6 +38,10 @@ void perror_and_abort(psem_t *sem, const char* msg) {
 }
 
 psem_t *psem_init(unsigned int value) {
+  return psem_init_named(value, NULL);
+}
+
+psem_t *psem_init_named(unsigned int value, const char *name) {
   psem_t *sem = malloc(sizeof(psem_t));
 
   sem->name = strdup("/tmp/semaphore.XXXXXX");
@@ -44,14 +52,89 @@ psem_t *psem_init(unsigned int value) {
   if (sem->sem == SEM_FAILED) {
     perror_and_abort(sem, "sem_open()");
   }
+  PSEM_STATS_INIT(sem, name);
   return sem;
 }
 
 
+void psem_init_shared(psem_t *sem, unsigned int value) {
+  (void) sem;
+  (void) value;
+  fprintf(stderr, "psem_init_shared(): not supported by the native macOS semaphores\n");
+  abort();
+}
+
 void psem_wait(psem_t *sem) {
+#ifdef PSEM_STATS
+  // sem_wait() doesn't tell whether it blocked, try the fast path first.
+  if (psem_trywait(sem)) {
+    PSEM_STATS_FAST(sem);
+    return;
+  }
+#endif
+
+  PSEM_STATS_START(start);
+
   if (sem_wait(sem->sem) == -1) {
     perror_and_abort(sem, "sem_wait()");
   }
+
+  PSEM_STATS_STOP(sem, start);
+}
+
+bool psem_trywait(psem_t *sem) {
+  if (sem_trywait(sem->sem) == -1) {
+    if (errno == EAGAIN) return false;
+    perror_and_abort(sem, "sem_trywait()");
+  }
+  return true;
+}
+
+/* There is no way to take several tokens from a sem_t at once. */
+unsigned int psem_trywait_n(psem_t *sem, unsigned int max) {
+  unsigned int taken = 0;
+
+  while (taken < max && psem_trywait(sem)) taken++;
+
+  return taken;
+}
+
+/*
+  There is no sem_timedwait() on macOS, poll with sem_trywait() and an
+  exponentially growing sleep, capped at one millisecond.
+*/
+bool psem_timedwait(psem_t *sem, long long timeout_ns) {
+  struct timespec ts;
+  long long backoff_ns = 1000;
+
+  if (psem_trywait(sem)) {
+    PSEM_STATS_FAST(sem);
+    return true;
+  }
+
+  PSEM_STATS_START(start);
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  long long deadline = ts.tv_sec * 1000000000LL + ts.tv_nsec + timeout_ns;
+
+  while (!psem_trywait(sem)) {
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    long long remaining = deadline - (ts.tv_sec * 1000000000LL + ts.tv_nsec);
+
+    if (remaining <= 0) {
+      PSEM_STATS_STOP(sem, start);
+      return false;
+    }
+
+    long long sleep_ns = backoff_ns < remaining ? backoff_ns : remaining;
+    struct timespec delay = {.tv_sec = sleep_ns / 1000000000, .tv_nsec = sleep_ns % 1000000000};
+    nanosleep(&delay, NULL);
+
+    if (backoff_ns < 1000000) backoff_ns *= 2;
+  }
+
+  PSEM_STATS_STOP(sem, start);
+  return true;
 }
 
 void psem_signal(psem_t *sem) {
@@ -60,6 +143,20 @@ void psem_signal(psem_t *sem) {
   }
 }
 
+void psem_signal_n(psem_t *sem, unsigned int n) {
+  for (unsigned int i = 0; i < n; i++) psem_signal(sem);
+}
+
+void psem_destroy_shared(psem_t *sem) {
+  (void) sem;
+  abort();
+}
+
 void psem_destroy(psem_t *sem) {
+#ifdef PSEM_STATS
+  if (sem->stats.waits > 0) psem_stats_dump(sem);
+#endif
   cleanup(sem);
 }
+
+#endif
@@ -0,0 +1,312 @@
+/*
+  Semaphores built on a 32-bit atomic counter and the futex (Linux) or __ulock
+  (macOS) system calls.
+
+  Uncontended psem_wait() and psem_signal() are a single compare-and-swap or
+  atomic add and never enter the kernel. A thread that finds the counter at
+  zero spins for a while, hoping for a signal from another core, before it
+  parks itself in the kernel. A signaling thread only makes the wake system
+  call if some thread is parked.
+
+  Semaphores initialized with psem_init_shared() park on process-shared
+  futexes, which the kernel looks up by physical page instead of by address,
+  so that the processes may map the semaphore at different addresses. The
+  private ones skip that lookup.
+
+  The spin budget is adaptive, in the same way as for glibc's adaptive mutexes:
+  every time a waiter has to spin, the per semaphore estimate moves 1/8 of the
+  way towards the number of iterations that were actually needed.
+*/
+
+#ifdef __linux__
+#define _GNU_SOURCE // syscall()
+#endif
+
+#include <stdio.h>  // perror()
+#include <stdlib.h> // malloc(), free(), abort()
+
+#include "psem.h"
+#include "atomics.h" // cpu_relax()
+
+#ifdef PSEM_FUTEX
+
+#include <errno.h>  // errno, EAGAIN, EINTR, ETIMEDOUT
+#include <limits.h> // INT_MAX
+#include <time.h>   // clock_gettime()
+
+#ifdef __linux__
+#include <linux/futex.h> // FUTEX_WAIT[_PRIVATE], FUTEX_WAKE[_PRIVATE]
+#include <sys/syscall.h> // SYS_futex
+#include <unistd.h>      // syscall()
+#endif
+
+#ifdef __APPLE__
+/* Private but stable libSystem API used by libc++ and Swift for the same
+   purpose. */
+#define UL_COMPARE_AND_WAIT 1
+#define UL_COMPARE_AND_WAIT_SHARED 3
+#define ULF_WAKE_ALL 0x00000100
+#define ULF_NO_ERRNO 0x01000000
+
+extern int __ulock_wait(uint32_t operation, void *addr, uint64_t value,
+                        uint32_t timeout_us);
+extern int __ulock_wake(uint32_t operation, void *addr, uint64_t wake_value);
+#endif
+
+/* Upper bound for the adaptive spin budget. */
+#define PSEM_MAX_SPINS 1000
+
+/*******************************************************************************
+                              Platform dependent parking
+*******************************************************************************/
+
+/* Blocks the caller as long as *addr == expected, but at most timeout_ns
+   nanoseconds if timeout_ns >= 0. May return spuriously. shared must be set
+   if addr is in memory shared between processes.
+
+   Returns false if the timeout expired, true otherwise. */
+static bool futex_wait(uint32_t *addr, uint32_t expected, long long timeout_ns, bool shared) {
+#ifdef __linux__
+  struct timespec ts = {.tv_sec = timeout_ns / 1000000000, .tv_nsec = timeout_ns % 1000000000};
+
+  if (syscall(SYS_futex, addr, shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, expected,
+              timeout_ns >= 0 ? &ts : NULL, NULL, 0) == -1) {
+    if (errno == ETIMEDOUT) return false;
+    if (errno != EAGAIN && errno != EINTR) {
+      perror("futex(FUTEX_WAIT)");
+      abort();
+    }
+  }
+#endif
+#ifdef __APPLE__
+  // A timeout of 0 means wait forever, so round short timeouts up to 1 us.
+  uint32_t timeout_us = 0;
+
+  if (timeout_ns >= 0) {
+    timeout_us = timeout_ns / 1000 > 0 ? timeout_ns / 1000 : 1;
+  }
+
+  int ret = __ulock_wait((shared ? UL_COMPARE_AND_WAIT_SHARED : UL_COMPARE_AND_WAIT) | ULF_NO_ERRNO,
+                         addr, expected, timeout_us);
+
+  if (ret == -ETIMEDOUT) return false;
+  if (ret < 0 && ret != -EINTR && ret != -EFAULT) {
+    errno = -ret;
+    perror("__ulock_wait()");
+    abort();
+  }
+#endif
+  return true;
+}
+
+static long long monotonic_ns() {
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+    perror("clock_gettime()");
+    abort();
+  }
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Wakes up to count threads blocked in futex_wait() on addr. __ulock_wake()
+   wakes either one thread or all of them. */
+static void futex_wake(uint32_t *addr, uint32_t count, bool shared) {
+#ifdef __linux__
+  int n = count > INT_MAX ? INT_MAX : (int) count;
+
+  if (syscall(SYS_futex, addr, shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0) == -1) {
+    perror("futex(FUTEX_WAKE)");
+    abort();
+  }
+#endif
+#ifdef __APPLE__
+  uint32_t operation = (shared ? UL_COMPARE_AND_WAIT_SHARED : UL_COMPARE_AND_WAIT) | ULF_NO_ERRNO;
+
+  if (count > 1) operation |= ULF_WAKE_ALL;
+
+  int ret = __ulock_wake(operation, addr, 0);
+
+  if (ret < 0 && ret != -ENOENT && ret != -EINTR) {
+    errno = -ret;
+    perror("__ulock_wake()");
+    abort();
+  }
+#endif
+}
+
+/*******************************************************************************
+                                  Semaphore API
+*******************************************************************************/
+
+psem_t *psem_init(unsigned int value) {
+  return psem_init_named(value, NULL);
+}
+
+psem_t *psem_init_named(unsigned int value, const char *name) {
+  psem_t *sem = malloc(sizeof(psem_t));
+
+  if (sem == NULL) {
+    perror("Initializing new semaphore");
+    abort();
+  }
+
+  sem->value = value;
+  sem->waiters = 0;
+  sem->spins = 0;
+  sem->shared = false;
+  PSEM_STATS_INIT(sem, name);
+
+  return sem;
+}
+
+void psem_init_shared(psem_t *sem, unsigned int value) {
+  sem->value = value;
+  sem->waiters = 0;
+  sem->spins = 0;
+  sem->shared = true;
+  // A name would point into the memory of one process only.
+  PSEM_STATS_INIT(sem, NULL);
+}
+
+bool psem_trywait(psem_t *sem) {
+  uint32_t value = __atomic_load_n(&sem->value, __ATOMIC_RELAXED);
+
+  while (value > 0) {
+    // On failure value is updated with the current counter.
+    if (__atomic_compare_exchange_n(&sem->value, &value, value - 1, true,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+unsigned int psem_trywait_n(psem_t *sem, unsigned int max) {
+  uint32_t value = __atomic_load_n(&sem->value, __ATOMIC_RELAXED);
+
+  while (value > 0 && max > 0) {
+    uint32_t taken = value < max ? value : max;
+
+    if (__atomic_compare_exchange_n(&sem->value, &value, value - taken, true,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      return taken;
+    }
+  }
+
+  return 0;
+}
+
+/* Spins and then parks until the counter can be decremented or, if
+   timeout_ns >= 0, until timeout_ns nanoseconds have passed. */
+static bool wait_slow(psem_t *sem, long long timeout_ns) {
+  long long deadline = timeout_ns >= 0 ? monotonic_ns() + timeout_ns : -1;
+
+  /* Spin for a while before parking. */
+
+  uint32_t spins = __atomic_load_n(&sem->spins, __ATOMIC_RELAXED);
+  uint32_t max_spins = spins * 2 + 10;
+
+  if (max_spins > PSEM_MAX_SPINS) max_spins = PSEM_MAX_SPINS;
+
+  for (uint32_t i = 0; i < max_spins; i++) {
+    cpu_relax();
+
+    if (psem_trywait(sem)) {
+      __atomic_store_n(&sem->spins, spins + ((int) i - (int) spins) / 8,
+                       __ATOMIC_RELAXED);
+      return true;
+    }
+  }
+
+  __atomic_store_n(&sem->spins, spins + ((int) max_spins - (int) spins) / 8,
+                   __ATOMIC_RELAXED);
+
+  /*
+    Announce ourselves before the final check of the counter. The signaler
+    increments the counter before reading waiters, and both are sequentially
+    consistent, so either we see the new counter value or the signaler sees us.
+    The kernel rechecks value == 0 atomically when we park.
+  */
+  __atomic_fetch_add(&sem->waiters, 1, __ATOMIC_SEQ_CST);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  while (!psem_trywait(sem)) {
+    long long remaining = -1;
+
+    if (deadline >= 0 && (remaining = deadline - monotonic_ns()) <= 0) {
+      /*
+        Timed out. A signal may have picked us to wake up just now, so after
+        leaving the waiters make a last attempt, otherwise that signal would
+        be lost for the remaining waiters.
+      */
+      __atomic_fetch_sub(&sem->waiters, 1, __ATOMIC_SEQ_CST);
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+      return psem_trywait(sem);
+    }
+
+    futex_wait(&sem->value, 0, remaining, sem->shared);
+  }
+
+  __atomic_fetch_sub(&sem->waiters, 1, __ATOMIC_RELAXED);
+  return true;
+}
+
+void psem_wait(psem_t *sem) {
+  if (psem_trywait(sem)) {
+    PSEM_STATS_FAST(sem);
+    return;
+  }
+
+  PSEM_STATS_START(start);
+  wait_slow(sem, -1);
+  PSEM_STATS_STOP(sem, start);
+}
+
+bool psem_timedwait(psem_t *sem, long long timeout_ns) {
+  if (psem_trywait(sem)) {
+    PSEM_STATS_FAST(sem);
+    return true;
+  }
+
+  PSEM_STATS_START(start);
+  bool success = wait_slow(sem, timeout_ns > 0 ? timeout_ns : 0);
+  PSEM_STATS_STOP(sem, start);
+
+  return success;
+}
+
+void psem_signal(psem_t *sem) {
+  __atomic_fetch_add(&sem->value, 1, __ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n(&sem->waiters, __ATOMIC_SEQ_CST) > 0) {
+    futex_wake(&sem->value, 1, sem->shared);
+  }
+}
+
+void psem_signal_n(psem_t *sem, unsigned int n) {
+  if (n == 0) return;
+
+  __atomic_fetch_add(&sem->value, n, __ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n(&sem->waiters, __ATOMIC_SEQ_CST) > 0) {
+    futex_wake(&sem->value, n, sem->shared);
+  }
+}
+
+void psem_destroy(psem_t *sem) {
+#ifdef PSEM_STATS
+  if (sem->stats.waits > 0) psem_stats_dump(sem);
+#endif
+  free(sem);
+}
+
+void psem_destroy_shared(psem_t *sem) {
+#ifdef PSEM_STATS
+  if (sem->stats.waits > 0) psem_stats_dump(sem);
+#endif
+  (void) sem;
+}
+
+#endif
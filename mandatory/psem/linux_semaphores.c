@@ -1,35 +1,145 @@
+#define _XOPEN_SOURCE 600 // sem_timedwait(), clock_gettime()
+
+#include <errno.h> // errno, EAGAIN, EINTR, ETIMEDOUT
 #include <stdio.h> // perror()
 #include <stdlib.h> // malloc()
+#include <time.h>   // clock_gettime()
 
 #include "psem.h"
 
+#ifndef PSEM_FUTEX
+
 psem_t *psem_init(unsigned int value) {
-  psem_t *sem = malloc(sizeof(sem_t));
+  return psem_init_named(value, NULL);
+}
 
- if (sem_init(sem, 0, value) == -1) {
+psem_t *psem_init_named(unsigned int value, const char *name) {
+  psem_t *sem = malloc(sizeof(psem_t));
+
+ if (sem == NULL || sem_init(&sem->sem, 0, value) == -1) {
    perror("Initializing new semaphore");
    abort();
  }
+ PSEM_STATS_INIT(sem, name);
  return sem;
 }
 
+void psem_init_shared(psem_t *sem, unsigned int value) {
+  if (sem_init(&sem->sem, 1, value) == -1) {
+    perror("Initializing new shared semaphore");
+    abort();
+  }
+  PSEM_STATS_INIT(sem, NULL);
+}
+
 void psem_wait(psem_t *sem) {
-  if (sem_wait(sem) == -1) {
+#ifdef PSEM_STATS
+  // sem_wait() doesn't tell whether it blocked, try the fast path first.
+  if (psem_trywait(sem)) {
+    PSEM_STATS_FAST(sem);
+    return;
+  }
+#endif
+
+  PSEM_STATS_START(start);
+
+  if (sem_wait(&sem->sem) == -1) {
     perror("Wating on sempahore failed");
     abort();
   }
+
+  PSEM_STATS_STOP(sem, start);
+}
+
+bool psem_trywait(psem_t *sem) {
+  if (sem_trywait(&sem->sem) == -1) {
+    if (errno == EAGAIN) return false;
+    perror("Trying to wait on semaphore failed");
+    abort();
+  }
+  return true;
+}
+
+/* There is no way to take several tokens from a sem_t at once. */
+unsigned int psem_trywait_n(psem_t *sem, unsigned int max) {
+  unsigned int taken = 0;
+
+  while (taken < max && psem_trywait(sem)) taken++;
+
+  return taken;
+}
+
+bool psem_timedwait(psem_t *sem, long long timeout_ns) {
+  struct timespec ts;
+
+#ifdef PSEM_STATS
+  if (psem_trywait(sem)) {
+    PSEM_STATS_FAST(sem);
+    return true;
+  }
+#endif
+
+  PSEM_STATS_START(start);
+
+  // sem_timedwait() takes an absolute CLOCK_REALTIME deadline.
+  if (clock_gettime(CLOCK_REALTIME, &ts) == -1) {
+    perror("Reading the clock failed");
+    abort();
+  }
+
+  long long nsec = ts.tv_nsec + (timeout_ns > 0 ? timeout_ns : 0);
+  ts.tv_sec  += nsec / 1000000000;
+  ts.tv_nsec  = nsec % 1000000000;
+
+  bool success = true;
+
+  while (sem_timedwait(&sem->sem, &ts) == -1) {
+    if (errno == ETIMEDOUT) {
+      success = false;
+      break;
+    }
+    if (errno != EINTR) {
+      perror("Timed wait on semaphore failed");
+      abort();
+    }
+  }
+
+  PSEM_STATS_STOP(sem, start);
+  return success;
 }
 
 void psem_signal(psem_t *sem) {
-  if (sem_post(sem) == -1) {
+  if (sem_post(&sem->sem) == -1) {
     perror("Signaling on semaphore failed");
     abort();
   }
 }
 
+void psem_signal_n(psem_t *sem, unsigned int n) {
+  for (unsigned int i = 0; i < n; i++) psem_signal(sem);
+}
+
 void psem_destroy(psem_t *sem) {
-  if (sem_destroy(sem) == -1) {
+#ifdef PSEM_STATS
+  if (sem->stats.waits > 0) psem_stats_dump(sem);
+#endif
+
+  if (sem_destroy(&sem->sem) == -1) {
+    perror("Destroying semaphore failed");
+    abort();
+  }
+  free(sem);
+}
+
+void psem_destroy_shared(psem_t *sem) {
+#ifdef PSEM_STATS
+  if (sem->stats.waits > 0) psem_stats_dump(sem);
+#endif
+
+  if (sem_destroy(&sem->sem) == -1) {
     perror("Destroying semaphore failed");
     abort();
   }
 }
+
+#endif
@@ -1,7 +1,40 @@
+#ifndef PLATFORM_SPECIFICS_H
+#define PLATFORM_SPECIFICS_H
+
 #include <semaphore.h>	// sem_open(), sem_close(), sem_unlink(), sem_wait(), sem_post()
 
+#include "psem_stats.h" // PSEM_STATS_MEMBER
+
+/*
+  On Linux and macOS the default backend is a semaphore built on a 32-bit
+  atomic counter and the futex (Linux) or __ulock (macOS) system calls, see
+  futex_semaphores.c. Define PSEM_NATIVE to use the semaphores from
+  semaphore.h instead.
+*/
+#if !defined(PSEM_NATIVE) && (defined(__linux__) || defined(__APPLE__))
+#define PSEM_FUTEX
+#endif
+
+#ifdef PSEM_FUTEX
+
+#include <stdint.h> // uint32_t
+
+typedef struct {
+  uint32_t value;   // The semaphore counter, also used as the futex word.
+  uint32_t waiters; // Number of threads parked, or about to park, on value.
+  uint32_t spins;   // Running estimate of how long to spin before parking.
+  uint32_t shared;  // Set by psem_init_shared(), parked waiters use a
+                    // process-shared futex.
+  PSEM_STATS_MEMBER
+} psem_t;
+
+#else
+
 #ifdef __linux__
-typedef sem_t psem_t;
+typedef struct {
+  sem_t sem;
+  PSEM_STATS_MEMBER
+} psem_t;
 #endif
 
 #ifdef __APPLE__
@@ -9,6 +42,11 @@ typedef sem_t psem_t;
 typedef struct {
   char *name;
   sem_t *sem;
+  PSEM_STATS_MEMBER
 } psem_t;
 
 #endif
+
+#endif
+
+#endif
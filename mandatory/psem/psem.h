@@ -15,9 +15,14 @@
   First version by Karl Marklund <karl.marklund@it.uu.se>.
 */
 
+#ifndef PSEM_H
+#define PSEM_H
+
 /* Platform dependent definition of the psem_t data type. */
 #include "platform_specifics.h"
 
+#include <stdbool.h> // bool
+
 /*******************************************************************************
                                  Semaphore API
 ********************************************************************************/
@@ -33,6 +38,28 @@
 */
 psem_t *psem_init(unsigned int value);
 
+/* psem_init_named(value, name)
+
+   Same as psem_init() but gives the semaphore a name, used to tell
+   semaphores apart in the statistics of a PSEM_STATS build and ignored
+   otherwise. The name is not copied, so it must outlive the semaphore, a
+   string literal will do.
+*/
+psem_t *psem_init_named(unsigned int value, const char *name);
+
+/* psem_init_shared(sem, value)
+
+   Initializes the semaphore pointed to by sem in place, with its counter set
+   to value, for use by several processes. sem must be in memory shared by
+   the processes, for example a MAP_SHARED mapping of a shm_open() object, and
+   is initialized by one of them only. Only semaphores initialized this way
+   should be destroyed with psem_destroy_shared().
+
+   Not available with the native macOS semaphores, where a semaphore can't be
+   placed in shared memory, the program is terminated.
+*/
+void psem_init_shared(psem_t *sem, unsigned int value);
+
 /* psem_wait(sem)
 
   Atomically decrements the counter of the semaphore pointed to by sem. If the
@@ -43,6 +70,37 @@ psem_t *psem_init(unsigned int value);
 */
 void psem_wait(psem_t *sem);
 
+/* psem_trywait(sem)
+
+  Same as psem_wait() but never blocks. If the counter of the semaphore
+  pointed to by sem is greater than zero it is decremented and true is
+  returned, otherwise the counter is left untouched and false is returned.
+*/
+bool psem_trywait(psem_t *sem);
+
+/* psem_trywait_n(sem, max)
+
+  Same as psem_trywait() but takes up to max tokens at once. Takes as many of
+  them as the counter of the semaphore pointed to by sem holds, but no more
+  than max, and never blocks.
+
+  Return value
+
+  The number of tokens taken, 0 if the counter was zero.
+*/
+unsigned int psem_trywait_n(psem_t *sem, unsigned int max);
+
+/* psem_timedwait(sem, timeout_ns)
+
+  Same as psem_wait() but gives up if the counter is still zero after
+  timeout_ns nanoseconds.
+
+  Return value
+
+  true if the counter was decremented, false on timeout.
+*/
+bool psem_timedwait(psem_t *sem, long long timeout_ns);
+
 /* psem_signal(sem)
 
    Atomically increments the counter of the semaphore pointed to by sem.  If
@@ -52,9 +110,47 @@ void psem_wait(psem_t *sem);
 */
 void psem_signal(psem_t *sem);
 
+/* psem_signal_n(sem, n)
+
+   Same as n calls to psem_signal(), adds n to the counter of the semaphore
+   pointed to by sem and wakes up to n blocked processes or threads.
+*/
+void psem_signal_n(psem_t *sem, unsigned int n);
+
 /* psem_destroy(sem)
 
    Destroys the semaphore pointed to by sem. Only a semaphore that has been
    initialized by psem_init() should be destroyed using psem_destroy().
+
+   In a PSEM_STATS build the statistics of a semaphore that has been waited on
+   are printed on stderr first.
  */
 void psem_destroy(psem_t *sem);
+
+/* psem_destroy_shared(sem)
+
+   Destroys a semaphore initialized by psem_init_shared(), without freeing
+   the memory it is in. Called by one process once no process uses it.
+*/
+void psem_destroy_shared(psem_t *sem);
+
+/*******************************************************************************
+                                  Statistics
+********************************************************************************/
+
+/* psem_stats_dump(sem)
+
+   Prints the wait statistics of the semaphore pointed to by sem on stderr:
+   the number of waits, how many of them found the counter at zero and had to
+   spin or block (contended), and the total and longest time a contended wait
+   took. Does nothing unless built with PSEM_STATS, see the Makefile.
+*/
+#ifdef PSEM_STATS
+void psem_stats_dump(psem_t *sem);
+#else
+static inline void psem_stats_dump(psem_t *sem) {
+  (void) sem;
+}
+#endif
+
+#endif
@@ -0,0 +1,76 @@
+/*
+  Wait statistics for PSEM_STATS builds, see psem_stats.h. Empty otherwise.
+
+  The counters are updated with relaxed atomics, so the statistics of a
+  semaphore that is still in use are approximate, but nothing is lost.
+*/
+
+#define _XOPEN_SOURCE 600 // clock_gettime()
+
+#include <stdio.h>  // fprintf(), stderr
+#include <stdlib.h> // abort()
+#include <time.h>   // clock_gettime()
+
+#include "psem.h"
+
+#ifdef PSEM_STATS
+
+void psem_stats_init(psem_stats_t *stats, const char *name) {
+  stats->name = name;
+  stats->waits = 0;
+  stats->contended = 0;
+  stats->blocked_ns = 0;
+  stats->max_blocked_ns = 0;
+}
+
+void psem_stats_fast(psem_stats_t *stats) {
+  __atomic_fetch_add(&stats->waits, 1, __ATOMIC_RELAXED);
+}
+
+long long psem_stats_now(void) {
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+    perror("clock_gettime()");
+    abort();
+  }
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void psem_stats_blocked(psem_stats_t *stats, long long start) {
+  uint64_t ns = psem_stats_now() - start;
+  uint64_t max = __atomic_load_n(&stats->max_blocked_ns, __ATOMIC_RELAXED);
+
+  __atomic_fetch_add(&stats->waits, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&stats->contended, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&stats->blocked_ns, ns, __ATOMIC_RELAXED);
+
+  // On failure max is updated with the current maximum.
+  while (ns > max && !__atomic_compare_exchange_n(&stats->max_blocked_ns, &max, ns, true,
+                                                  __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+void psem_stats_print(const psem_stats_t *stats, const void *sem) {
+  uint64_t waits = __atomic_load_n(&stats->waits, __ATOMIC_RELAXED);
+  uint64_t contended = __atomic_load_n(&stats->contended, __ATOMIC_RELAXED);
+  uint64_t blocked_ns = __atomic_load_n(&stats->blocked_ns, __ATOMIC_RELAXED);
+  uint64_t max_ns = __atomic_load_n(&stats->max_blocked_ns, __ATOMIC_RELAXED);
+
+  if (stats->name != NULL) {
+    fprintf(stderr, "psem %-16s", stats->name);
+  } else {
+    fprintf(stderr, "psem %-16p", sem);
+  }
+
+  fprintf(stderr, " %10llu waits %10llu contended (%5.1f%%)  blocked %10.3f ms total %10.3f ms max\n",
+          (unsigned long long) waits, (unsigned long long) contended,
+          waits > 0 ? 100.0 * contended / waits : 0.0,
+          blocked_ns / 1E6, max_ns / 1E6);
+}
+
+void psem_stats_dump(psem_t *sem) {
+  psem_stats_print(&sem->stats, sem);
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef PSEM_STATS_H
+#define PSEM_STATS_H
+
+/*
+  Per semaphore wait statistics, compiled in by defining PSEM_STATS. Every
+  backend embeds a psem_stats_t in its psem_t and records its waits through
+  the PSEM_STATS_ macros below, which expand to nothing in a normal build.
+
+  A wait is contended when the counter was zero so the fast path could not be
+  taken, its blocked time is measured from then until the wait returns,
+  including any spinning.
+*/
+
+#ifdef PSEM_STATS
+
+#include <stdint.h> // uint64_t
+
+typedef struct {
+  const char *name;           // Given to psem_init_named(), may be NULL.
+  uint64_t   waits;           // psem_wait() and psem_timedwait() calls.
+  uint64_t   contended;       // Waits that missed the fast path.
+  uint64_t   blocked_ns;      // Total time of the contended waits.
+  uint64_t   max_blocked_ns;  // Longest contended wait.
+} psem_stats_t;
+
+void psem_stats_init(psem_stats_t *stats, const char *name);
+
+/* Records an uncontended wait. */
+void psem_stats_fast(psem_stats_t *stats);
+
+/* Monotonic clock in nanoseconds, the start of a contended wait. */
+long long psem_stats_now(void);
+
+/* Records a contended wait that started at start. */
+void psem_stats_blocked(psem_stats_t *stats, long long start);
+
+/* Prints stats on stderr, sem identifies unnamed semaphores. */
+void psem_stats_print(const psem_stats_t *stats, const void *sem);
+
+#define PSEM_STATS_MEMBER           psem_stats_t stats;
+#define PSEM_STATS_INIT(sem, name)  psem_stats_init(&(sem)->stats, (name))
+#define PSEM_STATS_FAST(sem)        psem_stats_fast(&(sem)->stats)
+#define PSEM_STATS_START(start)     long long start = psem_stats_now()
+#define PSEM_STATS_STOP(sem, start) psem_stats_blocked(&(sem)->stats, (start))
+
+#else
+
+#define PSEM_STATS_MEMBER
+#define PSEM_STATS_INIT(sem, name)  ((void) (name))
+#define PSEM_STATS_FAST(sem)
+#define PSEM_STATS_START(start)
+#define PSEM_STATS_STOP(sem, start)
+
+#endif
+
+#endif
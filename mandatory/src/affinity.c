@@ -0,0 +1,346 @@
+#ifdef __linux__
+#define _GNU_SOURCE  // pthread_setaffinity_np(), sched_getaffinity(), CPU_SET()
+#endif
+#ifdef __APPLE__
+#define _DARWIN_C_SOURCE // MAP_ANON
+#endif
+
+#include "affinity.h"
+
+#include <stdio.h>    // snprintf(), fopen(), fscanf(), perror()
+#include <stdlib.h>   // malloc(), free(), qsort(), strtol(), exit()
+#include <string.h>   // strcmp()
+#include <unistd.h>   // sysconf()
+#include <pthread.h>  // pthread_self()
+#include <sys/mman.h> // mmap(), munmap()
+#ifdef __linux__
+#include <sched.h>    // cpu_set_t, sched_getaffinity()
+#include <dirent.h>   // opendir(), readdir()
+#endif
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* Where a CPU sits in the machine. */
+typedef struct {
+  int cpu;
+  int node;
+  int package;
+  int core;      // Core id within the package.
+  int sibling;   // Index among the hardware threads of the core.
+  int core_rank; // Index of the core within the node.
+} cpu_info_t;
+
+/*******************************************************************************
+                                   Topology
+*******************************************************************************/
+
+#ifdef __linux__
+
+/* Reads an integer from the sysfs file of cpu, default if there is none. */
+static int read_topology(int cpu, const char *file, int default_value) {
+  char path[128];
+  int value;
+
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, file);
+
+  FILE *f = fopen(path, "r");
+
+  if (f == NULL) return default_value;
+  if (fscanf(f, "%d", &value) != 1) value = default_value;
+  fclose(f);
+
+  return value;
+}
+
+/* The NUMA node of cpu, from the nodeN link in its sysfs directory. */
+static int read_node(int cpu) {
+  char path[64];
+  struct dirent *entry;
+  int node = 0;
+
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+
+  DIR *dir = opendir(path);
+
+  if (dir == NULL) return 0;
+
+  while ((entry = readdir(dir)) != NULL) {
+    if (sscanf(entry->d_name, "node%d", &node) == 1) break;
+  }
+  closedir(dir);
+
+  return node;
+}
+
+#endif
+
+/* Fills *cpus with the CPUs the process may run on, in increasing order.
+   Returns their number. */
+static int topology(cpu_info_t **cpus) {
+  int n = 0;
+
+#ifdef __linux__
+  cpu_set_t set;
+
+  if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+    perror("sched_getaffinity()");
+    exit(EXIT_FAILURE);
+  }
+
+  *cpus = malloc(CPU_COUNT(&set) * sizeof(cpu_info_t));
+
+  for (int cpu = 0; *cpus != NULL && cpu < CPU_SETSIZE; cpu++) {
+    if (!CPU_ISSET(cpu, &set)) continue;
+
+    (*cpus)[n++] = (cpu_info_t) {
+      .cpu = cpu,
+      .node = read_node(cpu),
+      .package = read_topology(cpu, "physical_package_id", 0),
+      .core = read_topology(cpu, "core_id", cpu),
+    };
+  }
+#else
+  long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+  *cpus = malloc((online > 0 ? online : 1) * sizeof(cpu_info_t));
+
+  for (n = 0; *cpus != NULL && n < (online > 0 ? online : 1); n++) {
+    (*cpus)[n] = (cpu_info_t) {.cpu = n, .node = 0, .package = 0, .core = n};
+  }
+#endif
+
+  if (*cpus == NULL) {
+    perror("Could not allocate the CPU topology");
+    exit(EXIT_FAILURE);
+  }
+
+  for (int i = 0; i < n; i++) {
+    cpu_info_t *c = &(*cpus)[i];
+
+    c->sibling = 0;
+    c->core_rank = 0;
+
+    for (int j = 0; j < n; j++) {
+      cpu_info_t *d = &(*cpus)[j];
+
+      if (d->package == c->package && d->core == c->core && d->cpu < c->cpu) c->sibling++;
+    }
+  }
+
+  // Ranks count the first hardware thread of every lower core in the node.
+  for (int i = 0; i < n; i++) {
+    cpu_info_t *c = &(*cpus)[i];
+
+    for (int j = 0; j < n; j++) {
+      cpu_info_t *d = &(*cpus)[j];
+
+      if (d->sibling == 0 && d->node == c->node &&
+          (d->package < c->package || (d->package == c->package && d->core < c->core))) {
+        c->core_rank++;
+      }
+    }
+  }
+
+  return n;
+}
+
+static int compare_compact(const void *a, const void *b) {
+  const cpu_info_t *x = a, *y = b;
+
+  if (x->node != y->node) return x->node - y->node;
+  if (x->package != y->package) return x->package - y->package;
+  if (x->core != y->core) return x->core - y->core;
+  return x->cpu - y->cpu;
+}
+
+static int compare_scatter(const void *a, const void *b) {
+  const cpu_info_t *x = a, *y = b;
+
+  if (x->sibling != y->sibling) return x->sibling - y->sibling;
+  if (x->core_rank != y->core_rank) return x->core_rank - y->core_rank;
+  if (x->node != y->node) return x->node - y->node;
+  return x->cpu - y->cpu;
+}
+
+/* Parses a list such as "0,2,4-7" into affinity, every CPU must be one of
+   the n in cpus. */
+static bool parse_list(affinity_t *affinity, const char *spec, cpu_info_t *cpus, int n) {
+  const char *s = spec;
+  int count = 0;
+
+  affinity->cpus = NULL;
+  affinity->nodes = NULL;
+
+  while (true) {
+    char *end;
+    long first = strtol(s, &end, 10), last = first;
+
+    if (end == s || first < 0) return false;
+    if (*end == '-') {
+      s = end + 1;
+      last = strtol(s, &end, 10);
+      if (end == s || last < first) return false;
+    }
+
+    for (long cpu = first; cpu <= last; cpu++) {
+      int i = 0;
+
+      while (i < n && cpus[i].cpu != cpu) i++;
+      if (i == n) return false;
+
+      int *grown_cpus = realloc(affinity->cpus, (count + 1) * sizeof(int));
+      if (grown_cpus != NULL) affinity->cpus = grown_cpus;
+      int *grown_nodes = realloc(affinity->nodes, (count + 1) * sizeof(int));
+      if (grown_nodes != NULL) affinity->nodes = grown_nodes;
+
+      if (grown_cpus == NULL || grown_nodes == NULL) {
+        perror("Could not allocate the CPU list");
+        exit(EXIT_FAILURE);
+      }
+
+      affinity->cpus[count] = cpus[i].cpu;
+      affinity->nodes[count] = cpus[i].node;
+      count++;
+    }
+
+    if (*end == '\0') break;
+    if (*end != ',') return false;
+    s = end + 1;
+  }
+
+  affinity->ncpus = count;
+  return true;
+}
+
+/*******************************************************************************
+                                  Interface
+*******************************************************************************/
+
+bool affinity_init(affinity_t *affinity, const char *spec) {
+  cpu_info_t *cpus;
+  int n = topology(&cpus);
+  bool ok = true;
+
+  affinity->ncpus = 0;
+  affinity->cpus = NULL;
+  affinity->nodes = NULL;
+
+  if (strcmp(spec, "none") == 0) {
+    affinity->policy = AFFINITY_NONE;
+  } else if (strcmp(spec, "compact") == 0 || strcmp(spec, "scatter") == 0) {
+    affinity->policy = spec[0] == 'c' ? AFFINITY_COMPACT : AFFINITY_SCATTER;
+    qsort(cpus, n, sizeof(cpu_info_t),
+          affinity->policy == AFFINITY_COMPACT ? compare_compact : compare_scatter);
+
+    affinity->ncpus = n;
+    affinity->cpus = malloc(n * sizeof(int));
+    affinity->nodes = malloc(n * sizeof(int));
+
+    if (affinity->cpus == NULL || affinity->nodes == NULL) {
+      perror("Could not allocate the CPU list");
+      exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < n; i++) {
+      affinity->cpus[i] = cpus[i].cpu;
+      affinity->nodes[i] = cpus[i].node;
+    }
+  } else {
+    affinity->policy = AFFINITY_LIST;
+    ok = parse_list(affinity, spec, cpus, n);
+    if (!ok) affinity_destroy(affinity);
+  }
+
+  free(cpus);
+
+  return ok;
+}
+
+void affinity_destroy(affinity_t *affinity) {
+  free(affinity->cpus);
+  free(affinity->nodes);
+  affinity->cpus = NULL;
+  affinity->nodes = NULL;
+  affinity->ncpus = 0;
+}
+
+int affinity_cpu(const affinity_t *affinity, int i) {
+  if (affinity == NULL || affinity->ncpus == 0) return -1;
+  return affinity->cpus[i % affinity->ncpus];
+}
+
+int affinity_node(const affinity_t *affinity, int i) {
+  if (affinity == NULL || affinity->ncpus == 0) return -1;
+  return affinity->nodes[i % affinity->ncpus];
+}
+
+int affinity_nodes(const affinity_t *affinity, int nthreads) {
+  int nodes = 0;
+
+  if (affinity == NULL || affinity->ncpus == 0) return 0;
+  if (nthreads > affinity->ncpus) nthreads = affinity->ncpus;
+
+  for (int i = 0; i < nthreads; i++) {
+    int j = 0;
+
+    while (j < i && affinity->nodes[j] != affinity->nodes[i]) j++;
+    if (j == i) nodes++;
+  }
+
+  return nodes;
+}
+
+int affinity_pin(const affinity_t *affinity, int i) {
+  int cpu = affinity_cpu(affinity, i);
+
+#ifdef __linux__
+  cpu_set_t set;
+
+  if (cpu < 0) return -1;
+
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? cpu : -1;
+#else
+  (void) cpu; // Not supported, the threads are left to the OS.
+  return -1;
+#endif
+}
+
+void affinity_describe(const affinity_t *affinity, int nthreads, char *buffer, size_t size) {
+  static const char *names[] = {"none", "compact", "scatter", "list"};
+  int n = nthreads < affinity->ncpus ? nthreads : affinity->ncpus;
+  size_t length = snprintf(buffer, size, "%s", names[affinity->policy]);
+
+  if (affinity->policy == AFFINITY_NONE) return;
+
+  for (int i = 0; i < n && length < size; i++) {
+    length += snprintf(buffer + length, size - length, "%s%d", i == 0 ? ", CPUs " : ",",
+                       affinity->cpus[i]);
+  }
+
+  if (length < size) {
+    int nodes = affinity_nodes(affinity, nthreads);
+
+    length += snprintf(buffer + length, size - length, " on %d node%s%s", nodes,
+                       nodes == 1 ? "" : "s", nthreads > affinity->ncpus ? ", shared" : "");
+  }
+}
+
+void *affinity_alloc(size_t size) {
+  void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (memory == MAP_FAILED) {
+    perror("mmap()");
+    exit(EXIT_FAILURE);
+  }
+
+  return memory;
+}
+
+void affinity_free(void *memory, size_t size) {
+  if (memory != NULL) munmap(memory, size);
+}
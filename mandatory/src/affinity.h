@@ -0,0 +1,102 @@
+/**
+ * Thread placement.
+ *
+ * An affinity_t is an ordered list of CPUs, thread i of a benchmark or pool
+ * is pinned to CPU i modulo the length of the list. The order comes from a
+ * placement policy:
+ *
+ *   compact  Fill a core (all its hardware threads), then the next core of
+ *            the same NUMA node, then the next node. Threads share caches
+ *            and never cross a socket until they have to.
+ *
+ *   scatter  One thread per NUMA node in turn, then per core, hardware
+ *            threads of the same core last. Threads get as much cache and
+ *            memory bandwidth as possible but talk across sockets.
+ *
+ *   0,2,4-7  An explicit list of CPUs, in that order.
+ *
+ *   none     No pinning, the scheduler decides.
+ *
+ * The topology is read from /sys/devices/system/cpu on Linux, only the CPUs
+ * the process may run on are used. Elsewhere the CPUs are assumed to be one
+ * node of single threaded cores, and threads can't be pinned.
+ *
+ * Memory
+ *
+ * Linux places a page on the NUMA node of the thread that first touches it.
+ * Memory from affinity_alloc() has not been touched by anyone, so it ends up
+ * local to the thread that first writes to it, while memory from malloc() has
+ * often already been touched by the allocating thread. Allocate per-thread
+ * data with affinity_alloc() and initialize it from the pinned thread.
+ */
+
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stdbool.h> // bool
+#include <stddef.h>  // size_t
+
+typedef enum {AFFINITY_NONE, AFFINITY_COMPACT, AFFINITY_SCATTER, AFFINITY_LIST} affinity_policy_t;
+
+typedef struct {
+  affinity_policy_t policy;
+  int ncpus;  // Length of cpus and nodes.
+  int *cpus;  // Thread i runs on cpus[i % ncpus].
+  int *nodes; // NUMA node of each of cpus.
+} affinity_t;
+
+/* affinity_init(affinity, spec)
+
+   Initializes affinity from spec, one of "none", "compact", "scatter" or a
+   comma separated list of CPUs and CPU ranges.
+
+   Return value
+
+   true on success, false if spec is invalid or lists a CPU the process may
+   not run on.
+*/
+bool affinity_init(affinity_t *affinity, const char *spec);
+
+/* Frees the CPU list of affinity. */
+void affinity_destroy(affinity_t *affinity);
+
+/* CPU of thread i, -1 for AFFINITY_NONE. */
+int affinity_cpu(const affinity_t *affinity, int i);
+
+/* NUMA node of thread i, -1 for AFFINITY_NONE. */
+int affinity_node(const affinity_t *affinity, int i);
+
+/* Number of NUMA nodes that threads 0 to nthreads - 1 run on, 0 for
+   AFFINITY_NONE. */
+int affinity_nodes(const affinity_t *affinity, int nthreads);
+
+/* affinity_pin(affinity, i)
+
+   Pins the calling thread to the CPU of thread i. affinity may be NULL, which
+   is the same as AFFINITY_NONE.
+
+   Return value
+
+   The CPU, or -1 if the thread was not pinned.
+*/
+int affinity_pin(const affinity_t *affinity, int i);
+
+/* affinity_describe(affinity, nthreads, buffer, size)
+
+   Writes a description of where threads 0 to nthreads - 1 run to buffer, for
+   example "compact, CPUs 0,1,2,3 on 1 node". Truncated to size bytes.
+*/
+void affinity_describe(const affinity_t *affinity, int nthreads, char *buffer, size_t size);
+
+/* affinity_alloc(size)
+
+   Allocates size bytes of zeroed, page aligned memory that no thread has
+   touched yet, so its pages are placed on the NUMA node of the thread that
+   first touches them. Terminates the program if out of memory.
+*/
+void *affinity_alloc(size_t size);
+
+/* Frees memory of size bytes from affinity_alloc(). */
+void affinity_free(void *memory, size_t size);
+
+#endif
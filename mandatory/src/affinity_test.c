@@ -0,0 +1,171 @@
+/**
+ * Unit test for thread placement.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE  // sched_getcpu()
+#endif
+
+#include "affinity.h"
+
+#include <stdio.h>   // printf(), setbuf(), stdout
+#include <stdlib.h>  // calloc(), free()
+#include <string.h>  // memset()
+#include <pthread.h> // pthread_...
+#include <assert.h>  // assert()
+#ifdef __linux__
+#include <sched.h>   // sched_getcpu()
+#endif
+
+#define TEST_HEADER printf("\n==== %s ====\n\n", __FUNCTION__)
+
+void success() {
+  printf("\nTest SUCCESSFUL :-)\n\n");
+}
+
+affinity_t compact, scatter;
+char description[256];
+
+void none_test() {
+  TEST_HEADER;
+
+  affinity_t none;
+  bool ok = affinity_init(&none, "none");
+
+  assert(ok);
+  assert(none.policy == AFFINITY_NONE);
+  assert(affinity_cpu(&none, 0) == -1);
+  int cpu = affinity_pin(&none, 0);
+  assert(cpu == -1);
+  cpu = affinity_pin(NULL, 0);
+  assert(cpu == -1);
+  assert(affinity_nodes(&none, 4) == 0);
+
+  affinity_describe(&none, 4, description, sizeof(description));
+  printf("%s\n", description);
+
+  affinity_destroy(&none);
+
+  success();
+}
+
+/* compact and scatter are two orders of the same CPUs. compact keeps nodes
+   together, scatter takes a new node as long as there is one. */
+void policy_test() {
+  TEST_HEADER;
+
+  bool ok = affinity_init(&compact, "compact");
+  assert(ok);
+  ok = affinity_init(&scatter, "scatter");
+  assert(ok);
+  assert(compact.ncpus > 0 && compact.ncpus == scatter.ncpus);
+
+  int n = compact.ncpus;
+  int *seen = calloc(n, sizeof(int));
+
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      if (scatter.cpus[j] == compact.cpus[i]) seen[i]++;
+    }
+  }
+  for (int i = 0; i < n; i++) assert(seen[i] == 1);
+  free(seen);
+
+  for (int i = 1; i < n; i++) assert(compact.nodes[i] >= compact.nodes[i - 1]);
+
+  int nodes = affinity_nodes(&compact, n);
+  for (int i = 1; i <= nodes; i++) assert(affinity_nodes(&scatter, i) == i);
+
+  // Threads wrap around the CPUs.
+  assert(affinity_cpu(&compact, n) == compact.cpus[0]);
+
+  affinity_describe(&compact, n, description, sizeof(description));
+  printf("%s\n", description);
+  affinity_describe(&scatter, n, description, sizeof(description));
+  printf("%s\n", description);
+
+  success();
+}
+
+void list_test() {
+  TEST_HEADER;
+
+  affinity_t list;
+  char spec[64];
+  int cpu = compact.cpus[0];
+
+  snprintf(spec, sizeof(spec), "%d,%d-%d", cpu, cpu, cpu);
+  bool ok = affinity_init(&list, spec);
+  assert(ok);
+  assert(list.policy == AFFINITY_LIST && list.ncpus == 2);
+  assert(affinity_cpu(&list, 0) == cpu && affinity_cpu(&list, 1) == cpu);
+  affinity_destroy(&list);
+
+  const char *invalid[] = {"", "zero", "0,", "3-1", "100000"};
+
+  for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+    ok = affinity_init(&list, invalid[i]);
+    assert(!ok);
+  }
+
+  success();
+}
+
+void *pinned(void *arg) {
+  int i = *(int *) arg;
+  int cpu = affinity_pin(&scatter, i);
+
+#ifdef __linux__
+  assert(cpu == affinity_cpu(&scatter, i));
+  assert(sched_getcpu() == cpu);
+#else
+  assert(cpu == -1);
+#endif
+
+  return NULL;
+}
+
+void pin_test() {
+  TEST_HEADER;
+
+  int n = scatter.ncpus + 1;
+  pthread_t threads[n];
+  int ids[n];
+
+  for (int i = 0; i < n; i++) {
+    ids[i] = i;
+    int created = pthread_create(&threads[i], NULL, pinned, &ids[i]);
+    assert(created == 0);
+  }
+
+  for (int i = 0; i < n; i++) pthread_join(threads[i], NULL);
+
+  success();
+}
+
+void alloc_test() {
+  TEST_HEADER;
+
+  size_t size = 3 * 4096 + 1;
+  char *memory = affinity_alloc(size);
+
+  for (size_t i = 0; i < size; i++) assert(memory[i] == 0);
+  memset(memory, 1, size);
+
+  affinity_free(memory, size);
+
+  success();
+}
+
+int main(void) {
+  setbuf(stdout, NULL);
+
+  none_test();
+  policy_test();
+  list_test();
+  pin_test();
+  alloc_test();
+
+  affinity_destroy(&compact);
+  affinity_destroy(&scatter);
+}
@@ -0,0 +1,94 @@
+/**
+ * Atomic operations with explicit memory orders.
+ *
+ * A thin layer over C11 <stdatomic.h>. Every operation names its memory order,
+ * so the code says exactly which ordering it relies on instead of paying for
+ * a full barrier everywhere, as the legacy __sync builtins and the default
+ * (sequentially consistent) C11 operations do. On x86-64 most orderings
+ * compile to the same instructions, but on ARM an acquire load or a release
+ * store is much cheaper than a sequentially consistent one.
+ *
+ *   relaxed - atomicity only, no ordering with respect to other variables.
+ *             Enough for counters and statistics.
+ *   acquire - later loads and stores stay after the operation. Used to take a
+ *             lock or to read data published by another thread.
+ *   release - earlier loads and stores stay before the operation. Used to
+ *             release a lock or to publish data.
+ *   acq_rel - both, for read-modify-write operations that do both.
+ *   seq_cst - in addition a single total order of all seq_cst operations,
+ *             needed when a thread writes one variable and then reads another
+ *             one that another thread writes (as in Dekker's algorithm).
+ *
+ * The operands are C11 _Atomic objects, for example atomic_int or
+ * atomic_size_t.
+ */
+
+#ifndef ATOMICS_H
+#define ATOMICS_H
+
+#include <stdatomic.h>
+
+#define load_relaxed(p)           atomic_load_explicit(p, memory_order_relaxed)
+#define load_acquire(p)           atomic_load_explicit(p, memory_order_acquire)
+#define load_seq_cst(p)           atomic_load_explicit(p, memory_order_seq_cst)
+
+#define store_relaxed(p, v)       atomic_store_explicit(p, v, memory_order_relaxed)
+#define store_release(p, v)       atomic_store_explicit(p, v, memory_order_release)
+#define store_seq_cst(p, v)       atomic_store_explicit(p, v, memory_order_seq_cst)
+
+#define exchange_acquire(p, v)    atomic_exchange_explicit(p, v, memory_order_acquire)
+#define exchange_acq_rel(p, v)    atomic_exchange_explicit(p, v, memory_order_acq_rel)
+#define exchange_seq_cst(p, v)    atomic_exchange_explicit(p, v, memory_order_seq_cst)
+
+#define fetch_add_relaxed(p, v)   atomic_fetch_add_explicit(p, v, memory_order_relaxed)
+#define fetch_add_seq_cst(p, v)   atomic_fetch_add_explicit(p, v, memory_order_seq_cst)
+#define fetch_sub_relaxed(p, v)   atomic_fetch_sub_explicit(p, v, memory_order_relaxed)
+#define fetch_sub_release(p, v)   atomic_fetch_sub_explicit(p, v, memory_order_release)
+#define fetch_sub_seq_cst(p, v)   atomic_fetch_sub_explicit(p, v, memory_order_seq_cst)
+
+/* cas_weak_relaxed(p, expected, desired)
+
+   Compare-and-swap that may fail spuriously, meant to be used in a loop. On
+   failure *expected is updated with the current value of *p.
+*/
+#define cas_weak_relaxed(p, expected, desired) \
+  atomic_compare_exchange_weak_explicit(p, expected, desired, \
+                                        memory_order_relaxed, memory_order_relaxed)
+
+/* cas_weak_acquire(p, expected, desired)
+
+   Same as cas_weak_relaxed() with acquire ordering on success.
+*/
+#define cas_weak_acquire(p, expected, desired) \
+  atomic_compare_exchange_weak_explicit(p, expected, desired, \
+                                        memory_order_acquire, memory_order_relaxed)
+
+/* cas_strong_release(p, expected, desired)
+
+   Compare-and-swap that only fails if *p != *expected, with release ordering
+   on success.
+*/
+#define cas_strong_release(p, expected, desired) \
+  atomic_compare_exchange_strong_explicit(p, expected, desired, \
+                                          memory_order_release, memory_order_relaxed)
+
+#define fence_acquire()           atomic_thread_fence(memory_order_acquire)
+#define fence_release()           atomic_thread_fence(memory_order_release)
+#define fence_seq_cst()           atomic_thread_fence(memory_order_seq_cst)
+
+/* cpu_relax()
+
+   Tells the CPU that the caller is spinning, to be called in every iteration
+   of a busy-wait loop. It saves power and lets the other hardware thread of
+   the core run, and on x86 it avoids the memory order violation that ends the
+   loop.
+*/
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define cpu_relax() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
+
+#endif
@@ -0,0 +1,144 @@
+#include "barrier.h"
+
+#include <stdio.h>   // fprintf(), perror()
+#include <stdlib.h>  // posix_memalign(), free(), exit()
+#include <stdbool.h> // bool
+#include <unistd.h>  // sysconf()
+
+/*
+  A waiter spins on a word until it reaches a target episode. Episodes are
+  unsigned counters that are allowed to wrap, so "reached" is computed on the
+  signed difference.
+
+  After BARRIER_SPIN iterations the waiter parks: it announces itself in
+  sleepers and then, with the mutex held, waits on the condition variable
+  until the word reaches the target. A thread updating a word issues a full
+  fence and only takes the mutex to broadcast if someone sleeps. Both sides
+  write before they read with a fence in between, so either the sleeper sees
+  the update before it waits or the updater sees the sleeper.
+*/
+
+static inline bool reached(atomic_uint *word, unsigned int target) {
+  return (int) (load_acquire(word) - target) >= 0;
+}
+
+static void wait_for(barrier_t *barrier, atomic_uint *word, unsigned int target) {
+  for (int i = 0; i < barrier->spin; i++) {
+    if (reached(word, target)) return;
+    cpu_relax();
+  }
+
+  pthread_mutex_lock(&barrier->mutex);
+  fetch_add_relaxed(&barrier->sleepers, 1);
+  fence_seq_cst();
+
+  while (!reached(word, target)) {
+    pthread_cond_wait(&barrier->cond, &barrier->mutex);
+  }
+
+  fetch_sub_relaxed(&barrier->sleepers, 1);
+  pthread_mutex_unlock(&barrier->mutex);
+}
+
+/* Sets *word to value and wakes up parked waiters. */
+static void signal_word(barrier_t *barrier, atomic_uint *word, unsigned int value) {
+  store_release(word, value);
+  fence_seq_cst();
+
+  if (load_relaxed(&barrier->sleepers) > 0) {
+    pthread_mutex_lock(&barrier->mutex);
+    pthread_cond_broadcast(&barrier->cond);
+    pthread_mutex_unlock(&barrier->mutex);
+  }
+}
+
+void barrier_init(barrier_t *barrier, int n, barrier_kind_t kind) {
+  if (n < 1) {
+    fprintf(stderr, "Number of barrier participants must be positive, got %d\n", n);
+    exit(EXIT_FAILURE);
+  }
+
+  if (kind == BARRIER_AUTO) {
+    kind = n <= BARRIER_CENTRAL_MAX ? BARRIER_CENTRAL : BARRIER_DISSEMINATION;
+  }
+
+  barrier->kind = kind;
+  barrier->n = n;
+  barrier->rounds = 0;
+  while (1 << barrier->rounds < n) barrier->rounds++;
+  barrier->spin = n <= sysconf(_SC_NPROCESSORS_ONLN) ? BARRIER_SPIN : 0;
+
+  atomic_init(&barrier->count, 0);
+  atomic_init(&barrier->episode, 0);
+  atomic_init(&barrier->sleepers, 0);
+  barrier->participants = NULL;
+
+  if (kind == BARRIER_DISSEMINATION) {
+    void *participants;
+
+    if (posix_memalign(&participants, CACHE_LINE, n * sizeof(barrier_participant_t)) != 0) {
+      perror("Could not allocate barrier participants");
+      exit(EXIT_FAILURE);
+    }
+
+    barrier->participants = participants;
+
+    for (int i = 0; i < n; i++) {
+      for (int k = 0; k < barrier->rounds; k++) {
+        atomic_init(&barrier->participants[i].flags[k], 0);
+      }
+      barrier->participants[i].episode = 0;
+    }
+  }
+
+  pthread_mutex_init(&barrier->mutex, NULL);
+  pthread_cond_init(&barrier->cond, NULL);
+}
+
+void barrier_destroy(barrier_t *barrier) {
+  free(barrier->participants);
+  barrier->participants = NULL;
+
+  pthread_mutex_destroy(&barrier->mutex);
+  pthread_cond_destroy(&barrier->cond);
+}
+
+static void central_wait(barrier_t *barrier) {
+  // Read the episode before arriving, it can't flip until we have arrived.
+  unsigned int episode = load_acquire(&barrier->episode);
+
+  if (atomic_fetch_add_explicit(&barrier->count, 1, memory_order_acq_rel) == barrier->n - 1) {
+    // Last to arrive. Reset the count for the next episode before releasing
+    // the others, who may arrive at the next episode right away.
+    store_relaxed(&barrier->count, 0);
+    signal_word(barrier, &barrier->episode, episode + 1);
+  } else {
+    wait_for(barrier, &barrier->episode, episode + 1);
+  }
+}
+
+static void dissemination_wait(barrier_t *barrier, int id) {
+  barrier_participant_t *me = &barrier->participants[id];
+  unsigned int episode = ++me->episode;
+
+  for (int k = 0; k < barrier->rounds; k++) {
+    barrier_participant_t *partner = &barrier->participants[(id + (1 << k)) % barrier->n];
+
+    // The partner's flag only ever moves forward, a partner that is already
+    // in the next episode has also received this episode's signal.
+    signal_word(barrier, &partner->flags[k], episode);
+    wait_for(barrier, &me->flags[k], episode);
+  }
+}
+
+void barrier_wait(barrier_t *barrier, int id) {
+  if (barrier->kind == BARRIER_CENTRAL) {
+    central_wait(barrier);
+  } else {
+    dissemination_wait(barrier, id);
+  }
+}
+
+char *barrier_kind_name(barrier_t *barrier) {
+  return barrier->kind == BARRIER_CENTRAL ? "central" : "dissemination";
+}
@@ -0,0 +1,100 @@
+/**
+ * Reusable barriers for N threads.
+ *
+ * A barrier makes every participating thread wait in barrier_wait() until all
+ * participants have arrived, after which all of them continue and the barrier
+ * can immediately be used again for the next phase. Two algorithms are
+ * provided:
+ *
+ *   BARRIER_CENTRAL       - sense-reversing centralized barrier. Arriving
+ *                           threads increment a shared counter, the last one
+ *                           to arrive resets it and flips the sense, which
+ *                           the others are waiting for. Only one cache line
+ *                           is written per arrival, but every arrival writes
+ *                           the same line. Best for a handful of threads.
+ *
+ *   BARRIER_DISSEMINATION - log2(N) rounds. In round k thread i signals thread
+ *                           (i + 2^k) mod N and waits for a signal from
+ *                           thread (i - 2^k) mod N. No shared counter, every
+ *                           thread spins on flags of its own. Best for many
+ *                           threads.
+ *
+ * Instead of a sense bit that flips between true and false, both barriers
+ * count episodes (phases), so a thread never needs to remember the sense of
+ * the previous episode.
+ *
+ * Waiting threads spin for a while and then park on a condition variable, so
+ * a barrier with a slow participant doesn't burn the other cores.
+ */
+
+#ifndef BARRIER_H
+#define BARRIER_H
+
+#include <pthread.h> // pthread_mutex_t, pthread_cond_t
+
+#include "cache_line.h" // CACHE_ALIGNED
+#include "atomics.h"    // atomic_uint, atomic_int
+
+typedef enum {
+  BARRIER_AUTO,          // Central for a few threads, dissemination otherwise.
+  BARRIER_CENTRAL,
+  BARRIER_DISSEMINATION
+} barrier_kind_t;
+
+/* Largest number of participants for which BARRIER_AUTO picks the central
+   barrier. */
+#define BARRIER_CENTRAL_MAX 8
+
+/* Number of spin iterations before a waiting thread parks. Waiters park right
+   away if there are more participants than cores, since then the thread they
+   are waiting for may well need the core they are spinning on. */
+#define BARRIER_SPIN 2000
+
+/* State owned by one participant of a dissemination barrier. */
+typedef struct {
+  CACHE_ALIGNED
+  atomic_uint flags[32]; // Episode of the last signal received in each round.
+  unsigned int episode;  // Episodes passed by this participant.
+} barrier_participant_t;
+
+typedef struct {
+  barrier_kind_t kind;
+  int            n;       // Number of participants.
+  int            rounds;  // Dissemination: ceil(log2(n)).
+  int            spin;    // Spin iterations before parking.
+
+  /* Central barrier. */
+  CACHE_ALIGNED
+  atomic_int     count;   // Threads arrived in the current episode.
+  CACHE_ALIGNED
+  atomic_uint    episode; // Flipped, that is incremented, by the last arrival.
+
+  /* Dissemination barrier, one per participant. */
+  barrier_participant_t *participants;
+
+  /* Parked waiters. */
+  CACHE_ALIGNED
+  atomic_int      sleepers;
+  pthread_mutex_t mutex;
+  pthread_cond_t  cond;
+} barrier_t;
+
+/* barrier_init(barrier, n, kind)
+
+   Initializes a barrier for n threads.
+*/
+void barrier_init(barrier_t *barrier, int n, barrier_kind_t kind);
+
+void barrier_destroy(barrier_t *barrier);
+
+/* barrier_wait(barrier, id)
+
+   Waits for all n participants to call barrier_wait(). Every participant
+   passes a distinct id between 0 and n - 1, the same one in every episode.
+*/
+void barrier_wait(barrier_t *barrier, int id);
+
+/* Name of the algorithm used by barrier, for benchmarks and diagnostics. */
+char *barrier_kind_name(barrier_t *barrier);
+
+#endif
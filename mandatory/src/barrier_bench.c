@@ -0,0 +1,128 @@
+/**
+ * Barrier benchmark.
+ *
+ * Measures how many lock-step episodes per second a group of threads can go
+ * through, comparing the central and dissemination barriers with each other
+ * and, for two threads, with the semaphore pair of rendezvous.c, where each
+ * thread signals the other's semaphore and waits on its own.
+ *
+ * Usage: barrier_bench [-t max threads] [-i episodes]
+ */
+
+#include <stdio.h>   // printf()
+#include <stdlib.h>  // exit(), atoi()
+#include <unistd.h>  // getopt()
+#include <pthread.h> // pthread_...
+
+#include "barrier.h"
+#include "psem.h"    // psem_init(), psem_wait(), psem_signal(), psem_destroy()
+#include "timing.h"  // timing_start(), timing_stop()
+
+#define MAX_THREADS 64
+
+int episodes = 100000;
+
+barrier_t barrier;
+psem_t *sem[2];
+
+typedef struct {
+  int id;
+  void *(*start_routine)(void *);
+} arg_t;
+
+void *barrier_thread(void *arg) {
+  int id = ((arg_t *) arg)->id;
+
+  for (int i = 0; i < episodes; i++) {
+    barrier_wait(&barrier, id);
+  }
+
+  return NULL;
+}
+
+/* Rendezvous of two threads with a semaphore pair. */
+void *semaphore_thread(void *arg) {
+  int id = ((arg_t *) arg)->id;
+
+  for (int i = 0; i < episodes; i++) {
+    psem_signal(sem[1 - id]);
+    psem_wait(sem[id]);
+  }
+
+  return NULL;
+}
+
+/* Runs n threads executing start_routine, returns episodes per second. */
+double run(int n, void *(*start_routine)(void *)) {
+  pthread_t tid[MAX_THREADS];
+  arg_t arg[MAX_THREADS];
+  struct timespec ts;
+
+  timing_start(&ts);
+
+  for (int i = 0; i < n; i++) {
+    arg[i].id = i;
+    if (pthread_create(&tid[i], NULL, start_routine, &arg[i]) != 0) {
+      perror("pthread_create()");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    pthread_join(tid[i], NULL);
+  }
+
+  return episodes / timing_stop(&ts);
+}
+
+double run_barrier(int n, barrier_kind_t kind) {
+  barrier_init(&barrier, n, kind);
+  double result = run(n, barrier_thread);
+  barrier_destroy(&barrier);
+  return result;
+}
+
+int main(int argc, char *argv[]) {
+  int max_threads = 16;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:i:")) != -1) {
+    switch (opt) {
+    case 't':
+      max_threads = atoi(optarg);
+      break;
+    case 'i':
+      episodes = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-t max threads] [-i episodes]\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (max_threads < 2 || max_threads > MAX_THREADS || episodes < 1) {
+    fprintf(stderr, "Between 2 and %d threads and at least one episode\n", MAX_THREADS);
+    exit(EXIT_FAILURE);
+  }
+
+  printf("%d episodes, episodes per second\n\n", episodes);
+  printf("%7s  %14s  %14s  %14s\n", "Threads", "Semaphores", "Central", "Dissemination");
+  printf("-------------------------------------------------------\n");
+
+  for (int n = 2; n <= max_threads; n *= 2) {
+    printf("%7d  ", n);
+
+    if (n == 2) {
+      sem[0] = psem_init(0);
+      sem[1] = psem_init(0);
+      printf("%14.4e  ", run(2, semaphore_thread));
+      psem_destroy(sem[0]);
+      psem_destroy(sem[1]);
+    } else {
+      printf("%14s  ", "-");
+    }
+
+    printf("%14.4e  ", run_barrier(n, BARRIER_CENTRAL));
+    printf("%14.4e\n", run_barrier(n, BARRIER_DISSEMINATION));
+  }
+}
@@ -0,0 +1,135 @@
+/**
+ * Unit test for the barriers.
+ */
+
+#include "barrier.h"
+
+#include <stdio.h>   // printf(), setbuf(), stdout
+#include <stdlib.h>  // exit(), EXIT_FAILURE
+#include <stdbool.h> // bool
+#include <unistd.h>  // usleep()
+#include <pthread.h> // pthread_..
+#include <assert.h>  // assert()
+
+#define TEST_HEADER printf("\n==== %s ====\n\n", __FUNCTION__)
+
+#define MAX_THREADS 16
+#define PHASES      1000
+
+void success() {
+  printf("\nTest SUCCESSFUL :-)\n\n");
+}
+
+barrier_t barrier;
+int nthreads;
+bool slow;
+
+/* The phase each thread has reached. */
+atomic_int phase[MAX_THREADS];
+
+void *participant(void *arg) {
+  int id = *(int *) arg;
+
+  for (int p = 1; p <= PHASES; p++) {
+    store_relaxed(&phase[id], p);
+
+    // Now and then be late, so that the others have to park.
+    if (slow && p % 250 == id) usleep(2000);
+
+    barrier_wait(&barrier, id);
+
+    // Everyone has reached phase p, and no one moves on to the next phase
+    // before everyone has checked.
+    for (int i = 0; i < nthreads; i++) {
+      assert(load_relaxed(&phase[i]) == p);
+    }
+
+    barrier_wait(&barrier, id);
+  }
+
+  return NULL;
+}
+
+void run(int n, barrier_kind_t kind) {
+  pthread_t tid[MAX_THREADS];
+  int id[MAX_THREADS];
+
+  nthreads = n;
+  barrier_init(&barrier, n, kind);
+
+  for (int i = 0; i < n; i++) {
+    id[i] = i;
+    store_relaxed(&phase[i], 0);
+  }
+
+  for (int i = 0; i < n; i++) {
+    if (pthread_create(&tid[i], NULL, participant, &id[i]) != 0) {
+      perror("pthread_create()");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    pthread_join(tid[i], NULL);
+  }
+
+  printf("%2d threads %s\n", n, barrier_kind_name(&barrier));
+
+  barrier_destroy(&barrier);
+}
+
+void auto_test() {
+  TEST_HEADER;
+
+  barrier_init(&barrier, BARRIER_CENTRAL_MAX, BARRIER_AUTO);
+  assert(barrier.kind == BARRIER_CENTRAL);
+  barrier_destroy(&barrier);
+
+  barrier_init(&barrier, BARRIER_CENTRAL_MAX + 1, BARRIER_AUTO);
+  assert(barrier.kind == BARRIER_DISSEMINATION);
+  assert(barrier.rounds == 4);
+  barrier_destroy(&barrier);
+
+  success();
+}
+
+void central_test() {
+  TEST_HEADER;
+
+  for (int n = 1; n <= 5; n++) run(n, BARRIER_CENTRAL);
+
+  success();
+}
+
+void dissemination_test() {
+  TEST_HEADER;
+
+  // Powers of two and in between.
+  int sizes[] = {1, 2, 3, 4, 7, 13, 16};
+
+  for (int i = 0; i < (int) (sizeof(sizes) / sizeof(sizes[0])); i++) {
+    run(sizes[i], BARRIER_DISSEMINATION);
+  }
+
+  success();
+}
+
+void park_test() {
+  TEST_HEADER;
+
+  slow = true;
+  run(4, BARRIER_CENTRAL);
+  run(5, BARRIER_DISSEMINATION);
+  slow = false;
+
+  success();
+}
+
+int main(void) {
+  setbuf(stdout, NULL);
+
+  auto_test();
+  central_test();
+  dissemination_test();
+  park_test();
+}
@@ -1,4 +1,7 @@
 #include "bounded_buffer.h"
+#include "buffer_core.h" // buffer_core_t, core_put_reserved(), core_get_reserved()
+#include "cache_line.h"  // CACHE_LINE
+#include "atomics.h"     // load_relaxed(), store_relaxed(), cpu_relax()
 
 #include <string.h>  // strncmp()
 #include <stdbool.h> // true, false
@@ -6,9 +9,15 @@
 #include <ctype.h>   // isprint()
 #include <stddef.h>  // NULL
 #include <stdio.h>   // printf(), fprintf()
-#include <stdlib.h>  // [s]rand()
+#include <stdlib.h>  // [s]rand(), posix_memalign()
 #include <unistd.h>  // usleep(), sleep()
 #include <pthread.h> // pthread_...
+#include <sched.h>   // sched_yield()
+
+/* Upper bound for the adaptive spin budget of BUFFER_SPIN_PARK and
+   BUFFER_SPIN_YIELD. */
+#define BUFFER_MAX_SPINS 4000
+
 /*
 
 An Arrow operator in C/C++ allows to access elements in Structures and Unions. 
@@ -24,24 +33,30 @@ The -> operator in C or C++ gives the value held by variable_name to structure o
 */
 
 void buffer_init(buffer_t *buffer, int size)
+{
+  buffer_init_wait(buffer, size, BUFFER_PARK);
+}
+
+void buffer_init_wait(buffer_t *buffer, int size, buffer_wait_t wait)
 {
 
-  // Allocate the buffer array.
-  tuple_t *array = malloc(size * sizeof(tuple_t));
+  // Allocate the buffer array, starting on a cache line of its own.
+  void *array;
 
-  if (array == NULL)
+  if (posix_memalign(&array, CACHE_LINE, size * sizeof(tuple_t)) != 0)
   {
     perror("Could not allocate buffer array");
     exit(EXIT_FAILURE);
   }
 
   buffer->array = array; // We create an array using malloc size * (sizeOf * tuple)
-  buffer->size = size;
-  buffer->in = 0; // where to produce the next data
-  buffer->out = 0; // where to consume the next data
-  buffer->mutex = psem_init(1);
-  buffer->data = psem_init(0); // Numbers of data in the buffer
-  buffer->empty = psem_init(size); // To check if the buffer is emptys
+  core_init(&buffer->state, size);
+  buffer->mutex = psem_init_named(1, "buffer mutex");
+  buffer->data = psem_init_named(0, "buffer data"); // Numbers of data in the buffer
+  buffer->empty = psem_init_named(size, "buffer empty"); // To check if the buffer is emptys
+  buffer->wait = wait;
+  buffer->max_spins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? BUFFER_MAX_SPINS : 0;
+  atomic_init(&buffer->spins, 0);
 }
 
 void buffer_destroy(buffer_t *buffer)
@@ -68,13 +83,14 @@ void buffer_print(buffer_t *buffer)
   puts("---- Bounded Buffer ----");
   puts("");
 
-  printf("size: %d\n", buffer->size);
-  printf("  in: %d\n", buffer->in);
-  printf(" out: %d\n", buffer->out);
+  printf("size: %d\n", buffer->state.size);
+  printf("  in: %d\n", buffer->state.in);
+  printf(" out: %d\n", buffer->state.out);
+  if (buffer->state.closed) puts("closed");
   puts("");
 
   // Just a for loop that prints the a and b element of all the tuples: (a,b)
-  for (int i = 0; i < buffer->size; i++)
+  for (int i = 0; i < buffer->state.size; i++)
   {
     printf("array[%d]: (%d, %d)\n", i, buffer->array[i].a, buffer->array[i].b);
   }
@@ -84,76 +100,169 @@ void buffer_print(buffer_t *buffer)
   puts("");
 }
 
-void buffer_put(buffer_t *buffer, int a, int b)
+/*
+Spins until a token can be taken from sem, giving up after the adaptive spin
+budget. As for the futex semaphores, every spin moves the estimate 1/8 of the
+way towards the number of iterations that were actually needed.
+
+Returns true if a token was taken.
+*/
+static bool spin(buffer_t *buffer, psem_t *sem)
+{
+  int spins = load_relaxed(&buffer->spins);
+  int max_spins = spins * 2 + 10;
+
+  if (max_spins > buffer->max_spins)
+    max_spins = buffer->max_spins;
+
+  for (int i = 0; i < max_spins; i++)
+  {
+    cpu_relax();
+
+    if (psem_trywait(sem))
+    {
+      store_relaxed(&buffer->spins, spins + (i - spins) / 8);
+      return true;
+    }
+  }
+
+  store_relaxed(&buffer->spins, spins + (max_spins - spins) / 8);
+  return false;
+}
+
+/*
+Takes a token from sem, one of the semaphores of buffer, waiting as set by the
+wait policy of the buffer.
+*/
+static void wait_token(buffer_t *buffer, psem_t *sem)
+{
+  switch (buffer->wait)
+  {
+  case BUFFER_PARK:
+    psem_wait(sem);
+    return;
+
+  case BUFFER_SPIN:
+    while (!psem_trywait(sem))
+      cpu_relax();
+    return;
+
+  case BUFFER_SPIN_PARK:
+    if (!psem_trywait(sem) && !spin(buffer, sem))
+      psem_wait(sem);
+    return;
+
+  case BUFFER_SPIN_YIELD:
+    if (!psem_trywait(sem) && !spin(buffer, sem))
+      while (!psem_trywait(sem))
+        sched_yield();
+    return;
+  }
+}
+
+/*
+The array and semaphores of buffer, for the algorithm in buffer_core.h.
+*/
+static buffer_core_t core(buffer_t *buffer)
 {
+  return (buffer_core_t){&buffer->state, buffer->array, buffer->mutex, buffer->data, buffer->empty};
+}
+
+bool buffer_put(buffer_t *buffer, int a, int b)
+{
+  tuple_t tuple = {.a = a, .b = b};
+
   /*
   Performs a wait() as the producer to check if the buffer is full 
   empty is init as the size of the buffer so each time something is added 
   it is first checked to be >= 0 and otherwise decremented by using wait()
   */
-  psem_wait(buffer->empty); 
+  wait_token(buffer, buffer->empty);
 
-  /*
-  Use a mutex to protect access to the critial section when something reads/writes to the buffer
-  */
-  psem_wait(buffer->mutex);
-
-  // Insert the tuple (a, b) into the buffer.
-  buffer->array[buffer->in].a = a;
-  buffer->array[buffer->in].b = b;
+  return core_put_reserved(core(buffer), &tuple, 1) == 1;
+}
 
-  /* 
-  add one (with wrap arpund in mind) to in which keeps track of where to produce the next data item using index
-  Wrap around uses modulu to write to the first index after previously written to the last
-  */
-  buffer->in = (buffer->in + 1) % buffer->size;
+bool buffer_try_put(buffer_t *buffer, int a, int b)
+{
+  tuple_t tuple = {.a = a, .b = b};
 
-  /*
-  Releases the lock
-  */
-  psem_signal(buffer->mutex);
+  if (!psem_trywait(buffer->empty))
+    return false;
 
-  /*
-  Use signal to increment the semaphore data which keeps tracks of numbers of data in the buffer
-  */
-  psem_signal(buffer->data);
+  return core_put_reserved(core(buffer), &tuple, 1) == 1;
 }
 
-void buffer_get(buffer_t *buffer, tuple_t *tuple)
+bool buffer_get(buffer_t *buffer, tuple_t *tuple)
 {
   /* 
   Use wait on data to see that it is >0 (otherwise it waits)
   and then decrement it since we have consumed one data from the buffer
   */
-  psem_wait(buffer->data);
+  wait_token(buffer, buffer->data);
 
-  /*
-  Creates a lock to protect access to the critial section
-  */
-  psem_wait(buffer->mutex); 
+  return core_get_reserved(core(buffer), tuple, 1) == 1;
+}
 
-  // Read the tuple (a, b) from the buffer.
-  tuple->a = buffer->array[buffer->out].a;
-  tuple->b = buffer->array[buffer->out].b;
+bool buffer_try_get(buffer_t *buffer, tuple_t *tuple)
+{
+  if (!psem_trywait(buffer->data))
+    return false;
 
+  return core_get_reserved(core(buffer), tuple, 1) == 1;
+}
 
-  /*
-  Updates out which keeps track of where to consume the next data item using index
-  Use wrap around by using modulo with the size to start over on the first index after having consumed the last
-  */
-  buffer->out = (buffer->out + 1) % buffer->size;
+bool buffer_get_timeout(buffer_t *buffer, tuple_t *tuple, long long timeout_ns)
+{
+  if (!psem_timedwait(buffer->data, timeout_ns))
+    return false;
 
-  /*
-  Releases the lock after leaving the critial section
-  */
-  psem_signal(buffer->mutex);
+  return core_get_reserved(core(buffer), tuple, 1) == 1;
+}
+
+int buffer_put_n(buffer_t *buffer, const tuple_t *src, int n)
+{
+  int done = 0;
+
+  while (done < n)
+  {
+    /*
+    Block for the first free slot, then grab every other free slot we need
+    without blocking, in one go. Each token taken from empty is one reserved
+    slot.
+    */
+    wait_token(buffer, buffer->empty);
+
+    int reserved = 1 + psem_trywait_n(buffer->empty, n - done - 1);
+
+    if (core_put_reserved(core(buffer), src + done, reserved) == 0)
+      break;
+
+    done += reserved;
+  }
+
+  return done;
+}
+
+int buffer_get_n(buffer_t *buffer, tuple_t *dst, int max)
+{
+  if (max < 1)
+    return 0;
 
   /*
-  Signals the empty to increment it since we just consumed one element and now have one more empty data
+  Same idea as in buffer_put_n(), each token taken from data is one tuple that
+  is ours to consume.
   */
-  psem_signal(buffer->empty);
+  wait_token(buffer, buffer->data);
+
+  int reserved = 1 + psem_trywait_n(buffer->data, max - 1);
+
+  return core_get_reserved(core(buffer), dst, reserved);
 }
 
+void buffer_close(buffer_t *buffer)
+{
+  core_close(core(buffer));
+}
 
 
 /*** 
@@ -1,23 +1,147 @@
+#ifndef BOUNDED_BUFFER_H
+#define BOUNDED_BUFFER_H
+
 #include "psem.h" // init_sem(), wait_sem(), signal_sem(), destroy_sem()
 
+#include <stdbool.h>   // bool
+#include <stdatomic.h> // atomic_int
+
 typedef struct {
   int a;
   int b;
 } tuple_t;
 
+/* How a producer waits for a free slot, and a consumer for a tuple, when
+   there is none. Set per buffer by buffer_init_wait().
+
+   BUFFER_PARK        Blocks on the semaphore right away. Costs no CPU time
+                      while waiting, but a sleep and a wakeup when the wait is
+                      short. The default, for batch consumers.
+
+   BUFFER_SPIN_PARK   Spins with cpu_relax() for a budget that adapts to how
+                      long waits on the buffer have recently taken, then
+                      blocks.
+
+   BUFFER_SPIN_YIELD  Spins for the same budget, then gives the CPU to other
+                      threads with sched_yield() between attempts. Never
+                      blocks.
+
+   BUFFER_SPIN        Busy-spins until the wait is over, burning a CPU for the
+                      lowest latency. Only sensible with a CPU per waiting
+                      thread.
+
+   With a single CPU there is nobody to spin for, so BUFFER_SPIN_PARK and
+   BUFFER_SPIN_YIELD skip spinning.
+*/
+typedef enum {BUFFER_PARK, BUFFER_SPIN_PARK, BUFFER_SPIN_YIELD, BUFFER_SPIN} buffer_wait_t;
+
+/* The ring indices of a bounded buffer. Holds no pointers, so that the buffer
+   of shm_buffer.h can keep it in shared memory. */
+typedef struct {
+  int  size;
+  int  in;
+  int  out;
+  int  count;  // Number of tuples in the buffer.
+  bool closed; // Set by buffer_close().
+} buffer_state_t;
+
 typedef struct {
   tuple_t *array;
-  int     size;
-  int     in;
-  int     out;
+  buffer_state_t state;
   psem_t  *mutex;
   psem_t  *data;
   psem_t  *empty;
+  buffer_wait_t wait;
+  int           max_spins; // Upper bound for spins, 0 with a single CPU.
+  atomic_int    spins;     // Running estimate of how long to spin.
 } buffer_t;
 
 
 void buffer_print(buffer_t *buffer);
+
+/* Initializes buffer with room for size tuples and the BUFFER_PARK wait
+   policy. */
 void buffer_init(buffer_t *buffer, int size);
+
+/* Same as buffer_init() with the wait policy wait. */
+void buffer_init_wait(buffer_t *buffer, int size, buffer_wait_t wait);
+
 void buffer_destroy(buffer_t *buffer);
-void buffer_put(buffer_t *buffer, int a, int b);
-void buffer_get(buffer_t *buffer, tuple_t *tuple);
+
+/* buffer_put(buffer, a, b)
+
+   Inserts the tuple (a, b), blocking while the buffer is full.
+
+   Return value
+
+   true on success, false if the buffer has been closed.
+*/
+bool buffer_put(buffer_t *buffer, int a, int b);
+
+/* buffer_get(buffer, tuple)
+
+   Removes the oldest tuple, blocking while the buffer is empty. A closed buffer
+   can still be drained of the tuples inserted before it was closed.
+
+   Return value
+
+   true on success, false if the buffer is closed and empty.
+*/
+bool buffer_get(buffer_t *buffer, tuple_t *tuple);
+
+/* buffer_try_put(buffer, a, b)
+
+   Same as buffer_put() but returns false instead of blocking if the buffer is
+   full.
+*/
+bool buffer_try_put(buffer_t *buffer, int a, int b);
+
+/* buffer_try_get(buffer, tuple)
+
+   Same as buffer_get() but returns false instead of blocking if the buffer is
+   empty.
+*/
+bool buffer_try_get(buffer_t *buffer, tuple_t *tuple);
+
+/* buffer_get_timeout(buffer, tuple, timeout_ns)
+
+   Same as buffer_get() but gives up and returns false if no tuple has arrived
+   within timeout_ns nanoseconds. Always blocks on the semaphore, whatever the
+   wait policy.
+*/
+bool buffer_get_timeout(buffer_t *buffer, tuple_t *tuple, long long timeout_ns);
+
+/* buffer_close(buffer)
+
+   Closes the buffer and wakes up every blocked producer and consumer. Once
+   closed, all puts fail, and gets fail as soon as the buffer is empty.
+*/
+void buffer_close(buffer_t *buffer);
+
+/* buffer_put_n(buffer, src, n)
+
+   Inserts the n tuples in src, in order. As many free slots as possible are
+   reserved at once and filled under a single critical section, so the mutex is
+   taken once per run of free slots instead of once per tuple. Blocks until all
+   n tuples have been inserted.
+
+   Return value
+
+   The number of tuples inserted, which is less than n only if the buffer was
+   closed.
+*/
+int buffer_put_n(buffer_t *buffer, const tuple_t *src, int n);
+
+/* buffer_get_n(buffer, dst, max)
+
+   Blocks until at least one tuple is available and then removes as many
+   tuples as are available, but no more than max, under a single critical
+   section.
+
+   Return value
+
+   The number of tuples copied to dst, 0 if the buffer is closed and empty.
+*/
+int buffer_get_n(buffer_t *buffer, tuple_t *dst, int max);
+
+#endif
@@ -1,19 +1,89 @@
 #include "bounded_buffer.h"
+#include "ring_buffer.h"
 
-#include <string.h>  // strncmp()
+#include <string.h>  // strncmp(), strcmp()
 #include <stdbool.h> // true, false
 #include <assert.h>  // assert()
 #include <ctype.h>   // isprint()
 #include <stddef.h>  // NULL
 #include <stdio.h>   // printf(), fprintf()
 #include <stdlib.h>  // [s]rand()
+#include <stdint.h>  // uint64_t
+#include <inttypes.h> // PRIu64
 #include <unistd.h>  // usleep(), sleep()
 #include <pthread.h> // pthread_...
+#include <sys/resource.h> // getrusage()
+
+#include "timing.h"    // timing_start(), timing_stop(), timing_ticks()
+#include "histogram.h" // histogram_t
+#include "affinity.h"  // affinity_t, affinity_pin(), affinity_alloc()
+
+/* The buffer implementations that can be stress tested. */
+typedef enum {SEMAPHORE, SPSC, MPMC} impl_t;
+
+/* A buffer under test together with the implementation to use. */
+typedef struct {
+  impl_t   impl;
+  buffer_t buffer;
+  ring_t   ring;
+} test_buffer_t;
+
+void test_buffer_put(test_buffer_t *tb, int a, int b) {
+  if (tb->impl == SEMAPHORE) {
+    buffer_put(&tb->buffer, a, b);
+  } else {
+    tuple_t tuple = {.a = a, .b = b};
+    ring_put(&tb->ring, &tuple);
+  }
+}
+
+void test_buffer_get(test_buffer_t *tb, tuple_t *tuple) {
+  if (tb->impl == SEMAPHORE) {
+    buffer_get(&tb->buffer, tuple);
+  } else {
+    ring_get(&tb->ring, tuple);
+  }
+}
+
+void print_tuple(const void *elem) {
+  const tuple_t *tuple = elem;
+  printf("(%d, %d)", tuple->a, tuple->b);
+}
+
+char *impl2string(impl_t impl) {
+  switch (impl) {
+  case SEMAPHORE:
+    return "semaphore";
+  case SPSC:
+    return "spsc";
+  case MPMC:
+    return "mpmc";
+  default:
+    return "???";
+  }
+}
+
+/* Wait policy of the semaphore buffer, set with -w. */
+buffer_wait_t wait_policy = BUFFER_PARK;
+
+char *wait_names[] = {"park", "spin-park", "spin-yield", "spin"};
+
+/* Placement of the threads, set with -a. Producer i is thread i, consumer i
+   thread num_producers + i. */
+affinity_t affinity;
+
+/* Benchmark mode, set with -b. No sleeps, every put and get is timed. */
+bool benchmark = false;
+
+/* Check that the items from each producer arrive in order. Always done when
+   testing, only with -V in benchmark mode. */
+bool verify = true;
 
 typedef struct {
   int id;
   int n;
-  buffer_t *buffer;
+  test_buffer_t *buffer;
+  histogram_t *latency;
 } producer_arg_t;
 
 typedef struct {
@@ -24,9 +94,10 @@ typedef struct {
 typedef struct {
   int id;
   int n;
-  buffer_t *buffer;
+  test_buffer_t *buffer;
   int num_producers;
   int *tuple_counters;
+  histogram_t *latency;
 } consumer_arg_t;
 
 bool verbose = false;
@@ -34,10 +105,25 @@ bool verbose = false;
 void *producer(void *arg) {
   producer_arg_t *a = (producer_arg_t *) arg;
 
+  affinity_pin(&affinity, a->id);
+
+  if (benchmark) {
+    // First touched here, so allocated on the node of the thread.
+    histogram_init(a->latency);
+
+    for (int i = 0; i < a->n; i++) {
+      uint64_t start = timing_ticks();
+      test_buffer_put(a->buffer, a->id, i);
+      histogram_record(a->latency, timing_ticks_to_ns(timing_ticks() - start));
+    }
+
+    pthread_exit(0);
+  }
+
   for (int i = 0; i < a -> n; i++) {
     if (verbose) printf("P%03d (%d, %d)\n", a->id, a->id, i);
     usleep(100);
-    buffer_put(a -> buffer, a->id, i);
+    test_buffer_put(a -> buffer, a->id, i);
   }
 
   pthread_exit(0);
@@ -47,6 +133,9 @@ void *consumer(void *arg) {
 
   consumer_arg_t *a = (consumer_arg_t *) arg;
 
+  affinity_pin(&affinity, a->num_producers + a->id);
+  if (benchmark) histogram_init(a->latency);
+
   stat_t *stats = malloc(a->num_producers*sizeof(stat_t));
 
   for (int i = 0; i < a->num_producers; i++) {
@@ -57,12 +146,20 @@ void *consumer(void *arg) {
   tuple_t tuple;
 
   for (int i = 0; i < a->n; i++) {
-    usleep(100);
-    buffer_get(a->buffer, &tuple);
+    if (benchmark) {
+      uint64_t start = timing_ticks();
+      test_buffer_get(a->buffer, &tuple);
+      histogram_record(a->latency, timing_ticks_to_ns(timing_ticks() - start));
+    } else {
+      usleep(100);
+      test_buffer_get(a->buffer, &tuple);
+    }
 
     if (verbose) printf("C%03d (%d, %d)\n", a->id, tuple.a, tuple.b);
 
-    if (stats[tuple.a].last_value < tuple.b) {
+    if (!verify) {
+      stats[0].n++;
+    } else if (stats[tuple.a].last_value < tuple.b) {
       stats[tuple.a].n = stats[tuple.a].n + 1;
       stats[tuple.a].last_value = tuple.b;
 
@@ -85,15 +182,28 @@ void *consumer(void *arg) {
   }
 
   assert(tuple_count == a->n);
+  free(stats);
   pthread_exit(0);
 }
 
 
-void test(int buffer_size, int num_producers, int n, int num_consumers, int m){
+/* Put and get latencies of a test run. */
+typedef struct {
+  histogram_t put;
+  histogram_t get;
+} latency_t;
+
+void test(impl_t impl, int buffer_size, int num_producers, int n, int num_consumers, int m,
+          latency_t *latency){
   pthread_t *producers, *consumers;
 
-  buffer_t buffer;
-  buffer_init(&buffer, buffer_size);
+  test_buffer_t buffer = {.impl = impl};
+
+  if (impl == SEMAPHORE) {
+    buffer_init_wait(&buffer.buffer, buffer_size, wait_policy);
+  } else {
+    ring_init(&buffer.ring, buffer_size, sizeof(tuple_t), impl == SPSC ? RING_SPSC : RING_MPMC);
+  }
 
 
   producers = malloc(num_producers * sizeof(pthread_t));
@@ -118,6 +228,7 @@ void test(int buffer_size, int num_producers, int n, int num_consumers, int m){
     arg[i].id = i;
     arg[i].n    = n;
     arg[i].buffer = &buffer;
+    arg[i].latency = benchmark ? affinity_alloc(sizeof(histogram_t)) : NULL;
 
     if (pthread_create(&producers[i], NULL, producer, &arg[i]) != 0) {
       perror("pthread_create()");
@@ -129,10 +240,11 @@ void test(int buffer_size, int num_producers, int n, int num_consumers, int m){
 
   for (int i = 0; i < num_consumers; i++) {
     carg[i].id = i;
-    carg[i].n  = m;
+    carg[i].n  = m < 0 ? num_producers * n / num_consumers + (i < num_producers * n % num_consumers) : m;
     carg[i].buffer = &buffer;
     carg[i].num_producers = num_producers;
     carg[i].tuple_counters = tuple_counters;
+    carg[i].latency = benchmark ? affinity_alloc(sizeof(histogram_t)) : NULL;
 
     if (pthread_create(&consumers[i], NULL, consumer, &carg[i]) != 0) {
       perror("pthread_create()");
@@ -147,6 +259,8 @@ void test(int buffer_size, int num_producers, int n, int num_consumers, int m){
     perror("couldn't join with  thread");
     exit(EXIT_FAILURE);
     }
+    if (latency) histogram_merge(&latency->put, arg[i].latency);
+    affinity_free(arg[i].latency, sizeof(histogram_t));
   }
 
   for (int i = 0; i < num_consumers; i++) {
@@ -154,21 +268,182 @@ void test(int buffer_size, int num_producers, int n, int num_consumers, int m){
       perror("couldn't join with  thread");
       exit(EXIT_FAILURE);
     }
-
+    if (latency) histogram_merge(&latency->get, carg[i].latency);
+    affinity_free(carg[i].latency, sizeof(histogram_t));
   }
 
+  if (m < 0) m = num_producers * n / num_consumers;
+
+  free(producers);
+  free(consumers);
+  free(tuple_counters);
+
+  if (benchmark) {
+    if (impl == SEMAPHORE) {
+      assert(buffer.buffer.state.in == buffer.buffer.state.out);
+      buffer_destroy(&buffer.buffer);
+    } else {
+      assert((size_t) num_producers*n == buffer.ring.tail);
+      assert(buffer.ring.head == buffer.ring.tail);
+      ring_destroy(&buffer.ring);
+    }
+    return;
+  }
 
-  assert(num_producers*n % buffer.size == buffer.in);
-  assert(num_consumers*m % buffer.size == buffer.out);
-  assert(buffer.in == buffer.out);
 
   printf("\nThe buffer when the test ends.\n");
 
-  buffer_print(&buffer);
+  if (impl == SEMAPHORE) {
+    assert(num_producers*n % buffer.buffer.state.size == buffer.buffer.state.in);
+    assert(num_consumers*m % buffer.buffer.state.size == buffer.buffer.state.out);
+    assert(buffer.buffer.state.in == buffer.buffer.state.out);
+
+    buffer_print(&buffer.buffer);
+  } else {
+    assert((size_t) num_producers*n == buffer.ring.tail);
+    assert((size_t) num_consumers*m == buffer.ring.head);
+
+    ring_print(&buffer.ring, print_tuple);
+  }
 
   puts("\n====> TEST SUCCESS <====\n");
 }
 
+/*******************************************************************************
+                                 Benchmark mode
+*******************************************************************************/
+
+/* Buffer sizes and producer/consumer counts swept by the benchmark unless -s,
+   -p or -c is given. */
+int bench_sizes[] = {1, 16, 256, 4096};
+int bench_ratios[][2] = {{1, 1}, {1, 4}, {4, 1}, {4, 4}};
+
+#define LENGTH(array) ((int) (sizeof(array) / sizeof(array[0])))
+
+bool csv = false;
+
+void bench_header() {
+  if (csv) {
+    printf("impl,wait,size,producers,consumers,nodes,items,items_per_sec,cpu,"
+           "put_p50,put_p99,put_p999,get_p50,get_p99,get_p999\n");
+  } else {
+    printf("%-9s  %-10s  %5s  %3s  %3s  %5s  %14s  %5s  %27s  %27s\n", "", "", "", "", "", "", "",
+           "", "put latency (ns)", "get latency (ns)");
+    printf("%-9s  %-10s  %5s  %3s  %3s  %5s  %14s  %5s  %8s %8s %9s  %8s %8s %9s\n", "impl",
+           "wait", "size", "P", "C", "nodes", "items/s", "cpu", "p50", "p99", "p999", "p50",
+           "p99", "p999");
+    printf("-----------------------------------------------------------------------------------------------------------------------------\n");
+  }
+}
+
+/* User and system CPU time used by the process so far, in seconds. */
+double cpu_time() {
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    perror("getrusage()");
+    exit(EXIT_FAILURE);
+  }
+
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1E6;
+}
+
+/* Runs the benchmark for one configuration, each producer producing n items
+   and the consumers sharing them evenly. The cpu column is the CPU time used
+   per second of run time, in CPUs, which shows what spinning costs. */
+void bench(impl_t impl, int size, int p, int n, int c) {
+  static latency_t latency;
+  struct timespec ts;
+
+  histogram_init(&latency.put);
+  histogram_init(&latency.get);
+
+  double cpu = cpu_time();
+  timing_start(&ts);
+  test(impl, size, p, n, c, -1, &latency);
+  double run_time = timing_stop(&ts);
+  cpu = (cpu_time() - cpu) / run_time;
+
+  long items = (long) p * n;
+  double throughput = items / run_time;
+  histogram_t *put = &latency.put, *get = &latency.get;
+  char *wait = impl == SEMAPHORE ? wait_names[wait_policy] : "-";
+  int nodes = affinity_nodes(&affinity, p + c);
+
+  if (csv) {
+    printf("%s,%s,%d,%d,%d,%d,%ld,%.6e,%.2f,%" PRIu64 ",%" PRIu64 ",%" PRIu64
+           ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n", impl2string(impl), wait,
+           size, p, c, nodes, items, throughput, cpu,
+           histogram_percentile(put, 0.5), histogram_percentile(put, 0.99),
+           histogram_percentile(put, 0.999), histogram_percentile(get, 0.5),
+           histogram_percentile(get, 0.99), histogram_percentile(get, 0.999));
+  } else {
+    printf("%-9s  %-10s  %5d  %3d  %3d  %5d  %14.4e  %5.2f  %8" PRIu64 " %8" PRIu64 " %9" PRIu64
+           "  %8" PRIu64 " %8" PRIu64 " %9" PRIu64 "\n",
+           impl2string(impl), wait, size, p, c, nodes, throughput, cpu,
+           histogram_percentile(put, 0.5), histogram_percentile(put, 0.99),
+           histogram_percentile(put, 0.999), histogram_percentile(get, 0.5),
+           histogram_percentile(get, 0.99), histogram_percentile(get, 0.999));
+  }
+  fflush(stdout);
+}
+
+/* Prints the row of a configuration that was not run, and why. CSV output
+   leaves it out. */
+void bench_skipped(impl_t impl, int size, int p, int c, char *reason) {
+  if (csv) return;
+
+  printf("%-9s  %-10s  %5d  %3d  %3d  %s\n", impl2string(impl),
+         impl == SEMAPHORE ? wait_names[wait_policy] : "-", size, p, c, reason);
+  fflush(stdout);
+}
+
+/* Sweeps buffer sizes and producer/consumer counts. A size, producer or
+   consumer count of 0 means sweep, impls is a bit set of the implementations
+   to run and waits a bit set of the wait policies of the semaphore buffer.
+
+   A BUFFER_SPIN waiter never gives up its CPU, so with more threads than
+   CPUs it starves the very thread it waits for. Such configurations are
+   skipped. */
+void bench_sweep(int impls, int waits, int size, int p, int n, int c) {
+  long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  bench_header();
+
+  for (impl_t impl = SEMAPHORE; impl <= MPMC; impl++) {
+    if (!(impls & 1 << impl)) continue;
+
+    for (buffer_wait_t wait = BUFFER_PARK; wait <= BUFFER_SPIN; wait++) {
+      // The rings have a wait policy of their own, run them once.
+      if (impl != SEMAPHORE && wait > BUFFER_PARK) break;
+      if (impl == SEMAPHORE && !(waits & 1 << wait)) continue;
+
+      wait_policy = wait;
+
+      for (int r = 0; r < LENGTH(bench_ratios); r++) {
+        int np = p ? p : bench_ratios[r][0];
+        int nc = c ? c : bench_ratios[r][1];
+
+        // Only the first ratio if both counts are given.
+        if (p && c && r > 0) break;
+        if (impl == SPSC && (np != 1 || nc != 1)) continue;
+
+        for (int i = 0; i < LENGTH(bench_sizes); i++) {
+          if (size && i > 0) break;
+
+          if (impl == SEMAPHORE && wait == BUFFER_SPIN && np + nc > ncpus) {
+            bench_skipped(impl, size ? size : bench_sizes[i], np, nc,
+                          "skipped, more threads than CPUs");
+            continue;
+          }
+          bench(impl, size ? size : bench_sizes[i], np, n, nc);
+        }
+      }
+    }
+  }
+}
+
 int optvalue(char opt, char *optarg, int default_value) {
   int tmp = atoi(optarg);
 
@@ -194,27 +469,72 @@ int num_of_digits(int num) {
 int main(int argc, char *argv[]) {
 
   int s = 10, p = 20, n = 10000, c = 20, m = 10000;
+  impl_t impl = SEMAPHORE;
+  bool s_set = false, p_set = false, c_set = false, n_set = false, impl_set = false;
+  bool verify_set = false, wait_set = false;
+  char *placement = "none", description[256];
 
   int opt;
 
-  while((opt = getopt(argc, argv, ":s:p:n:c:m:v")) != -1)
+  while((opt = getopt(argc, argv, ":s:p:n:c:m:i:w:a:vbVo:")) != -1)
     {
       switch(opt)
         {
         case 'v':
           verbose = true;
           break;
+        case 'b':
+          benchmark = true;
+          break;
+        case 'V':
+          verify_set = true;
+          break;
+        case 'o':
+          if (strcmp(optarg, "csv") == 0) {
+            csv = true;
+          } else if (strcmp(optarg, "text") != 0) {
+            printf("Option -o: invalid value %s, will use text.\n", optarg);
+          }
+          break;
+        case 'i':
+          if (strcmp(optarg, "semaphore") == 0) {
+            impl = SEMAPHORE;
+          } else if (strcmp(optarg, "spsc") == 0) {
+            impl = SPSC;
+          } else if (strcmp(optarg, "mpmc") == 0) {
+            impl = MPMC;
+          } else {
+            printf("Option -i: invalid value %s, will use %s.\n", optarg, impl2string(impl));
+          }
+          impl_set = true;
+          break;
+        case 'w':
+          wait_set = true;
+          for (wait_policy = BUFFER_SPIN; wait_policy > BUFFER_PARK; wait_policy--) {
+            if (strcmp(optarg, wait_names[wait_policy]) == 0) break;
+          }
+          if (strcmp(optarg, wait_names[wait_policy]) != 0) {
+            printf("Option -w: invalid value %s, will use %s.\n", optarg, wait_names[wait_policy]);
+          }
+          break;
+        case 'a':
+          placement = optarg;
+          break;
         case 's':
           s = optvalue(opt, optarg, s);
+          s_set = true;
           break;
         case 'p':
           p = optvalue(opt, optarg, p);
+          p_set = true;
           break;
         case 'n':
           n = optvalue(opt, optarg, n);
+          n_set = true;
           break;
         case 'c':
           c = optvalue(opt, optarg, c);
+          c_set = true;
           break;
         case 'm':
           m = optvalue(opt, optarg, m);
@@ -228,6 +548,34 @@ int main(int argc, char *argv[]) {
         }
     }
 
+  if (!affinity_init(&affinity, placement)) {
+    printf("Option -a: invalid value %s, will use none.\n", placement);
+    affinity_init(&affinity, "none");
+  }
+
+  if (benchmark) {
+    // The sequence check is off unless asked for. Every producer produces n
+    // items, the consumers share them.
+    verify = verify_set;
+
+    timing_calibrate();
+
+    printf("Benchmark, %d items per producer, sequence check %s, %.2f GHz cycle counter, ",
+           n_set ? n : 10000, verify ? "on" : "off", timing_ticks_per_ns());
+#ifdef NO_CACHE_PADDING
+    printf("packed layout\n");
+#else
+    printf("padded to %d byte cache lines\n", CACHE_LINE);
+#endif
+    affinity_describe(&affinity, affinity.ncpus, description, sizeof(description));
+    printf("Placement: %s\n\n", description);
+
+    // BUFFER_SPIN only when asked for, it needs a CPU per thread.
+    bench_sweep(impl_set ? 1 << impl : 1 << SEMAPHORE | 1 << SPSC | 1 << MPMC,
+                wait_set ? 1 << wait_policy : ~(1 << BUFFER_SPIN), s_set ? s : 0, p_set ? p : 0, n_set ? n : 10000, c_set ? c : 0);
+    exit(EXIT_SUCCESS);
+  }
+
   int wp = num_of_digits(p);
   int wc = num_of_digits(c);
 
@@ -237,7 +585,12 @@ int main(int argc, char *argv[]) {
   int w1 = (wp > wc) ? wp : wc;
   int w2 = (wn > wm) ? wn : wm;
 
-  printf("Test buffer of size %d with: \n\n", s);
+  if (impl == SPSC && (p != 1 || c != 1)) {
+    printf("The spsc buffer requires exactly one producer and one consumer (-p 1 -c 1).\n");
+    exit(EXIT_FAILURE);
+  }
+
+  printf("Test %s buffer of size %d with: \n\n", impl2string(impl), s);
   printf(" %*d producers, each producing %*d items.\n", w1, p, w2, n);
   printf(" %*d consumers, each consuming %*d items.\n", w1, c, w2, m);
 
@@ -247,7 +600,21 @@ int main(int argc, char *argv[]) {
   }
 
   printf("\nVerbose: %s\n", verbose ? "true" : "false");
+  printf("Wait:    %s\n", impl == SEMAPHORE ? wait_names[wait_policy] : "-");
+
+#ifdef NO_CACHE_PADDING
+  printf("Layout:  packed\n");
+#else
+  printf("Layout:  padded to %d byte cache lines\n", CACHE_LINE);
+#endif
+  affinity_describe(&affinity, p + c, description, sizeof(description));
+  printf("Threads: %s\n", description);
+
+  struct timespec ts;
+  timing_start(&ts);
+
+  test(impl, s, p, n, c, m, NULL);
 
-  test(s, p, n, c, m);
+  printf("Run time: %.4f sec\n", timing_stop(&ts));
 
 }
@@ -29,7 +29,7 @@ void init_test() {
 
   buffer_init(&buffer, 10);
 
-  assert(buffer.size == 10);
+  assert(buffer.state.size == 10);
   assert(buffer.array != NULL);
   assert(buffer.mutex != NULL);
   assert(buffer.data  != NULL);
@@ -134,6 +134,215 @@ void get_test() {
   success();
 }
 
+void batch_test() {
+  TEST_HEADER;
+
+  buffer_t buffer;
+  tuple_t src[4] = {{1, 111}, {2, 222}, {3, 333}, {4, 444}};
+  tuple_t dst[4];
+
+  buffer_init(&buffer, 5);
+
+  // Move in past the middle so the next batch has to wrap around.
+  buffer_put_n(&buffer, src, 3);
+  int n = buffer_get_n(&buffer, dst, 4);
+  assert(n == 3);
+  assert(dst[0].a == 1 && dst[1].a == 2 && dst[2].a == 3);
+
+  buffer_put_n(&buffer, src, 4);
+  buffer_print(&buffer);
+
+  assert(buffer.state.in == 2);
+  assert(buffer.array[3].a == 1 && buffer.array[4].a == 2);
+  assert(buffer.array[0].a == 3 && buffer.array[1].a == 4);
+
+  n = buffer_get_n(&buffer, dst, 2);
+  assert(n == 2);
+  assert(dst[0].a == 1 && dst[0].b == 111);
+  assert(dst[1].a == 2 && dst[1].b == 222);
+
+  n = buffer_get_n(&buffer, dst, 4);
+  assert(n == 2);
+  assert(dst[0].a == 3 && dst[0].b == 333);
+  assert(dst[1].a == 4 && dst[1].b == 444);
+
+  assert(buffer.state.in == buffer.state.out);
+
+  buffer_destroy(&buffer);
+
+  success();
+}
+
+void try_test() {
+  TEST_HEADER;
+
+  buffer_t buffer;
+  tuple_t tuple;
+  bool ok;
+
+  buffer_init(&buffer, 2);
+
+  ok = buffer_try_get(&buffer, &tuple);
+  assert(!ok);
+
+  ok = buffer_try_put(&buffer, 1, 111);
+  assert(ok);
+  ok = buffer_try_put(&buffer, 2, 222);
+  assert(ok);
+  ok = buffer_try_put(&buffer, 3, 333);
+  assert(!ok);
+
+  ok = buffer_try_get(&buffer, &tuple);
+  assert(ok);
+  assert(tuple.a == 1 && tuple.b == 111);
+
+  ok = buffer_get_timeout(&buffer, &tuple, 1000000);
+  assert(ok);
+  assert(tuple.a == 2 && tuple.b == 222);
+
+  // 50 ms timeout on an empty buffer.
+  ok = buffer_get_timeout(&buffer, &tuple, 50000000);
+  assert(!ok);
+
+  buffer_destroy(&buffer);
+
+  success();
+}
+
+void *blocked_consumer(void *arg) {
+  buffer_t *buffer = (buffer_t*) arg;
+  tuple_t tuple;
+
+  // The buffer is empty, blocks until the buffer is closed.
+  bool ok = buffer_get(buffer, &tuple);
+  assert(!ok);
+
+  pthread_exit(NULL);
+}
+
+void *blocked_producer(void *arg) {
+  buffer_t *buffer = (buffer_t*) arg;
+
+  // The buffer is full, blocks until the buffer is closed.
+  bool ok = buffer_put(buffer, 9, 999);
+  assert(!ok);
+
+  pthread_exit(NULL);
+}
+
+void close_test() {
+  TEST_HEADER;
+
+  pthread_t consumers[3], producers[3];
+  buffer_t empty, full;
+
+  buffer_init(&empty, 3);
+  buffer_init(&full, 1);
+
+  buffer_put(&full, 1, 111);
+
+  for (int i = 0; i < 3; i++) {
+    if (pthread_create(&consumers[i], NULL, blocked_consumer, &empty) != 0 ||
+        pthread_create(&producers[i], NULL, blocked_producer, &full) != 0) {
+      perror("pthread_create()");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // Give the threads time to block.
+  usleep(100000);
+
+  buffer_close(&empty);
+  buffer_close(&full);
+
+  for (int i = 0; i < 3; i++) {
+    pthread_join(consumers[i], NULL);
+    pthread_join(producers[i], NULL);
+  }
+
+  buffer_print(&full);
+
+  tuple_t tuple;
+  bool ok;
+
+  ok = buffer_put(&empty, 2, 222);
+  assert(!ok);
+  ok = buffer_try_get(&empty, &tuple);
+  assert(!ok);
+
+  // Tuples put before the close can still be read.
+  ok = buffer_get(&full, &tuple);
+  assert(ok && tuple.a == 1);
+  ok = buffer_get(&full, &tuple);
+  assert(!ok);
+
+  buffer_destroy(&empty);
+  buffer_destroy(&full);
+
+  success();
+}
+
+#define POLICY_ITEMS 256
+
+void *policy_producer(void *arg) {
+  buffer_t *buffer = (buffer_t*) arg;
+
+  for (int i = 0; i < POLICY_ITEMS; i++) {
+    bool ok = buffer_put(buffer, i, -i);
+    assert(ok);
+  }
+  buffer_close(buffer);
+
+  pthread_exit(NULL);
+}
+
+/* Every wait policy passes the tuples in order through a small buffer, and
+   wakes up its waiters when the buffer is closed. */
+void wait_policy_test() {
+  TEST_HEADER;
+
+  buffer_wait_t policies[] = {BUFFER_PARK, BUFFER_SPIN_PARK, BUFFER_SPIN_YIELD, BUFFER_SPIN};
+  char *names[] = {"park", "spin-park", "spin-yield", "spin"};
+
+  for (int p = 0; p < 4; p++) {
+    pthread_t tid;
+    buffer_t buffer;
+    tuple_t tuple;
+    int i = 0;
+
+    buffer_init_wait(&buffer, 4, policies[p]);
+
+    if (pthread_create(&tid, NULL, policy_producer, &buffer) != 0) {
+      perror("pthread_create()");
+      exit(EXIT_FAILURE);
+    }
+
+    for (; buffer_get(&buffer, &tuple); i++) assert(tuple.a == i && tuple.b == -i);
+    assert(i == POLICY_ITEMS);
+
+    pthread_join(tid, NULL);
+
+    // A consumer waiting on an empty buffer wakes up when it is closed.
+    buffer_t empty;
+    buffer_init_wait(&empty, 2, policies[p]);
+
+    if (pthread_create(&tid, NULL, blocked_consumer, &empty) != 0) {
+      perror("pthread_create()");
+      exit(EXIT_FAILURE);
+    }
+    usleep(10000);
+    buffer_close(&empty);
+    pthread_join(tid, NULL);
+
+    printf("%-10s %d tuples\n", names[p], i);
+
+    buffer_destroy(&buffer);
+    buffer_destroy(&empty);
+  }
+
+  success();
+}
+
 void random_ms_sleep(int min, int max) {
   usleep(1000 * (rand() % (max + 1 - min) + min));
 }
@@ -212,5 +421,9 @@ int main(void) {
   print_test();
   put_test();
   get_test();
+  batch_test();
+  try_test();
+  close_test();
+  wait_policy_test();
   concurrent_put_get_test();
 }
@@ -0,0 +1,128 @@
+#ifndef BUFFER_CORE_H
+#define BUFFER_CORE_H
+
+/* The bounded buffer algorithm shared by bounded_buffer.c and shm_buffer.c.
+   Not part of the API used by programs.
+
+   data counts the tuples, empty the free slots, and mutex protects the ring
+   and its indices. A producer takes n tokens from empty before it calls
+   core_put_reserved(), a consumer n tokens from data before it calls
+   core_get_reserved(). How they wait for the tokens is up to the caller.
+
+   The state of the ring, a buffer_state_t, holds no pointers so that it can
+   live in shared memory. Each caller passes the array and the semaphores as a
+   buffer_core_t, reached through its own pointers or its own mapping.
+*/
+
+#include "bounded_buffer.h" // tuple_t, buffer_state_t
+#include "psem.h"           // psem_wait(), psem_signal(), psem_signal_n()
+
+#include <stdbool.h> // true, false
+#include <string.h>  // memcpy()
+
+typedef struct {
+  buffer_state_t *state;
+  tuple_t        *array;
+  psem_t         *mutex;
+  psem_t         *data;
+  psem_t         *empty;
+} buffer_core_t;
+
+static inline void core_init(buffer_state_t *state, int size) {
+  state->size = size;
+  state->in = 0;     // where to produce the next data
+  state->out = 0;    // where to consume the next data
+  state->count = 0;
+  state->closed = false;
+}
+
+/* Copies n tuples from src into the ring starting at in. The run of slots may
+   wrap around the end of the array, in which case the copy is split in two.
+   Must be called inside the critical section. */
+static inline void core_copy_in(buffer_core_t core, const tuple_t *src, int n) {
+  buffer_state_t *state = core.state;
+  int first = state->size - state->in;
+
+  if (first > n) first = n;
+
+  memcpy(&core.array[state->in], src, first * sizeof(tuple_t));
+  memcpy(core.array, src + first, (n - first) * sizeof(tuple_t));
+
+  state->in = (state->in + n) % state->size;
+}
+
+/* Copies n tuples from the ring starting at out into dst, the mirror image of
+   core_copy_in(). Must be called inside the critical section. */
+static inline void core_copy_out(buffer_core_t core, tuple_t *dst, int n) {
+  buffer_state_t *state = core.state;
+  int first = state->size - state->out;
+
+  if (first > n) first = n;
+
+  memcpy(dst, &core.array[state->out], first * sizeof(tuple_t));
+  memcpy(dst + first, core.array, (n - first) * sizeof(tuple_t));
+
+  state->out = (state->out + n) % state->size;
+}
+
+/* Inserts the n tuples in src. The caller has already reserved n free slots
+   by taking n tokens from empty.
+
+   Returns n, or 0 if the buffer has been closed, in which case the reserved
+   slots are handed back to empty to wake up the next producer. */
+static inline int core_put_reserved(buffer_core_t core, const tuple_t *src, int n) {
+  psem_wait(core.mutex);
+
+  if (core.state->closed) {
+    psem_signal(core.mutex);
+    psem_signal_n(core.empty, n);
+    return 0;
+  }
+
+  core_copy_in(core, src, n);
+  core.state->count += n;
+
+  psem_signal(core.mutex);
+  psem_signal_n(core.data, n);
+
+  return n;
+}
+
+/* Removes up to n tuples into dst. The caller has already taken n tokens from
+   data.
+
+   Every token normally stands for one tuple in the buffer. The exception is
+   the extra token posted by core_close(), so a closed buffer may hold fewer
+   tuples than the caller has tokens for. Surplus tokens are handed back to
+   data to wake up the next consumer.
+
+   Returns the number of tuples removed. */
+static inline int core_get_reserved(buffer_core_t core, tuple_t *dst, int n) {
+  psem_wait(core.mutex);
+
+  int available = (n < core.state->count) ? n : core.state->count;
+
+  core_copy_out(core, dst, available);
+  core.state->count -= available;
+
+  psem_signal(core.mutex);
+
+  psem_signal_n(core.empty, available);
+  psem_signal_n(core.data, n - available);
+
+  return available;
+}
+
+/* Closes the buffer. One extra token on each semaphore wakes up one blocked
+   producer and one blocked consumer. Each of them hands the token on before
+   returning, so eventually every blocked thread or process wakes up. */
+static inline void core_close(buffer_core_t core) {
+  psem_wait(core.mutex);
+  core.state->closed = true;
+  psem_signal(core.mutex);
+
+  psem_signal(core.empty);
+  psem_signal(core.data);
+}
+
+#endif
@@ -0,0 +1,30 @@
+/**
+ * Cache line size and alignment helpers.
+ *
+ * Data written by different threads should live on different cache lines,
+ * otherwise the line ping-pongs between the cores even though the threads
+ * never touch the same variable (false sharing).
+ *
+ * On x86-64 the adjacent line prefetcher pulls in cache lines in pairs and on
+ * Apple silicon the line size is 128 bytes, so 128 bytes is used on those.
+ *
+ * Compile with -DNO_CACHE_PADDING to disable the padding, which is only useful
+ * to measure what the padding buys.
+ */
+
+#ifndef CACHE_LINE_H
+#define CACHE_LINE_H
+
+#if defined(__x86_64__) || (defined(__APPLE__) && defined(__aarch64__))
+#define CACHE_LINE 128
+#else
+#define CACHE_LINE 64
+#endif
+
+#ifdef NO_CACHE_PADDING
+#define CACHE_ALIGNED
+#else
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE)))
+#endif
+
+#endif
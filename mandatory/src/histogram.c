@@ -0,0 +1,45 @@
+#include "histogram.h"
+
+#include <string.h> // memset()
+
+void histogram_init(histogram_t *h) {
+  memset(h, 0, sizeof(histogram_t));
+  h->min = UINT64_MAX;
+}
+
+/* Largest value counted in bucket. */
+static uint64_t bucket_value(int bucket) {
+  if (bucket < 2 * HISTOGRAM_SUB_BUCKETS) return bucket;
+
+  int e = bucket / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS - 1;
+  uint64_t k = bucket % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+
+  // For the very last bucket this wraps around to UINT64_MAX, as it should.
+  return ((k + 1) << (e - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+void histogram_merge(histogram_t *into, const histogram_t *from) {
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) into->buckets[i] += from->buckets[i];
+  into->count += from->count;
+  into->sum += from->sum;
+  if (from->min < into->min) into->min = from->min;
+  if (from->max > into->max) into->max = from->max;
+}
+
+uint64_t histogram_percentile(const histogram_t *h, double q) {
+  uint64_t rank = (uint64_t) (q * h->count + 0.5), seen = 0;
+
+  if (h->count == 0) return 0;
+  if (rank == 0) rank = 1;
+
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    seen += h->buckets[i];
+    if (seen >= rank) return bucket_value(i) < h->max ? bucket_value(i) : h->max;
+  }
+
+  return h->max;
+}
+
+double histogram_mean(const histogram_t *h) {
+  return h->count > 0 ? (double) h->sum / h->count : 0;
+}
@@ -0,0 +1,66 @@
+/**
+ * Latency histograms.
+ *
+ * Values, usually latencies in nanoseconds, are counted in log-linear buckets
+ * as in HdrHistogram: values below 2 * HISTOGRAM_SUB_BUCKETS have a bucket
+ * each, above that every power of two is split into HISTOGRAM_SUB_BUCKETS
+ * buckets. A reported percentile is therefore at most 1/HISTOGRAM_SUB_BUCKETS
+ * (3%) above the true value, over the whole range of 64-bit values, and
+ * recording a value is a handful of instructions with no allocation.
+ *
+ * A histogram is not thread safe. Give every thread a histogram of its own
+ * and merge them with histogram_merge() once the threads are done.
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h> // uint64_t
+
+#define HISTOGRAM_SUB_BITS    5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS     ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct {
+  uint64_t count;
+  uint64_t min;
+  uint64_t max;
+  uint64_t sum;
+  uint64_t buckets[HISTOGRAM_BUCKETS];
+} histogram_t;
+
+/* Empties h. */
+void histogram_init(histogram_t *h);
+
+static inline int histogram_bucket(uint64_t value) {
+  if (value < 2 * HISTOGRAM_SUB_BUCKETS) return value;
+
+  int e = 63 - __builtin_clzll(value); // 2^e <= value < 2^(e+1)
+  return (e - HISTOGRAM_SUB_BITS) * HISTOGRAM_SUB_BUCKETS + (value >> (e - HISTOGRAM_SUB_BITS));
+}
+
+static inline void histogram_record(histogram_t *h, uint64_t value) {
+  h->buckets[histogram_bucket(value)]++;
+  h->count++;
+  h->sum += value;
+  if (value < h->min) h->min = value;
+  if (value > h->max) h->max = value;
+}
+
+/* Adds the values of from to into. */
+void histogram_merge(histogram_t *into, const histogram_t *from);
+
+/* histogram_percentile(h, q)
+
+   Return value
+
+   The smallest value that fraction q (between 0 and 1) of the recorded values
+   are less than or equal to, rounded up to the end of its bucket but never
+   above the largest value. 0 if h is empty.
+*/
+uint64_t histogram_percentile(const histogram_t *h, double q);
+
+/* Mean of the recorded values, 0 if h is empty. */
+double histogram_mean(const histogram_t *h);
+
+#endif
@@ -0,0 +1,161 @@
+/**
+ * Unit test for the latency histograms and the cycle counter timing.
+ */
+
+#include "histogram.h"
+#include "timing.h"  // timing_ticks(), timing_ticks_to_ns(), timing_now_ns()
+
+#include <stdio.h>   // printf(), setbuf(), stdout
+#include <inttypes.h> // PRIu64
+#include <string.h>  // memcmp()
+#include <time.h>    // nanosleep()
+#include <assert.h>  // assert()
+
+#define TEST_HEADER printf("\n==== %s ====\n\n", __FUNCTION__)
+
+void success() {
+  printf("\nTest SUCCESSFUL :-)\n\n");
+}
+
+histogram_t h, h2, all;
+
+void empty_test() {
+  TEST_HEADER;
+
+  histogram_init(&h);
+  assert(h.count == 0);
+  assert(histogram_percentile(&h, 0.5) == 0);
+  assert(histogram_mean(&h) == 0);
+
+  success();
+}
+
+/* Small values have a bucket each and are reported exactly. */
+void exact_test() {
+  TEST_HEADER;
+
+  histogram_init(&h);
+
+  for (uint64_t v = 0; v < 2 * HISTOGRAM_SUB_BUCKETS; v++) histogram_record(&h, v);
+
+  assert(h.min == 0 && h.max == 2 * HISTOGRAM_SUB_BUCKETS - 1);
+  assert(histogram_percentile(&h, 0.5) == HISTOGRAM_SUB_BUCKETS - 1);
+  assert(histogram_percentile(&h, 1.0) == 2 * HISTOGRAM_SUB_BUCKETS - 1);
+  assert(histogram_percentile(&h, 0.0) == 0);
+  assert(histogram_mean(&h) == (2 * HISTOGRAM_SUB_BUCKETS - 1) / 2.0);
+
+  success();
+}
+
+/* Buckets are consecutive and cover every 64-bit value. */
+void bucket_test() {
+  TEST_HEADER;
+
+  int previous = -1;
+
+  for (int e = 0; e < 64; e++) {
+    for (uint64_t k = 0; k < 4; k++) {
+      uint64_t v = (1ULL << e) + k * ((1ULL << e) / 4);
+      int bucket = histogram_bucket(v);
+
+      assert(bucket >= previous && bucket <= previous + HISTOGRAM_SUB_BUCKETS);
+      assert(bucket < HISTOGRAM_BUCKETS);
+      previous = bucket;
+    }
+  }
+
+  assert(histogram_bucket(UINT64_MAX) == HISTOGRAM_BUCKETS - 1);
+
+  histogram_init(&h);
+  histogram_record(&h, UINT64_MAX);
+  assert(histogram_percentile(&h, 0.5) == UINT64_MAX);
+
+  success();
+}
+
+/* Percentiles of large values are at most 1/HISTOGRAM_SUB_BUCKETS too high,
+   and never too low. */
+void accuracy_test() {
+  TEST_HEADER;
+
+  double qs[] = {0.1, 0.5, 0.9, 0.99, 0.999};
+  int n = 1000000;
+
+  histogram_init(&h);
+
+  // n values 1000, 2000, ..., n * 1000, the true q percentile is q * n * 1000.
+  for (int i = 1; i <= n; i++) histogram_record(&h, i * 1000ULL);
+
+  for (size_t i = 0; i < sizeof(qs) / sizeof(qs[0]); i++) {
+    uint64_t exact = (uint64_t) (qs[i] * n + 0.5) * 1000;
+    uint64_t p = histogram_percentile(&h, qs[i]);
+
+    printf("p%g %" PRIu64 ", exact %" PRIu64 "\n", qs[i] * 100, p, exact);
+    assert(p >= exact && p <= exact + exact / HISTOGRAM_SUB_BUCKETS);
+  }
+
+  assert(histogram_percentile(&h, 1.0) == n * 1000ULL);
+
+  success();
+}
+
+/* Merging histograms recorded separately gives the histogram of all values,
+   as when every thread records into one of its own. */
+void merge_test() {
+  TEST_HEADER;
+
+  histogram_init(&h);
+  histogram_init(&h2);
+  histogram_init(&all);
+
+  for (uint64_t v = 1; v < 1000000; v = v * 3 / 2 + 1) {
+    histogram_record(v % 2 ? &h : &h2, v);
+    histogram_record(&all, v);
+  }
+
+  histogram_merge(&h, &h2);
+
+  assert(memcmp(&h, &all, sizeof(histogram_t)) == 0);
+
+  success();
+}
+
+/* The cycle counter and CLOCK_MONOTONIC agree on how long a sleep takes. */
+void timing_test() {
+  TEST_HEADER;
+
+  struct timespec delay = {.tv_sec = 0, .tv_nsec = 50000000};
+
+  timing_calibrate();
+  printf("%.3f ticks per ns\n", timing_ticks_per_ns());
+
+  uint64_t ns = timing_now_ns();
+  uint64_t ticks = timing_ticks();
+
+  nanosleep(&delay, NULL);
+
+  ticks = timing_ticks_to_ns(timing_ticks() - ticks);
+  ns = timing_now_ns() - ns;
+
+  printf("clock %" PRIu64 " ns, cycle counter %" PRIu64 " ns\n", ns, ticks);
+
+  assert(ns >= 50000000);
+  assert(ticks > ns - ns / 100 && ticks < ns + ns / 100);
+
+  // The conversion doesn't overflow for long intervals, here an hour.
+  uint64_t hour = timing_ticks_to_ns(3600E9 * timing_ticks_per_ns());
+  assert(hour > 3599E9 && hour < 3601E9);
+
+  success();
+}
+
+int main(void) {
+  setbuf(stdout, NULL);
+
+  empty_test();
+  exact_test();
+  bucket_test();
+  accuracy_test();
+  merge_test();
+  timing_test();
+}
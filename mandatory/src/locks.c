@@ -0,0 +1,275 @@
+#include "locks.h"
+
+#include <stdio.h>   // perror()
+#include <stdlib.h>  // posix_memalign(), free(), exit()
+#include <sched.h>   // sched_yield()
+
+/* Bounds, in pause instructions, of the TTAS backoff. */
+#define BACKOFF_MIN 4
+#define BACKOFF_MAX 1024
+
+/* Number of pause instructions a waiter spins before it gives its core away
+   with sched_yield(). Queue locks hand the lock to a particular thread, so with
+   more threads than cores a waiter that keeps spinning can burn a whole time
+   slice waiting for a thread that isn't running. */
+#define SPIN_LIMIT 256
+
+/* Waits one round, *spins counts the rounds waited so far. */
+static inline void spin_wait(int *spins) {
+  if (++*spins < SPIN_LIMIT) {
+    cpu_relax();
+  } else {
+    *spins = 0;
+    sched_yield();
+  }
+}
+
+/*******************************************************************************
+                         Test-and-test-and-set with backoff
+*******************************************************************************/
+
+void ttas_init(ttas_lock_t *lock) {
+  atomic_init(&lock->locked, 0);
+}
+
+bool ttas_trylock(ttas_lock_t *lock) {
+  return load_relaxed(&lock->locked) == 0 && exchange_acquire(&lock->locked, 1) == 0;
+}
+
+void ttas_lock(ttas_lock_t *lock) {
+  int backoff = BACKOFF_MIN;
+
+  while (exchange_acquire(&lock->locked, 1) != 0) {
+    // Back off after a failed attempt so that the waiters don't all retry at
+    // the same time the lock is released ...
+    for (int i = 0; i < backoff; i++) cpu_relax();
+    if (backoff < BACKOFF_MAX) backoff *= 2;
+
+    // ... and then wait with plain reads, which keep the cache line shared,
+    // for the lock to look free.
+    int spins = 0;
+    while (load_relaxed(&lock->locked) != 0) spin_wait(&spins);
+  }
+}
+
+void ttas_unlock(ttas_lock_t *lock) {
+  store_release(&lock->locked, 0);
+}
+
+/*******************************************************************************
+                                   Ticket lock
+*******************************************************************************/
+
+void ticket_init(ticket_lock_t *lock) {
+  atomic_init(&lock->next, 0);
+  atomic_init(&lock->serving, 0);
+}
+
+void ticket_lock(ticket_lock_t *lock) {
+  unsigned int ticket = fetch_add_relaxed(&lock->next, 1);
+  int spins = 0;
+
+  while (load_acquire(&lock->serving) != ticket) {
+    spin_wait(&spins);
+  }
+}
+
+void ticket_unlock(ticket_lock_t *lock) {
+  // Only the holder writes serving, no read-modify-write needed.
+  store_release(&lock->serving, load_relaxed(&lock->serving) + 1);
+}
+
+/*******************************************************************************
+                                    MCS lock
+*******************************************************************************/
+
+void mcs_init(mcs_lock_t *lock) {
+  atomic_init(&lock->tail, NULL);
+}
+
+void mcs_lock(mcs_lock_t *lock, mcs_node_t *node) {
+  store_relaxed(&node->next, NULL);
+  store_relaxed(&node->locked, 1);
+
+  mcs_node_t *pred = exchange_acq_rel(&lock->tail, node);
+
+  if (pred == NULL) return;
+
+  // Link in behind the predecessor and wait for it to hand over the lock.
+  store_release(&pred->next, node);
+
+  int spins = 0;
+  while (load_acquire(&node->locked)) spin_wait(&spins);
+}
+
+void mcs_unlock(mcs_lock_t *lock, mcs_node_t *node) {
+  mcs_node_t *next = load_acquire(&node->next);
+
+  if (next == NULL) {
+    mcs_node_t *expected = node;
+
+    // No one is waiting, unless a thread has swapped itself into tail but not
+    // yet linked itself in behind us.
+    if (cas_strong_release(&lock->tail, &expected, NULL)) {
+      return;
+    }
+
+    int spins = 0;
+    while ((next = load_acquire(&node->next)) == NULL) {
+      spin_wait(&spins);
+    }
+  }
+
+  store_release(&next->locked, 0);
+}
+
+/*******************************************************************************
+                                    CLH lock
+*******************************************************************************/
+
+clh_node_t *clh_node_new() {
+  void *node;
+
+  if (posix_memalign(&node, CACHE_LINE, sizeof(clh_node_t)) != 0) {
+    perror("Could not allocate CLH node");
+    exit(EXIT_FAILURE);
+  }
+
+  atomic_init(&((clh_node_t *) node)->locked, 0);
+  ((clh_node_t *) node)->pred = NULL;
+
+  return node;
+}
+
+void clh_node_free(clh_node_t *node) {
+  free(node);
+}
+
+void clh_init(clh_lock_t *lock) {
+  atomic_init(&lock->tail, clh_node_new());
+}
+
+void clh_destroy(clh_lock_t *lock) {
+  clh_node_free(load_relaxed(&lock->tail));
+  store_relaxed(&lock->tail, NULL);
+}
+
+void clh_lock(clh_lock_t *lock, clh_node_t **node) {
+  clh_node_t *me = *node;
+
+  store_relaxed(&me->locked, 1);
+  me->pred = exchange_acq_rel(&lock->tail, me);
+
+  int spins = 0;
+  while (load_acquire(&me->pred->locked)) spin_wait(&spins);
+}
+
+void clh_unlock(clh_lock_t *lock __attribute__((unused)), clh_node_t **node) {
+  clh_node_t *me = *node;
+
+  // The predecessor has released its node and no one else will look at it,
+  // our own node is watched by the successor until it gets the lock.
+  *node = me->pred;
+  store_release(&me->locked, 0);
+}
+
+/*******************************************************************************
+                               Reader-writer lock
+*******************************************************************************/
+
+/*
+  The state word holds the writer bit, the number of readers inside in bits 1
+  to 15 and the number of waiting writers from bit 16. A writer announces
+  itself first, which keeps new readers out, and then waits for the readers
+  inside to leave.
+*/
+#define RW_WRITER       1u
+#define RW_READER       (1u << 1)
+#define RW_READERS      0xfffeu
+#define RW_WAITING      (1u << 16)
+#define RW_WAITING_MASK (~0u << 16)
+
+void rw_init(rw_lock_t *lock) {
+  atomic_init(&lock->state, 0);
+}
+
+void rw_read_lock(rw_lock_t *lock) {
+  unsigned int state = load_relaxed(&lock->state);
+  int spins = 0;
+
+  while (true) {
+    if ((state & (RW_WRITER | RW_WAITING_MASK)) == 0) {
+      // On failure state is updated with the current value.
+      if (cas_weak_acquire(&lock->state, &state, state + RW_READER)) return;
+      continue;
+    }
+
+    spin_wait(&spins);
+    state = load_relaxed(&lock->state);
+  }
+}
+
+void rw_read_unlock(rw_lock_t *lock) {
+  fetch_sub_release(&lock->state, RW_READER);
+}
+
+void rw_write_lock(rw_lock_t *lock) {
+  unsigned int state = fetch_add_relaxed(&lock->state, RW_WAITING) + RW_WAITING;
+  int spins = 0;
+
+  while (true) {
+    if ((state & (RW_WRITER | RW_READERS)) == 0) {
+      if (cas_weak_acquire(&lock->state, &state, state - RW_WAITING + RW_WRITER)) return;
+      continue;
+    }
+
+    spin_wait(&spins);
+    state = load_relaxed(&lock->state);
+  }
+}
+
+void rw_write_unlock(rw_lock_t *lock) {
+  fetch_sub_release(&lock->state, RW_WRITER);
+}
+
+/*******************************************************************************
+                                    Seqlock
+*******************************************************************************/
+
+/*
+  The fences follow Boehm, "Can seqlocks get along with programming language
+  memory models?" (2012). The writer's release fence keeps its data stores
+  after the store of the odd sequence number, the reader's acquire fence keeps
+  its data loads before the second load of the sequence number. A reader that
+  sees any store of a writer therefore also sees the sequence number change.
+*/
+
+void seqlock_init(seqlock_t *lock) {
+  atomic_init(&lock->sequence, 0);
+  ttas_init(&lock->writer);
+}
+
+unsigned int seqlock_read_begin(seqlock_t *lock) {
+  unsigned int sequence;
+  int spins = 0;
+
+  while ((sequence = load_acquire(&lock->sequence)) & 1) spin_wait(&spins);
+
+  return sequence;
+}
+
+bool seqlock_read_retry(seqlock_t *lock, unsigned int start) {
+  fence_acquire();
+  return load_relaxed(&lock->sequence) != start;
+}
+
+void seqlock_write_lock(seqlock_t *lock) {
+  ttas_lock(&lock->writer);
+  store_relaxed(&lock->sequence, load_relaxed(&lock->sequence) + 1);
+  fence_release();
+}
+
+void seqlock_write_unlock(seqlock_t *lock) {
+  store_release(&lock->sequence, load_relaxed(&lock->sequence) + 1);
+  ttas_unlock(&lock->writer);
+}
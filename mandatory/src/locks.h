@@ -0,0 +1,239 @@
+/**
+ * Spinlocks for short critical sections, and locks for read-mostly data.
+ *
+ * All locks busy-wait, so they are only a good idea when the lock is held for
+ * a short time and there are no more threads than cores. A waiter that has
+ * spun for a while yields its core with sched_yield(), which keeps the FIFO
+ * locks from stalling completely when the lock is handed to a thread that
+ * isn't running. They differ in how they behave under contention:
+ *
+ *   ttas_lock_t   - test-and-test-and-set with exponential backoff. Waiters
+ *                   spin on a read of the lock and only try to take it when it
+ *                   looks free, backing off longer after every failed attempt.
+ *                   Unfair, but cheap and good at low contention.
+ *
+ *   ticket_lock_t - FIFO lock. Every thread takes a ticket and waits until the
+ *                   ticket is served. Fair, but all waiters spin on the same
+ *                   cache line, which is invalidated on every release.
+ *
+ *   mcs_lock_t    - FIFO queue lock. Every waiter spins on a flag in its own
+ *                   queue node, so a release only touches the cache line of
+ *                   the next waiter. The caller provides the node.
+ *
+ *   clh_lock_t    - FIFO queue lock like MCS, but every waiter spins on the
+ *                   node of its predecessor and nodes are passed from thread
+ *                   to thread. Release is a single store.
+ *
+ * The queue nodes of MCS and CLH are cache line aligned so that waiters never
+ * spin on a line shared with another waiter.
+ *
+ * For data that is read much more often than it is written:
+ *
+ *   rw_lock_t     - reader-writer spinlock. Any number of readers or a single
+ *                   writer. Writer preferring: once a writer is waiting, new
+ *                   readers wait until it is done, so a steady stream of
+ *                   readers can't starve the writers. Every reader still
+ *                   updates the shared lock word.
+ *
+ *   seqlock_t     - readers don't write to shared memory at all. A writer
+ *                   makes the sequence number odd while it updates the data,
+ *                   readers read the data optimistically and retry if the
+ *                   sequence number was odd or changed meanwhile. Readers
+ *                   scale with the number of cores, but must be able to cope
+ *                   with reading torn data before they retry.
+ */
+
+#ifndef LOCKS_H
+#define LOCKS_H
+
+#include <stdbool.h> // bool
+
+#include "cache_line.h" // CACHE_ALIGNED
+#include "atomics.h"    // atomic_int, atomic_uint
+
+/*******************************************************************************
+                         Test-and-test-and-set with backoff
+*******************************************************************************/
+
+typedef struct {
+  atomic_int locked;
+} ttas_lock_t;
+
+#define TTAS_LOCK_INITIALIZER {0}
+
+void ttas_init(ttas_lock_t *lock);
+void ttas_lock(ttas_lock_t *lock);
+void ttas_unlock(ttas_lock_t *lock);
+
+/* ttas_trylock(lock)
+
+   Return value
+
+   true if the lock was taken, false if it was held by someone else.
+*/
+bool ttas_trylock(ttas_lock_t *lock);
+
+/*******************************************************************************
+                                   Ticket lock
+*******************************************************************************/
+
+typedef struct {
+  /* Taken by arriving threads. */
+  CACHE_ALIGNED
+  atomic_uint next;
+  /* Written by the holder on release, read by all waiters. */
+  CACHE_ALIGNED
+  atomic_uint serving;
+} ticket_lock_t;
+
+#define TICKET_LOCK_INITIALIZER {0, 0}
+
+void ticket_init(ticket_lock_t *lock);
+void ticket_lock(ticket_lock_t *lock);
+void ticket_unlock(ticket_lock_t *lock);
+
+/*******************************************************************************
+                                    MCS lock
+*******************************************************************************/
+
+typedef struct mcs_node {
+  CACHE_ALIGNED
+  struct mcs_node *_Atomic next;
+  atomic_int      locked;
+} mcs_node_t;
+
+typedef struct {
+  mcs_node_t *_Atomic tail; // Last thread in the queue, NULL if the lock is free.
+} mcs_lock_t;
+
+#define MCS_LOCK_INITIALIZER {NULL}
+
+void mcs_init(mcs_lock_t *lock);
+
+/* mcs_lock(lock, node)
+
+   Acquires the lock, queueing node. The node belongs to the caller, usually
+   on its stack, and must not be touched until it has been passed to
+   mcs_unlock(). A node can only be in one queue at a time.
+*/
+void mcs_lock(mcs_lock_t *lock, mcs_node_t *node);
+
+/* mcs_unlock(lock, node)
+
+   Releases the lock, node must be the one passed to mcs_lock().
+*/
+void mcs_unlock(mcs_lock_t *lock, mcs_node_t *node);
+
+/*******************************************************************************
+                                    CLH lock
+*******************************************************************************/
+
+typedef struct clh_node {
+  CACHE_ALIGNED
+  atomic_int      locked;
+  struct clh_node *pred; // Predecessor, recycled by the owner on release.
+} clh_node_t;
+
+typedef struct {
+  clh_node_t *_Atomic tail; // Node of the last thread in the queue.
+} clh_lock_t;
+
+/* clh_init(lock)
+
+   Initializes the lock with a node of its own that is handed to the first
+   thread to release the lock. The lock must be destroyed with clh_destroy().
+*/
+void clh_init(clh_lock_t *lock);
+
+/* clh_destroy(lock)
+
+   Frees the node held by the lock. No thread may hold or wait for the lock.
+*/
+void clh_destroy(clh_lock_t *lock);
+
+/* clh_node_new()
+
+   Return value
+
+   A node for a thread to use with clh_lock(), freed with clh_node_free().
+*/
+clh_node_t *clh_node_new();
+void clh_node_free(clh_node_t *node);
+
+/* clh_lock(lock, node)
+
+   Acquires the lock using the caller's node *node. The node can be used with
+   any CLH lock.
+*/
+void clh_lock(clh_lock_t *lock, clh_node_t **node);
+
+/* clh_unlock(lock, node)
+
+   Releases the lock. The node passed to clh_lock() stays with the lock for the
+   next thread, *node is replaced by the node of the caller's predecessor,
+   which is the one to use from now on.
+*/
+void clh_unlock(clh_lock_t *lock, clh_node_t **node);
+
+/*******************************************************************************
+                               Reader-writer lock
+*******************************************************************************/
+
+typedef struct {
+  atomic_uint state; // Writer holding, readers holding and writers waiting.
+} rw_lock_t;
+
+#define RW_LOCK_INITIALIZER {0}
+
+void rw_init(rw_lock_t *lock);
+
+/* Takes the lock shared with other readers, waiting while a writer holds
+   the lock or waits for it. */
+void rw_read_lock(rw_lock_t *lock);
+void rw_read_unlock(rw_lock_t *lock);
+
+/* Takes the lock exclusively, waiting for the readers inside to leave. */
+void rw_write_lock(rw_lock_t *lock);
+void rw_write_unlock(rw_lock_t *lock);
+
+/*******************************************************************************
+                                    Seqlock
+*******************************************************************************/
+
+typedef struct {
+  atomic_uint sequence; // Odd while a writer updates the data.
+  ttas_lock_t writer;   // Serializes the writers.
+} seqlock_t;
+
+#define SEQLOCK_INITIALIZER {0, TTAS_LOCK_INITIALIZER}
+
+void seqlock_init(seqlock_t *lock);
+
+/* seqlock_read_begin(lock)
+
+   Starts reading the data protected by lock, waiting while a writer is
+   updating it. The data must be read with (relaxed) atomic loads and the
+   values only used once seqlock_read_retry() has returned false, as a writer
+   may change them while they are read.
+
+   Return value
+
+   The sequence number to pass to seqlock_read_retry().
+*/
+unsigned int seqlock_read_begin(seqlock_t *lock);
+
+/* seqlock_read_retry(lock, start)
+
+   Return value
+
+   true if a writer may have changed the data since seqlock_read_begin()
+   returned start, in which case the reads must be done again.
+*/
+bool seqlock_read_retry(seqlock_t *lock, unsigned int start);
+
+/* Excludes other writers and makes the readers wait or retry. The data must
+   be written with (relaxed) atomic stores. */
+void seqlock_write_lock(seqlock_t *lock);
+void seqlock_write_unlock(seqlock_t *lock);
+
+#endif
@@ -0,0 +1,312 @@
+/**
+ * Unit test for the spinlocks.
+ */
+
+#include "locks.h"
+
+#include <stdio.h>   // printf(), setbuf(), stdout
+#include <stdlib.h>  // exit(), EXIT_FAILURE
+#include <pthread.h> // pthread_..
+#include <unistd.h>  // usleep()
+#include <assert.h>  // assert()
+
+#include "atomics.h" // atomic_int, fetch_add_relaxed()
+
+#define TEST_HEADER printf("\n==== %s ====\n\n", __FUNCTION__)
+
+#define THREADS    4
+#define ITERATIONS 20000
+
+void success() {
+  printf("\nTest SUCCESSFUL :-)\n\n");
+}
+
+/* Incremented by the threads with the lock held. The non-atomic read-modify-
+   write loses updates unless the lock provides mutual exclusion. */
+volatile int counter;
+
+/* Number of threads in the critical section at the same time. */
+atomic_int inside;
+
+ttas_lock_t ttas = TTAS_LOCK_INITIALIZER;
+ticket_lock_t ticket = TICKET_LOCK_INITIALIZER;
+mcs_lock_t mcs = MCS_LOCK_INITIALIZER;
+clh_lock_t clh;
+
+void critical_section() {
+  int others = fetch_add_relaxed(&inside, 1);
+  assert(others == 0);
+  counter = counter + 1;
+  fetch_sub_relaxed(&inside, 1);
+}
+
+void *ttas_thread(void *arg __attribute__((unused))) {
+  for (int i = 0; i < ITERATIONS; i++) {
+    ttas_lock(&ttas);
+    critical_section();
+    ttas_unlock(&ttas);
+  }
+  return NULL;
+}
+
+void *ticket_thread(void *arg __attribute__((unused))) {
+  for (int i = 0; i < ITERATIONS; i++) {
+    ticket_lock(&ticket);
+    critical_section();
+    ticket_unlock(&ticket);
+  }
+  return NULL;
+}
+
+void *mcs_thread(void *arg __attribute__((unused))) {
+  mcs_node_t node;
+
+  for (int i = 0; i < ITERATIONS; i++) {
+    mcs_lock(&mcs, &node);
+    critical_section();
+    mcs_unlock(&mcs, &node);
+  }
+  return NULL;
+}
+
+void *clh_thread(void *arg __attribute__((unused))) {
+  clh_node_t *node = clh_node_new();
+
+  for (int i = 0; i < ITERATIONS; i++) {
+    clh_lock(&clh, &node);
+    critical_section();
+    clh_unlock(&clh, &node);
+  }
+
+  clh_node_free(node);
+  return NULL;
+}
+
+void run_threads(void *(*start_routine)(void *)) {
+  pthread_t tid[THREADS];
+
+  counter = 0;
+
+  for (int i = 0; i < THREADS; i++) {
+    if (pthread_create(&tid[i], NULL, start_routine, NULL) != 0) {
+      perror("pthread_create()");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  for (int i = 0; i < THREADS; i++) {
+    pthread_join(tid[i], NULL);
+  }
+
+  assert(counter == THREADS * ITERATIONS);
+}
+
+void ttas_test() {
+  TEST_HEADER;
+
+  bool locked = ttas_trylock(&ttas);
+  assert(locked);
+  locked = ttas_trylock(&ttas);
+  assert(!locked);
+  ttas_unlock(&ttas);
+
+  run_threads(ttas_thread);
+  assert(ttas.locked == 0);
+
+  success();
+}
+
+void ticket_test() {
+  TEST_HEADER;
+
+  run_threads(ticket_thread);
+
+  // Every ticket handed out has been served.
+  assert(ticket.next == THREADS * ITERATIONS);
+  assert(ticket.serving == ticket.next);
+
+  success();
+}
+
+void mcs_test() {
+  TEST_HEADER;
+
+  run_threads(mcs_thread);
+  assert(mcs.tail == NULL);
+
+  success();
+}
+
+void clh_test() {
+  TEST_HEADER;
+
+  clh_init(&clh);
+
+  // The node released by one lock can be used with another.
+  clh_lock_t other;
+  clh_node_t *node = clh_node_new();
+  clh_node_t *first = node;
+
+  clh_init(&other);
+  clh_lock(&clh, &node);
+  clh_unlock(&clh, &node);
+  assert(node != first);
+  clh_lock(&other, &node);
+  clh_unlock(&other, &node);
+  clh_node_free(node);
+  clh_destroy(&other);
+
+  run_threads(clh_thread);
+  assert(clh.tail->locked == 0);
+
+  clh_destroy(&clh);
+
+  success();
+}
+
+rw_lock_t rw = RW_LOCK_INITIALIZER;
+seqlock_t seq = SEQLOCK_INITIALIZER;
+
+/* Readers and writers inside the reader-writer lock, and written by the
+   writers under the seqlock, a stays equal to -b. */
+atomic_int readers, writers, a, b;
+
+/* Every fourth thread writes, the others read. */
+void *rw_thread(void *arg) {
+  bool writer = *(int *) arg % 4 == 0;
+
+  for (int i = 0; i < ITERATIONS; i++) {
+    if (writer) {
+      rw_write_lock(&rw);
+      int others = fetch_add_relaxed(&writers, 1);
+      assert(others == 0);
+      assert(load_relaxed(&readers) == 0);
+      counter = counter + 1;
+      fetch_sub_relaxed(&writers, 1);
+      rw_write_unlock(&rw);
+    } else {
+      rw_read_lock(&rw);
+      fetch_add_relaxed(&readers, 1);
+      assert(load_relaxed(&writers) == 0);
+      fetch_sub_relaxed(&readers, 1);
+      rw_read_unlock(&rw);
+    }
+  }
+  return NULL;
+}
+
+void *rw_waiting_writer(void *arg __attribute__((unused))) {
+  rw_write_lock(&rw);
+  fetch_add_relaxed(&writers, 1);
+  rw_write_unlock(&rw);
+  return NULL;
+}
+
+void *rw_late_reader(void *arg __attribute__((unused))) {
+  rw_read_lock(&rw);
+  // The writer that was waiting when we arrived went first.
+  assert(load_relaxed(&writers) == 1);
+  rw_read_unlock(&rw);
+  return NULL;
+}
+
+void rw_test() {
+  TEST_HEADER;
+
+  pthread_t tid[THREADS];
+  int ids[THREADS];
+
+  counter = 0;
+
+  for (int i = 0; i < THREADS; i++) {
+    ids[i] = i;
+    if (pthread_create(&tid[i], NULL, rw_thread, &ids[i]) != 0) {
+      perror("pthread_create()");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  for (int i = 0; i < THREADS; i++) pthread_join(tid[i], NULL);
+
+  assert(counter == (THREADS + 3) / 4 * ITERATIONS);
+  assert(rw.state == 0);
+
+  // A waiting writer keeps new readers out.
+  pthread_t writer, reader;
+
+  atomic_init(&writers, 0);
+  rw_read_lock(&rw);
+  pthread_create(&writer, NULL, rw_waiting_writer, NULL);
+  while (load_relaxed(&rw.state) < (1u << 16)) usleep(1000);
+  pthread_create(&reader, NULL, rw_late_reader, NULL);
+  usleep(50000);
+  rw_read_unlock(&rw);
+  pthread_join(writer, NULL);
+  pthread_join(reader, NULL);
+  assert(rw.state == 0);
+
+  success();
+}
+
+/* The first thread writes, the others read consistent snapshots. */
+void *seqlock_thread(void *arg) {
+  if (*(int *) arg == 0) {
+    for (int i = 1; i <= ITERATIONS; i++) {
+      seqlock_write_lock(&seq);
+      store_relaxed(&a, i);
+      store_relaxed(&b, -i);
+      seqlock_write_unlock(&seq);
+    }
+    return NULL;
+  }
+
+  int x, y, last = 0;
+
+  for (int i = 0; i < ITERATIONS; i++) {
+    unsigned int start;
+
+    do {
+      start = seqlock_read_begin(&seq);
+      x = load_relaxed(&a);
+      y = load_relaxed(&b);
+    } while (seqlock_read_retry(&seq, start));
+
+    assert(x == -y);
+    assert(x >= last);
+    last = x;
+  }
+  return NULL;
+}
+
+void seqlock_test() {
+  TEST_HEADER;
+
+  pthread_t tid[THREADS];
+  int ids[THREADS];
+
+  for (int i = 0; i < THREADS; i++) {
+    ids[i] = i;
+    if (pthread_create(&tid[i], NULL, seqlock_thread, &ids[i]) != 0) {
+      perror("pthread_create()");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  for (int i = 0; i < THREADS; i++) pthread_join(tid[i], NULL);
+
+  assert(a == ITERATIONS && b == -ITERATIONS);
+  assert(seq.sequence == 2 * ITERATIONS);
+
+  success();
+}
+
+int main(void) {
+  setbuf(stdout, NULL);
+
+  ttas_test();
+  ticket_test();
+  mcs_test();
+  clh_test();
+  rw_test();
+  seqlock_test();
+}
@@ -8,36 +8,91 @@
  * 2013 - Original version by Nikos Nikoleris <nikos.nikoleris@it.uu.se>.
  *
  * 2019 - Refactor and added stats summary by Karl Marklund <karl.marklund@it.uu.se>.
+ *
+ * Usage: mutex [options], run mutex -h for the list of options.
+ *
+ * Each test case is run for every thread count from 1 up to the maximum
+ * number of threads (half of them incrementing, half of them decrementing), a
+ * few warm up runs followed by a number of measured repetitions. The median,
+ * minimum and maximum throughput of the repetitions are reported as a table,
+ * CSV or JSON. A handful of repetitions is too few for a meaningful tail, with
+ * -l the latency percentiles of single operations are reported as well.
  */
 
 #include <stdio.h>   // printf(), fprintf()
-#include <stdlib.h>  // abort()
+#include <stdlib.h>  // abort(), qsort(), atoi()
+#include <string.h>  // strcmp(), strstr()
+#include <unistd.h>  // getopt(), sysconf()
 #include <pthread.h> // pthread_...
 #include <stdbool.h> // true, false
+#include <inttypes.h> // PRIu64
 
-#include "timing.h" // timing_start(), timing_stop()
+#include "timing.h" // timing_start(), timing_stop(), timing_ticks()
+#include "histogram.h" // histogram_t
+#include "locks.h"  // ttas_lock_t, ticket_lock_t, mcs_lock_t, clh_lock_t, rw_lock_t, seqlock_t
+#include "sharded_counter.h" // sharded_counter_t
+#include "affinity.h" // affinity_t, affinity_pin(), affinity_alloc()
+#include "atomics.h" // atomic_int, load_acquire(), store_release(), ...
 
-/* Shared variable */
+/* Shared variable. Only the unsynchronized test needs volatile, it keeps every
+   increment a separate load and store so that updates are visibly lost. */
 volatile int counter;
 
+/* Shared variable for the atomic tests */
+atomic_int atomic_counter;
+
 /* Pthread mutex lock */
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /* Shared variable used to implement a spinlock */
-volatile int lock = false;
+atomic_int lock = false;
 
-/* Number of threads that will increment the shared variable */
+/* Default number of threads that will increment the shared variable */
 #define INC_THREADS 5
 /* Value by which the threads increment the shared variable */
 #define INCREMENT 2
-/* Iterations performed incrementing the shared variable */
+/* Default number of iterations performed by each thread */
 #define INC_ITERATIONS 20000
-/* Number of threads that will try to decrement the shared variable */
+/* Default number of threads that will try to decrement the shared variable */
 #define DEC_THREADS 4
-/* Value by which the threads increment the shared variable */
+/* Value by which the threads decrement the shared variable */
 #define DECREMENT 2
-/* Iterations performed decrementing the shared variable.*/
-#define DEC_ITERATIONS (INC_ITERATIONS * INC_THREADS * INCREMENT / DEC_THREADS / DECREMENT)
+
+/* Iterations performed by each thread incrementing or decrementing the shared
+   variable, set with -i. */
+int iterations = INC_ITERATIONS;
+
+/* Length of the critical section in iterations of a pause loop, set with -w. */
+int cs_length = 0;
+
+/* Measure the latency of every operation, set with -l. */
+static bool measure_latency = false;
+
+/* Latencies of the operations of the calling thread, and the time of its
+   previous operation. */
+static _Thread_local histogram_t *op_latency = NULL;
+static _Thread_local uint64_t op_last = 0;
+
+/*
+  The latency of an operation is the time from one critical section of a
+  thread to its next one: releasing the lock, waiting for it and taking it
+  again. This is measured without touching the test cases, by reading the
+  cycle counter in cs_work(), at the cost of a counter read and a histogram
+  update, some 10 to 20 ns, inside every critical section.
+*/
+static void op_tick()
+{
+    uint64_t now = timing_ticks();
+
+    if (op_last != 0) histogram_record(op_latency, timing_ticks_to_ns(now - op_last));
+    op_last = now;
+}
+
+/* Simulated work inside the critical section. */
+static inline void cs_work() {
+    if (measure_latency) op_tick();
+    for (int i = 0; i < cs_length; i++) cpu_relax();
+}
 
 /*******************************************************************************
                           Test 0 - No synchronization
@@ -49,9 +104,10 @@ inc_no_sync(void *arg __attribute__((unused)))
 {
     int i;
 
-    for (i = 0; i < INC_ITERATIONS; i++)
+    for (i = 0; i < iterations; i++)
     {
         counter += INCREMENT;
+        cs_work();
     }
 
     return NULL;
@@ -63,9 +119,10 @@ dec_no_sync(void *arg __attribute__((unused)))
 {
     int i;
 
-    for (i = 0; i < DEC_ITERATIONS; i++)
+    for (i = 0; i < iterations; i++)
     {
         counter -= DECREMENT;
+        cs_work();
     }
 
     return NULL;
@@ -81,7 +138,7 @@ inc_mutex(void *arg __attribute__((unused)))
 {
     int i;
 
-    for (i = 0; i < INC_ITERATIONS; i++)
+    for (i = 0; i < iterations; i++)
     {
         /* TODO: Protect access to the shared variable counter with a mutex lock
          * inside the loop. */
@@ -91,6 +148,7 @@ inc_mutex(void *arg __attribute__((unused)))
         */
         pthread_mutex_lock(&mutex); // Locks
         counter += INCREMENT; // Critial section
+        cs_work();
         pthread_mutex_unlock(&mutex); // Unlocks
     }
 
@@ -103,12 +161,13 @@ dec_mutex(void *arg __attribute__((unused)))
 {
     int i;
 
-    for (i = 0; i < DEC_ITERATIONS; i++)
+    for (i = 0; i < iterations; i++)
     {
         /* TODO: Protect access to the shared variable counter with a mutex lock
          * inside the loop. */
         pthread_mutex_lock(&mutex); // Locks
         counter -= DECREMENT; // Critical section
+        cs_work();
         pthread_mutex_unlock(&mutex); // Unlocks
     }
 
@@ -119,13 +178,28 @@ dec_mutex(void *arg __attribute__((unused)))
                       Test 2 - Spinlock with test-and-set
 *******************************************************************************/
 
+/* Taking a lock only needs acquire ordering, which keeps the critical section
+   from moving before the lock is taken, and releasing it only needs release
+   ordering, which keeps the critical section from moving after the release. */
+
 void spin_lock() {
     // The calling operation obtains the lock if false, otherwise the while-loop "spins" waiting to acquire the lock before entering the critical section
-  while (__sync_lock_test_and_set(&lock, true)); // Sets to true and returns the previous value
+  while (exchange_acquire(&lock, true)); // Sets to true and returns the previous value
 }
 
 void spin_unlock() {
-  __sync_lock_release(&lock, false);
+  store_release(&lock, false);
+}
+
+/* The same lock with sequentially consistent operations, the ordering the
+   legacy __sync builtins give and the default for C11 atomic operations. */
+
+void spin_lock_seq_cst() {
+  while (exchange_seq_cst(&lock, true));
+}
+
+void spin_unlock_seq_cst() {
+  store_seq_cst(&lock, false);
 }
 
 /* Increments of the shared counter should be protected by a test-and-set spinlock */
@@ -134,11 +208,12 @@ inc_tas_spinlock(void *arg __attribute__((unused)))
 {
   int i;
 
-    for (i = 0; i < INC_ITERATIONS; i++)
+    for (i = 0; i < iterations; i++)
     {
         /* TODO: Add the spin_lock() and spin_unlock() operations inside the loop. */
         spin_lock(); // While loop if locked (i.e. it returns the previous value which then is true)
         counter += INCREMENT; // Critial section
+        cs_work();
         spin_unlock(); // "Unlocks", releases, the lock by setting it to false
     }
 
@@ -151,33 +226,73 @@ dec_tas_spinlock(void *arg __attribute__((unused)))
 {
   int i;
 
-    for (i = 0; i < DEC_ITERATIONS; i++)
+    for (i = 0; i < iterations; i++)
     {
         /* TODO: Add the spin_lock() and spin_unlock() operations inside the loop. */
         spin_lock(); // The while loop which will continue if true
         counter -= DECREMENT;
+        cs_work();
         spin_unlock(); // Releases the lock
     }
 
   return NULL;
 }
 
+void *
+inc_tas_spinlock_seq_cst(void *arg __attribute__((unused)))
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        spin_lock_seq_cst();
+        counter += INCREMENT;
+        cs_work();
+        spin_unlock_seq_cst();
+    }
+
+    return NULL;
+}
+
+void *
+dec_tas_spinlock_seq_cst(void *arg __attribute__((unused)))
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        spin_lock_seq_cst();
+        counter -= DECREMENT;
+        cs_work();
+        spin_unlock_seq_cst();
+    }
+
+    return NULL;
+}
+
 /*******************************************************************************
                       Tes 3 - Atomic addition/subtraction
 *******************************************************************************/
 
+void atomic_reset()
+{
+    store_relaxed(&atomic_counter, 0);
+}
+
+int atomic_value()
+{
+    return load_seq_cst(&atomic_counter);
+}
+
 /* Increment the shared counter using an atomic increment instruction */
 // From docu: 
-// These built-in functions perform the operation suggested by the name, and returns the value that had previously been in memory
+// These functions perform the operation suggested by the name, and returns the value that had previously been in memory
 
 void *
 inc_atomic(void *arg __attribute__((unused)))
 {
   int i;
 
-  for (i = 0; i < INC_ITERATIONS; i++)
+  for (i = 0; i < iterations; i++)
     {
-      __sync_fetch_and_add(&counter, INCREMENT); // Atomic add
+      fetch_add_seq_cst(&atomic_counter, INCREMENT); // Atomic add
+      cs_work();
     }
 
   return NULL;
@@ -189,14 +304,389 @@ dec_atomic(void *arg __attribute__((unused)))
 {
   int i;
 
-  for (i = 0; i < DEC_ITERATIONS; i++)
+  for (i = 0; i < iterations; i++)
     {
-      __sync_fetch_and_sub(&counter, DECREMENT); // Atomic sub
+      fetch_sub_seq_cst(&atomic_counter, DECREMENT); // Atomic sub
+      cs_work();
     }
 
   return NULL;
 }
 
+/* A counter that is only read once all threads have been joined doesn't need
+   any ordering at all, only atomicity. */
+
+void *
+inc_atomic_relaxed(void *arg __attribute__((unused)))
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        fetch_add_relaxed(&atomic_counter, INCREMENT);
+        cs_work();
+    }
+
+    return NULL;
+}
+
+void *
+dec_atomic_relaxed(void *arg __attribute__((unused)))
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        fetch_sub_relaxed(&atomic_counter, DECREMENT);
+        cs_work();
+    }
+
+    return NULL;
+}
+
+/* Sharded counter, every thread adds to a slot of its own (arg points to the
+   numeric thread id) and the slots are summed when the test is over. */
+
+sharded_counter_t sharded; // Initialized by main().
+
+void sharded_reset()
+{
+    sharded_counter_reset(&sharded);
+}
+
+int sharded_value()
+{
+    return sharded_counter_read(&sharded);
+}
+
+void *
+inc_sharded(void *arg)
+{
+    int shard = *(int *) arg;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        sharded_counter_add(&sharded, shard, INCREMENT);
+        cs_work();
+    }
+
+    return NULL;
+}
+
+void *
+dec_sharded(void *arg)
+{
+    int shard = *(int *) arg;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        sharded_counter_add(&sharded, shard, -DECREMENT);
+        cs_work();
+    }
+
+    return NULL;
+}
+
+/*******************************************************************************
+                  Test 4 - Spinlocks that scale under contention
+*******************************************************************************/
+
+/* The locks are implemented in locks.c, see locks.h. */
+
+ttas_lock_t ttas = TTAS_LOCK_INITIALIZER;
+ticket_lock_t ticket = TICKET_LOCK_INITIALIZER;
+mcs_lock_t mcs = MCS_LOCK_INITIALIZER;
+clh_lock_t clh; // Initialized by main().
+
+/* Test-and-test-and-set with exponential backoff */
+void *
+inc_ttas(void *arg __attribute__((unused)))
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        ttas_lock(&ttas);
+        counter += INCREMENT;
+        cs_work();
+        ttas_unlock(&ttas);
+    }
+
+    return NULL;
+}
+
+void *
+dec_ttas(void *arg __attribute__((unused)))
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        ttas_lock(&ttas);
+        counter -= DECREMENT;
+        cs_work();
+        ttas_unlock(&ttas);
+    }
+
+    return NULL;
+}
+
+/* Ticket lock, the threads get the lock in the order they asked for it */
+void *
+inc_ticket(void *arg __attribute__((unused)))
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        ticket_lock(&ticket);
+        counter += INCREMENT;
+        cs_work();
+        ticket_unlock(&ticket);
+    }
+
+    return NULL;
+}
+
+void *
+dec_ticket(void *arg __attribute__((unused)))
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        ticket_lock(&ticket);
+        counter -= DECREMENT;
+        cs_work();
+        ticket_unlock(&ticket);
+    }
+
+    return NULL;
+}
+
+/* MCS queue lock, every thread spins on its own queue node */
+void *
+inc_mcs(void *arg __attribute__((unused)))
+{
+    mcs_node_t node;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        mcs_lock(&mcs, &node);
+        counter += INCREMENT;
+        cs_work();
+        mcs_unlock(&mcs, &node);
+    }
+
+    return NULL;
+}
+
+void *
+dec_mcs(void *arg __attribute__((unused)))
+{
+    mcs_node_t node;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        mcs_lock(&mcs, &node);
+        counter -= DECREMENT;
+        cs_work();
+        mcs_unlock(&mcs, &node);
+    }
+
+    return NULL;
+}
+
+/* CLH queue lock, every thread spins on the node of its predecessor */
+void *
+inc_clh(void *arg __attribute__((unused)))
+{
+    clh_node_t *node = clh_node_new();
+
+    for (int i = 0; i < iterations; i++)
+    {
+        clh_lock(&clh, &node);
+        counter += INCREMENT;
+        cs_work();
+        clh_unlock(&clh, &node);
+    }
+
+    clh_node_free(node);
+
+    return NULL;
+}
+
+void *
+dec_clh(void *arg __attribute__((unused)))
+{
+    clh_node_t *node = clh_node_new();
+
+    for (int i = 0; i < iterations; i++)
+    {
+        clh_lock(&clh, &node);
+        counter -= DECREMENT;
+        cs_work();
+        clh_unlock(&clh, &node);
+    }
+
+    clh_node_free(node);
+
+    return NULL;
+}
+
+/*******************************************************************************
+                         Test 5 - Read-mostly shared data
+*******************************************************************************/
+
+/*
+  Most operations only read the shared value, one in every period operations
+  adds to it. A write adds delta times the number of operations since the
+  previous write, so the value ends up the same as when every operation
+  writes. Along with the value writers store its negation in mirror, and every
+  read checks that it sees both halves of the same write.
+*/
+
+typedef enum {RM_TTAS, RM_RW_LOCK, RM_SEQLOCK} rm_lock_kind_t;
+
+rw_lock_t rw = RW_LOCK_INITIALIZER;
+seqlock_t seq = SEQLOCK_INITIALIZER;
+
+atomic_int rm_value, rm_mirror;
+atomic_bool rm_torn; // Set if a read saw half a write.
+
+void rm_reset()
+{
+    store_relaxed(&rm_value, 0);
+    store_relaxed(&rm_mirror, 0);
+    store_relaxed(&rm_torn, false);
+}
+
+/* A torn read makes the test fail by returning a wrong value. */
+int rm_value_or_torn()
+{
+    return load_relaxed(&rm_value) + (load_relaxed(&rm_torn) ? 1 : 0);
+}
+
+static void rm_write(rm_lock_kind_t kind, int delta)
+{
+    if (kind == RM_TTAS) ttas_lock(&ttas);
+    else if (kind == RM_RW_LOCK) rw_write_lock(&rw);
+    else seqlock_write_lock(&seq);
+
+    int value = load_relaxed(&rm_value) + delta;
+    store_relaxed(&rm_value, value);
+    store_relaxed(&rm_mirror, -value);
+    cs_work();
+
+    if (kind == RM_TTAS) ttas_unlock(&ttas);
+    else if (kind == RM_RW_LOCK) rw_write_unlock(&rw);
+    else seqlock_write_unlock(&seq);
+}
+
+static void rm_read(rm_lock_kind_t kind)
+{
+    int value, mirror;
+
+    if (kind == RM_SEQLOCK)
+    {
+        unsigned int start;
+
+        do
+        {
+            start = seqlock_read_begin(&seq);
+            value = load_relaxed(&rm_value);
+            mirror = load_relaxed(&rm_mirror);
+            cs_work();
+        } while (seqlock_read_retry(&seq, start));
+    }
+    else
+    {
+        if (kind == RM_TTAS) ttas_lock(&ttas);
+        else rw_read_lock(&rw);
+
+        value = load_relaxed(&rm_value);
+        mirror = load_relaxed(&rm_mirror);
+        cs_work();
+
+        if (kind == RM_TTAS) ttas_unlock(&ttas);
+        else rw_read_unlock(&rw);
+    }
+
+    if (value != -mirror) store_relaxed(&rm_torn, true);
+}
+
+static void read_mostly(rm_lock_kind_t kind, int period, int delta)
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        if (i % period == 0)
+            rm_write(kind, delta * (iterations - i < period ? iterations - i : period));
+        else
+            rm_read(kind);
+    }
+}
+
+/* Exclusive lock for readers and writers alike, 95% reads */
+void *
+inc_ttas_95(void *arg __attribute__((unused)))
+{
+    read_mostly(RM_TTAS, 20, INCREMENT);
+    return NULL;
+}
+
+void *
+dec_ttas_95(void *arg __attribute__((unused)))
+{
+    read_mostly(RM_TTAS, 20, -DECREMENT);
+    return NULL;
+}
+
+/* Writer-preferring reader-writer spinlock, 95% and 99% reads */
+void *
+inc_rw_95(void *arg __attribute__((unused)))
+{
+    read_mostly(RM_RW_LOCK, 20, INCREMENT);
+    return NULL;
+}
+
+void *
+dec_rw_95(void *arg __attribute__((unused)))
+{
+    read_mostly(RM_RW_LOCK, 20, -DECREMENT);
+    return NULL;
+}
+
+void *
+inc_rw_99(void *arg __attribute__((unused)))
+{
+    read_mostly(RM_RW_LOCK, 100, INCREMENT);
+    return NULL;
+}
+
+void *
+dec_rw_99(void *arg __attribute__((unused)))
+{
+    read_mostly(RM_RW_LOCK, 100, -DECREMENT);
+    return NULL;
+}
+
+/* Seqlock, readers retry instead of locking, 95% and 99% reads */
+void *
+inc_seq_95(void *arg __attribute__((unused)))
+{
+    read_mostly(RM_SEQLOCK, 20, INCREMENT);
+    return NULL;
+}
+
+void *
+dec_seq_95(void *arg __attribute__((unused)))
+{
+    read_mostly(RM_SEQLOCK, 20, -DECREMENT);
+    return NULL;
+}
+
+void *
+inc_seq_99(void *arg __attribute__((unused)))
+{
+    read_mostly(RM_SEQLOCK, 100, INCREMENT);
+    return NULL;
+}
+
+void *
+dec_seq_99(void *arg __attribute__((unused)))
+{
+    read_mostly(RM_SEQLOCK, 100, -DECREMENT);
+    return NULL;
+}
+
 /*******************************************************************************
  *******************************************************************************
             NOTE: You don't need to modify anything below this line
@@ -210,18 +700,50 @@ typedef struct
     char *name;           // Test case name.
     void *(*inc)(void *); // Increment function.
     void *(*dec)(void *); // Decrement function.
-    double total_time;    // Total runtime;
-    double average_time;  // Average execution time per thread.
-    int counter;          // Final value of the shared counter.
+    void (*reset)();      // Resets the counter, NULL to set counter to 0.
+    int (*value)();       // Reads the counter, NULL to read counter.
 } test_t;
 
 test_t tests[] = {
     {.inc = inc_no_sync, .dec = dec_no_sync, .name = "No synchronization"},
     {.inc = inc_mutex, .dec = dec_mutex, .name = "Pthread mutex"},
     {.inc = inc_tas_spinlock, .dec = dec_tas_spinlock, .name = "Spinlock"},
-    {.inc = inc_atomic, .dec = dec_atomic, .name = "Atomic add/sub"},
+    {.inc = inc_tas_spinlock_seq_cst, .dec = dec_tas_spinlock_seq_cst, .name = "Spinlock seq_cst"},
+    {.inc = inc_atomic, .dec = dec_atomic, .reset = atomic_reset, .value = atomic_value,
+     .name = "Atomic add/sub"},
+    {.inc = inc_atomic_relaxed, .dec = dec_atomic_relaxed, .reset = atomic_reset,
+     .value = atomic_value, .name = "Atomic relaxed"},
+    {.inc = inc_sharded, .dec = dec_sharded, .reset = sharded_reset, .value = sharded_value,
+     .name = "Sharded counter"},
+    {.inc = inc_ttas, .dec = dec_ttas, .name = "TTAS with backoff"},
+    {.inc = inc_ticket, .dec = dec_ticket, .name = "Ticket lock"},
+    {.inc = inc_mcs, .dec = dec_mcs, .name = "MCS lock"},
+    {.inc = inc_clh, .dec = dec_clh, .name = "CLH lock"},
+    {.inc = inc_ttas_95, .dec = dec_ttas_95, .reset = rm_reset, .value = rm_value_or_torn,
+     .name = "TTAS 95/5"},
+    {.inc = inc_rw_95, .dec = dec_rw_95, .reset = rm_reset, .value = rm_value_or_torn,
+     .name = "RW lock 95/5"},
+    {.inc = inc_rw_99, .dec = dec_rw_99, .reset = rm_reset, .value = rm_value_or_torn,
+     .name = "RW lock 99/1"},
+    {.inc = inc_seq_95, .dec = dec_seq_95, .reset = rm_reset, .value = rm_value_or_torn,
+     .name = "Seqlock 95/5"},
+    {.inc = inc_seq_99, .dec = dec_seq_99, .reset = rm_reset, .value = rm_value_or_torn,
+     .name = "Seqlock 99/1"},
     {.inc = NULL, .dec = NULL, .name = NULL}};
 
+/* Benchmark configuration, see usage(). */
+
+typedef enum {TEXT, CSV, JSON} format_t;
+
+static int max_threads = INC_THREADS + DEC_THREADS;
+static bool sweep = true;
+static int repetitions = 5;
+static int warmups = 1;
+static char *placement = "compact";
+static affinity_t affinity;
+static format_t format = TEXT;
+static char *only = NULL;
+
 // Information about each thread will be kept in the following struct.
 
 typedef struct
@@ -242,20 +764,29 @@ typedef struct
     void *arg;
     // Total runtime of the thread.
     double run_time;
+    // Latencies of the operations of the thread, with -l.
+    histogram_t *latency;
 } thread_t;
 
-char *type2string(enum type type)
+/* The result of all repetitions of a test case with a given number of
+   threads. Throughput is in iterations per second, summed over all threads. */
+
+typedef struct
 {
-    switch (type)
-    {
-    case inc:
-        return "inc";
-    case dec:
-        return "dec";
-    default:
-        return "???";
-    }
-}
+    test_t *test;
+    int nthreads;
+    double median;       // Median throughput.
+    double min;
+    double max;
+    bool correct;        // The counter had the expected value every time.
+    uint64_t p50_ns;     // Operation latency percentiles over all
+    uint64_t p99_ns;     // repetitions, with -l.
+    uint64_t p999_ns;
+    int nodes;           // NUMA nodes the threads ran on, 0 if not pinned.
+} result_t;
+
+/* Set by run_once() when all threads have been created. */
+static atomic_bool go = false;
 
 /* The startroutine used by both increment and decrement threads. */
 void *
@@ -264,6 +795,17 @@ generic_thread(void *_conf)
     struct timespec ts;
     thread_t *conf = (thread_t *)_conf;
 
+    affinity_pin(&affinity, conf->id);
+
+    // First touched here, so allocated on the node of the thread.
+    if (conf->latency) histogram_init(conf->latency);
+
+    op_latency = conf->latency;
+    op_last = 0;
+
+    // All threads start at the same time.
+    while (!load_acquire(&go)) cpu_relax();
+
     timing_start(&ts);
 
     conf->start_routine(conf->arg);
@@ -273,145 +815,313 @@ generic_thread(void *_conf)
     pthread_exit(0);
 }
 
-double
-print_stats(thread_t *threads, int nthreads, int niterations, test_t *test)
+/* Runs test once with nthreads threads, the first half of them incrementing.
+   Returns the throughput in iterations per second, *correct is set if the
+   counter ended up with the expected value. With -l the latencies of the
+   operations of all threads are added to latency, unless it is NULL. */
+double run_once(test_t *test, int nthreads, bool *correct, histogram_t *latency)
 {
-    double run_time_sum = 0;
-    double average_execution_time = 0;
+    thread_t threads[nthreads];
+    int ninc = (nthreads + 1) / 2;
+    struct timespec ts;
+
+    if (test->reset) test->reset();
+    else counter = 0;
+    store_relaxed(&go, false);
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        thread_t *thread = &threads[i];
+        thread->latency = measure_latency ? affinity_alloc(sizeof(histogram_t)) : NULL;
+        thread->id = i;
+        thread->type = i < ninc ? inc : dec;
+        thread->start_routine = i < ninc ? test->inc : test->dec;
+        thread->arg = &thread->id;
+        if (pthread_create(&thread->tid, NULL, generic_thread, thread) != 0)
+        {
+            perror("pthread_create");
+            abort();
+        }
+    }
+
+    timing_start(&ts);
+    store_release(&go, true);
+
+    /* Wait for all threads to terminate */
 
-    printf("\nStatistics:\n\n");
     for (int i = 0; i < nthreads; i++)
+        if (pthread_join(threads[i].tid, NULL) != 0)
+        {
+            perror("pthread_join");
+            abort();
+        }
+
+    double run_time = timing_stop(&ts);
+
+    for (int i = 0; measure_latency && i < nthreads; i++)
     {
-        thread_t *t = &threads[i];
-        printf("Thread %i (%s): %.4f sec (%.4e iterations/s)\n",
-               i, type2string(t->type), t->run_time,
-               niterations / nthreads / t->run_time);
-        run_time_sum += t->run_time;
+        if (latency) histogram_merge(latency, threads[i].latency);
+        affinity_free(threads[i].latency, sizeof(histogram_t));
     }
 
-    average_execution_time = run_time_sum / nthreads;
+    int expected = (ninc * INCREMENT - (nthreads - ninc) * DECREMENT) * iterations;
 
-    printf("\nAverage execution time: %.4f s/thread\n"
-           "\nAvergage iterations/second: %.4e iterations/s\n",
-           average_execution_time,
-           niterations / nthreads / run_time_sum);
+    *correct = (test->value ? test->value() : counter) == expected;
 
-    test->total_time = run_time_sum;
-    return average_execution_time;
+    return (double) nthreads * iterations / run_time;
 }
 
-char *successOrFailure(int counter)
+static int compare_doubles(const void *a, const void *b)
 {
-    return (counter == 0) ? "success" : "failure";
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
 }
-void print_stats_summary(test_t tests[])
+
+/* Warms up and then runs test repetitions times with nthreads threads. */
+result_t run_test(test_t *test, int nthreads)
 {
-    test_t *test = tests;
-    int width = 20;
+    double samples[repetitions];
+    result_t result = {.test = test, .nthreads = nthreads, .correct = true,
+                       .nodes = affinity_nodes(&affinity, nthreads)};
+    histogram_t *latency = NULL;
+    bool correct;
 
-    printf("\n\n=========================================================================================\n\n");
-    printf("                                       SUMMARY\n\n\n");
+    if (measure_latency)
+    {
+        if ((latency = malloc(sizeof(histogram_t))) == NULL)
+        {
+            perror("malloc");
+            abort();
+        }
+        histogram_init(latency);
+    }
 
-    printf("%*s                             Total run      Average execution time\n", width, "");
-    printf("%*s     Counter     Result      time (sec)     per thread (sec/thread)\n", width, "Test Case");
-    printf("-----------------------------------------------------------------------------------------\n");
+    for (int i = 0; i < warmups; i++)
+    {
+        run_once(test, nthreads, &correct, NULL);
+    }
 
-    while (test->inc && test->dec)
+    for (int i = 0; i < repetitions; i++)
     {
-        printf("%*s     %-10d  %s     %f       %f\n",
-               width,
-               test->name,
-               test->counter,
-               successOrFailure(test->counter),
-               test->total_time,
-               test->average_time);
-        test++;
+        samples[i] = run_once(test, nthreads, &correct, latency);
+        result.correct = result.correct && correct;
     }
-}
 
-void run_test(test_t *test)
-{
-    int i, nthreads = 0;
-    thread_t threads[INC_THREADS + DEC_THREADS];
-    double average_execution_time = 0;
+    if (latency)
+    {
+        result.p50_ns = histogram_percentile(latency, 0.5);
+        result.p99_ns = histogram_percentile(latency, 0.99);
+        result.p999_ns = histogram_percentile(latency, 0.999);
+        free(latency);
+    }
 
-    pthread_setconcurrency(INC_THREADS + DEC_THREADS);
+    qsort(samples, repetitions, sizeof(double), compare_doubles);
 
-    counter = 0;
+    result.min = samples[0];
+    result.max = samples[repetitions - 1];
+    result.median = repetitions % 2 ? samples[repetitions / 2]
+        : (samples[repetitions / 2 - 1] + samples[repetitions / 2]) / 2;
 
-    pthread_setconcurrency(INC_THREADS + DEC_THREADS + 1);
+    return result;
+}
+
+char *successOrFailure(bool correct)
+{
+    return correct ? "success" : "failure";
+}
 
-    /* Create the incrementing threads */
+void print_header()
+{
+    char description[256];
 
-    for (i = 0; i < INC_THREADS; i++)
+    switch (format)
     {
-        thread_t *thread = &threads[nthreads];
-        thread->id = nthreads;
-        thread->type = inc;
-        thread->start_routine = test->inc;
-        if (pthread_create(&thread->tid, NULL, generic_thread, thread) != 0)
-        {
-            perror("pthread_create");
-            abort();
-        }
-        nthreads++;
+    case TEXT:
+        affinity_describe(&affinity, max_threads, description, sizeof(description));
+        printf("%d iterations per thread, critical section length %d, "
+               "%d repetitions after %d warm up runs\nThreads %s (%s)\n\n",
+               iterations, cs_length, repetitions, warmups,
+               affinity.policy != AFFINITY_NONE ? "pinned" : "not pinned", description);
+        printf("%20s  %7s  %5s  %-7s  %14s  %14s  %14s", "Test Case", "Threads", "Nodes", "Result",
+               "Median (it/s)", "Min (it/s)", "Max (it/s)");
+        if (measure_latency) printf("  %10s  %10s  %10s", "p50 (ns)", "p99 (ns)", "p999 (ns)");
+        printf("\n-------------------------------------------------------------------------------------------------");
+        if (measure_latency) printf("--------------------------------------");
+        printf("\n");
+        break;
+    case CSV:
+        printf("test,threads,iterations,cs_length,repetitions,pinned,affinity,nodes,result,"
+               "median,min,max%s\n",
+               measure_latency ? ",p50_ns,p99_ns,p999_ns" : "");
+        break;
+    case JSON:
+        printf("[");
+        break;
     }
+}
 
-    /* Create the decrementing threads */
-
-    for (i = 0; i < DEC_THREADS; i++)
+void print_result(result_t *r, bool first)
+{
+    switch (format)
     {
-        thread_t *thread = &threads[nthreads];
-        thread->id = nthreads;
-        thread->type = dec;
-        thread->start_routine = test->dec;
-        if (pthread_create(&thread->tid, NULL, generic_thread, thread) != 0)
-        {
-            perror("pthread_create");
-            abort();
-        }
-        nthreads++;
+    case TEXT:
+        printf("%20s  %7d  %5d  %-7s  %14.4e  %14.4e  %14.4e", r->test->name,
+               r->nthreads, r->nodes, successOrFailure(r->correct), r->median, r->min, r->max);
+        if (measure_latency)
+            printf("  %10" PRIu64 "  %10" PRIu64 "  %10" PRIu64, r->p50_ns, r->p99_ns, r->p999_ns);
+        printf("\n");
+        break;
+    case CSV:
+        printf("\"%s\",%d,%d,%d,%d,%d,\"%s\",%d,%s,%.6e,%.6e,%.6e", r->test->name, r->nthreads,
+               iterations, cs_length, repetitions, affinity.policy != AFFINITY_NONE, placement,
+               r->nodes, successOrFailure(r->correct),
+               r->median, r->min, r->max);
+        if (measure_latency) printf(",%" PRIu64 ",%" PRIu64 ",%" PRIu64,
+                                    r->p50_ns, r->p99_ns, r->p999_ns);
+        printf("\n");
+        break;
+    case JSON:
+        printf("%s\n  {\"test\": \"%s\", \"threads\": %d, \"iterations\": %d, "
+               "\"cs_length\": %d, \"repetitions\": %d, \"pinned\": %s, \"affinity\": \"%s\", "
+               "\"nodes\": %d, \"result\": \"%s\", "
+               "\"median\": %.6e, \"min\": %.6e, \"max\": %.6e",
+               first ? "" : ",", r->test->name, r->nthreads, iterations, cs_length,
+               repetitions, affinity.policy != AFFINITY_NONE ? "true" : "false", placement,
+               r->nodes, successOrFailure(r->correct),
+               r->median, r->min, r->max);
+        if (measure_latency)
+            printf(", \"p50_ns\": %" PRIu64 ", \"p99_ns\": %" PRIu64 ", \"p999_ns\": %" PRIu64,
+                   r->p50_ns, r->p99_ns, r->p999_ns);
+        printf("}");
+        break;
     }
+    fflush(stdout);
+}
 
-    /* Wait for all threads to terminate */
+void print_footer()
+{
+    if (format == JSON) printf("\n]\n");
+}
 
-    for (i = 0; i < nthreads; i++)
-        if (pthread_join(threads[i].tid, NULL) != 0)
-        {
-            perror("pthread_join");
-            abort();
-        }
-    printf("\n==========================================================================\n");
-    printf("%s\n\n", test->name);
-    printf("Counter expected value:%10d\n", 0);
-    printf("Counter actual value:  %10d\n", counter);
+void usage(char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [-t threads] [-f] [-i iterations] [-w length] [-r repetitions]\n"
+            "          [-W warmups] [-a placement] [-n] [-l] [-o text|csv|json] [-T test] [-h]\n\n"
+            "  -t threads     maximum number of threads (default %d)\n"
+            "  -f             only run with the maximum number of threads, no sweep\n"
+            "  -i iterations  iterations per thread (default %d)\n"
+            "  -w length      critical section length in pause loop iterations (default 0)\n"
+            "  -r repetitions measured runs per test and thread count (default 5)\n"
+            "  -W warmups     unmeasured runs before the measured ones (default 1)\n"
+            "  -a placement   compact, scatter, none or a CPU list such as 0,2,4-7\n"
+            "                 (default compact), see affinity.h\n"
+            "  -n             do not pin the threads to CPUs, same as -a none\n"
+            "  -l             also report the latency of single operations\n"
+            "  -o format      output format (default text)\n"
+            "  -T test        only run test cases whose name contains test\n",
+            program, INC_THREADS + DEC_THREADS, INC_ITERATIONS);
+}
 
-    test->counter = counter;
+void parse_args(int argc, char *argv[])
+{
+    int opt;
 
-    if (counter != 0)
+    while ((opt = getopt(argc, argv, "t:fi:w:r:W:a:nlo:T:h")) != -1)
     {
-        printf("\nFAILURE :-(\n");
+        switch (opt)
+        {
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'f':
+            sweep = false;
+            break;
+        case 'i':
+            iterations = atoi(optarg);
+            break;
+        case 'w':
+            cs_length = atoi(optarg);
+            break;
+        case 'r':
+            repetitions = atoi(optarg);
+            break;
+        case 'W':
+            warmups = atoi(optarg);
+            break;
+        case 'n':
+            placement = "none";
+            break;
+        case 'a':
+            placement = optarg;
+            break;
+        case 'l':
+            measure_latency = true;
+            break;
+        case 'o':
+            if (strcmp(optarg, "text") == 0) format = TEXT;
+            else if (strcmp(optarg, "csv") == 0) format = CSV;
+            else if (strcmp(optarg, "json") == 0) format = JSON;
+            else
+            {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'T':
+            only = optarg;
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
     }
-    else
+
+    if (max_threads < 1 || iterations < 1 || cs_length < 0 || repetitions < 1 || warmups < 0)
     {
-        printf("\nSUCCES :-)\n");
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
     }
 
-    average_execution_time = print_stats(threads, nthreads, INC_ITERATIONS + DEC_ITERATIONS, test);
-    test->average_time = average_execution_time;
+    if (!affinity_init(&affinity, placement))
+    {
+        fprintf(stderr, "Invalid placement %s\n", placement);
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
 }
 
-int main()
+int main(int argc, char *argv[])
 {
-    test_t *test = tests;
+    bool first = true;
+
+    parse_args(argc, argv);
+    if (measure_latency) timing_calibrate();
+    clh_init(&clh);
+    sharded_counter_init(&sharded, max_threads);
 
-    while (test->inc && test->dec)
+    print_header();
+
+    for (test_t *test = tests; test->inc && test->dec; test++)
     {
-        run_test(test);
-        test++;
+        if (only != NULL && strstr(test->name, only) == NULL) continue;
+
+        for (int nthreads = sweep ? 1 : max_threads; nthreads <= max_threads; nthreads++)
+        {
+            result_t result = run_test(test, nthreads);
+            print_result(&result, first);
+            first = false;
+        }
     }
 
-    print_stats_summary(tests);
+    print_footer();
+
+    clh_destroy(&clh);
+    sharded_counter_destroy(&sharded);
+    affinity_destroy(&affinity);
 
     exit(EXIT_SUCCESS);
 }
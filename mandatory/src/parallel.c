@@ -0,0 +1,140 @@
+#include "parallel.h"
+
+#include <stdio.h>   // perror()
+#include <stdlib.h>  // malloc(), posix_memalign(), free(), exit()
+#include <string.h>  // memcpy()
+
+/* One chunk of a loop, the argument of its task. */
+typedef struct {
+  size_t      begin;
+  size_t      end;
+  range_fn_t  fn;      // parallel_for()
+  reduce_fn_t reduce;  // parallel_reduce()
+  void        *arg;
+  void        *partial;
+} chunk_t;
+
+static void *chunk_task(void *arg) {
+  chunk_t *chunk = arg;
+
+  if (chunk->reduce != NULL) {
+    chunk->reduce(chunk->begin, chunk->end, chunk->arg, chunk->partial);
+  } else {
+    chunk->fn(chunk->begin, chunk->end, chunk->arg);
+  }
+
+  return NULL;
+}
+
+static size_t round_up(size_t x, size_t multiple) {
+  return (x + multiple - 1) / multiple * multiple;
+}
+
+static size_t chunk_size(pool_t *pool, size_t n, size_t grain) {
+  if (grain == 0) {
+    size_t chunks = (size_t) pool->nworkers * PARALLEL_CHUNKS_PER_WORKER;
+    grain = (n + chunks - 1) / chunks;
+    if (grain < PARALLEL_MIN_GRAIN) grain = PARALLEL_MIN_GRAIN;
+  }
+
+  return round_up(grain, CACHE_LINE);
+}
+
+static void *xmalloc(size_t size) {
+  void *p = malloc(size);
+
+  if (p == NULL) {
+    perror("Could not allocate loop");
+    exit(EXIT_FAILURE);
+  }
+
+  return p;
+}
+
+/* Runs the chunks, all but the last one as tasks and the last one in the
+   calling thread, which would otherwise just wait. */
+static void run_chunks(pool_t *pool, chunk_t *chunks, size_t nchunks) {
+  future_t **futures = xmalloc(nchunks * sizeof(future_t *));
+
+  for (size_t i = 0; i < nchunks - 1; i++) {
+    futures[i] = pool_submit(pool, chunk_task, &chunks[i]);
+  }
+
+  chunk_task(&chunks[nchunks - 1]);
+
+  for (size_t i = 0; i < nchunks - 1; i++) {
+    future_get(futures[i]);
+    future_destroy(futures[i]);
+  }
+
+  free(futures);
+}
+
+static chunk_t *split(pool_t *pool, size_t n, size_t grain, size_t *nchunks) {
+  size_t size = chunk_size(pool, n, grain);
+
+  *nchunks = (n + size - 1) / size;
+
+  chunk_t *chunks = xmalloc(*nchunks * sizeof(chunk_t));
+
+  for (size_t i = 0; i < *nchunks; i++) {
+    chunks[i] = (chunk_t) {
+      .begin = i * size,
+      .end = (i + 1) * size < n ? (i + 1) * size : n
+    };
+  }
+
+  return chunks;
+}
+
+void parallel_for(pool_t *pool, size_t n, size_t grain, range_fn_t fn, void *arg) {
+  size_t nchunks;
+
+  if (n == 0) return;
+
+  chunk_t *chunks = split(pool, n, grain, &nchunks);
+
+  for (size_t i = 0; i < nchunks; i++) {
+    chunks[i].fn = fn;
+    chunks[i].arg = arg;
+  }
+
+  run_chunks(pool, chunks, nchunks);
+
+  free(chunks);
+}
+
+void parallel_reduce(pool_t *pool, size_t n, size_t grain, void *result, size_t size,
+                     reduce_fn_t reduce, combine_fn_t combine, void *arg) {
+  size_t nchunks;
+  void *partials;
+
+  if (n == 0) return;
+
+  chunk_t *chunks = split(pool, n, grain, &nchunks);
+
+  // Every partial on cache lines of its own, chunks of a busy loop would
+  // otherwise keep stealing each other's partials.
+  size_t stride = round_up(size, CACHE_LINE);
+
+  if (posix_memalign(&partials, CACHE_LINE, nchunks * stride) != 0) {
+    perror("Could not allocate partial results");
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < nchunks; i++) {
+    chunks[i].reduce = reduce;
+    chunks[i].arg = arg;
+    chunks[i].partial = (char *) partials + i * stride;
+    memcpy(chunks[i].partial, result, size);
+  }
+
+  run_chunks(pool, chunks, nchunks);
+
+  for (size_t i = 0; i < nchunks; i++) {
+    combine(result, chunks[i].partial, arg);
+  }
+
+  free(partials);
+  free(chunks);
+}
@@ -0,0 +1,63 @@
+/**
+ * Parallel loops over the thread pool.
+ *
+ * parallel_for() and parallel_reduce() split the index range [0, n) into
+ * chunks, one task per chunk, and run the tasks on a pool. Chunks are a
+ * multiple of CACHE_LINE indices long, so when the indices are bytes of a
+ * cache line aligned buffer no two tasks ever write the same cache line.
+ *
+ * The chunks are large enough to amortize the cost of a task and small enough
+ * to give every worker several of them, so a worker that falls behind doesn't
+ * hold up the whole loop.
+ *
+ * Both can be called from a task, the calling worker then executes chunks
+ * while it waits.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h> // size_t
+
+#include "pool.h"   // pool_t
+
+/* Smallest number of indices in a chunk when the grain is left to
+   parallel_for() and parallel_reduce(). */
+#define PARALLEL_MIN_GRAIN (64 * 1024)
+
+/* Number of chunks per worker aimed for when the grain is left to
+   parallel_for() and parallel_reduce(). */
+#define PARALLEL_CHUNKS_PER_WORKER 4
+
+/* Works on the indices [begin, end). */
+typedef void (*range_fn_t)(size_t begin, size_t end, void *arg);
+
+/* Accumulates the indices [begin, end) into partial. */
+typedef void (*reduce_fn_t)(size_t begin, size_t end, void *arg, void *partial);
+
+/* Adds partial to result. */
+typedef void (*combine_fn_t)(void *result, const void *partial, void *arg);
+
+/* parallel_for(pool, n, grain, fn, arg)
+
+   Calls fn(begin, end, arg) for consecutive ranges covering [0, n) and waits
+   for all calls to return. Ranges are grain indices long, rounded up to a
+   multiple of CACHE_LINE, except for the last one. A grain of 0 picks one
+   based on n and the number of workers.
+*/
+void parallel_for(pool_t *pool, size_t n, size_t grain, range_fn_t fn, void *arg);
+
+/* parallel_reduce(pool, n, grain, result, size, reduce, combine, arg)
+
+   Reduces [0, n) into result, which holds size bytes. Chunks are split as
+   for parallel_for(). Every chunk gets a partial result of its own, a copy of
+   the initial value of result, which must therefore be the identity of
+   combine (0 for a sum). reduce(begin, end, arg, partial) accumulates a chunk
+   into its partial, and the partials are then combined into result with
+   combine(result, partial, arg), in the order of the chunks, so combine
+   needs to be associative but not commutative.
+*/
+void parallel_reduce(pool_t *pool, size_t n, size_t grain, void *result, size_t size,
+                     reduce_fn_t reduce, combine_fn_t combine, void *arg);
+
+#endif
@@ -0,0 +1,214 @@
+/**
+ * Unit test for the parallel loops and the text kernels.
+ */
+
+#include "parallel.h"
+#include "text.h"
+#include "timing.h"  // timing_start(), timing_stop()
+
+#include <stdio.h>   // printf(), setbuf(), stdout
+#include <stdlib.h>  // malloc(), calloc(), free(), rand()
+#include <string.h>  // memcpy(), memcmp(), memset()
+#include <assert.h>  // assert()
+
+#define TEST_HEADER printf("\n==== %s ====\n\n", __FUNCTION__)
+
+#define WORKERS 4
+
+/* Size of the text of the throughput test. */
+#define BIG (64 * 1024 * 1024)
+
+void success() {
+  printf("\nTest SUCCESSFUL :-)\n\n");
+}
+
+pool_t pool;
+
+void visit(size_t begin, size_t end, void *arg) {
+  unsigned char *visits = arg;
+
+  for (size_t i = begin; i < end; i++) visits[i]++;
+}
+
+/* Every index visited exactly once, whatever the grain. */
+void for_test() {
+  TEST_HEADER;
+
+  size_t sizes[] = {0, 1, 127, 128, 129, 100000, 1000003};
+  size_t grains[] = {0, 1, 128, 1000, 65536};
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    size_t n = sizes[s];
+    unsigned char *visits = calloc(n + 1, 1);
+
+    for (size_t g = 0; g < sizeof(grains) / sizeof(grains[0]); g++) {
+      memset(visits, 0, n);
+      parallel_for(&pool, n, grains[g], visit, visits);
+
+      for (size_t i = 0; i < n; i++) assert(visits[i] == 1);
+    }
+
+    free(visits);
+  }
+
+  success();
+}
+
+/* A reduction that is associative but not commutative, the range covered so
+   far. Combining out of order or overlapping chunks trips an assert. */
+typedef struct {
+  size_t begin;
+  size_t end;
+} range_t;
+
+void extend(size_t begin, size_t end, void *arg, void *partial) {
+  range_t *range = partial;
+
+  // Chunks start at multiples of the cache line.
+  assert(begin % CACHE_LINE == 0);
+
+  (void) arg;
+
+  // Every chunk starts from the identity.
+  assert(range->begin == range->end);
+  *range = (range_t) {begin, end};
+}
+
+void concatenate(void *result, const void *partial, void *arg) {
+  range_t *range = result;
+  const range_t *next = partial;
+
+  (void) arg;
+
+  if (range->begin == range->end) {
+    *range = *next;
+  } else {
+    assert(range->end == next->begin);
+    range->end = next->end;
+  }
+}
+
+void reduce_test() {
+  TEST_HEADER;
+
+  size_t sizes[] = {1, 129, 100000, 1000003};
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    range_t range = {0, 0};
+
+    parallel_reduce(&pool, sizes[s], 1000, &range, sizeof(range), extend, concatenate, NULL);
+    assert(range.begin == 0 && range.end == sizes[s]);
+  }
+
+  success();
+}
+
+size_t count_reference(const char *s, size_t n, char c) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; i++) count += s[i] == c;
+  return count;
+}
+
+void case_reference(char *s, size_t n, int upper) {
+  for (size_t i = 0; i < n; i++) {
+    if (upper && s[i] >= 'a' && s[i] <= 'z') s[i] -= 0x20;
+    if (!upper && s[i] >= 'A' && s[i] <= 'Z') s[i] += 0x20;
+  }
+}
+
+/* The vector kernels agree with a byte at a time at every length and
+   alignment, for all byte values. */
+void kernel_test() {
+  TEST_HEADER;
+
+  char text[8192 + 64], copy[8192 + 64], expected[8192 + 64];
+
+  for (size_t i = 0; i < sizeof(text); i++) {
+    text[i] = i % 7 == 0 ? ' ' : (char) rand();
+  }
+
+  for (size_t offset = 0; offset < 17; offset++) {
+    for (size_t n = 0; n + offset <= sizeof(text); n += n < 100 ? 1 : 997) {
+      assert(text_count(text + offset, n, ' ') == count_reference(text + offset, n, ' '));
+      assert(text_count(text + offset, n, 'q') == count_reference(text + offset, n, 'q'));
+
+      for (int upper = 0; upper <= 1; upper++) {
+        memcpy(copy, text, sizeof(text));
+        memcpy(expected, text, sizeof(text));
+
+        if (upper) {
+          text_to_upper(copy + offset, n);
+        } else {
+          text_to_lower(copy + offset, n);
+        }
+        case_reference(expected + offset, n, upper);
+
+        assert(memcmp(copy, expected, sizeof(text)) == 0);
+      }
+    }
+  }
+
+  success();
+}
+
+/* The parallel versions agree with the sequential ones on a big text, and
+   how long the two take. */
+void throughput_test() {
+  TEST_HEADER;
+
+  char *text = malloc(BIG), *copy = malloc(BIG);
+  struct timespec ts;
+
+  for (size_t i = 0; i < BIG; i++) {
+    text[i] = "The string shared among the threads."[i % 36];
+  }
+  memcpy(copy, text, BIG);
+
+  timing_start(&ts);
+  size_t spaces = text_count(text, BIG, ' ');
+  double count_time = timing_stop(&ts);
+
+  timing_start(&ts);
+  size_t spaces_parallel = text_count_parallel(&pool, text, BIG, ' ');
+  double count_parallel_time = timing_stop(&ts);
+
+  assert(spaces_parallel == spaces);
+  assert(spaces == count_reference(text, BIG, ' '));
+
+  timing_start(&ts);
+  text_to_upper(text, BIG);
+  double upper_time = timing_stop(&ts);
+
+  timing_start(&ts);
+  text_to_upper_parallel(&pool, copy, BIG);
+  double upper_parallel_time = timing_stop(&ts);
+
+  assert(memcmp(text, copy, BIG) == 0);
+
+  text_to_lower_parallel(&pool, copy, BIG);
+  text_to_lower(text, BIG);
+  assert(memcmp(text, copy, BIG) == 0);
+
+  printf("%d MB, %d workers, GB/s\n\n", BIG >> 20, WORKERS);
+  printf("%-12s  %10s  %10s\n", "Kernel", "Sequential", "Parallel");
+  printf("%-12s  %10.2f  %10.2f\n", "count", BIG / count_time / 1E9, BIG / count_parallel_time / 1E9);
+  printf("%-12s  %10.2f  %10.2f\n", "to_upper", BIG / upper_time / 1E9, BIG / upper_parallel_time / 1E9);
+
+  free(text);
+  free(copy);
+
+  success();
+}
+
+int main(void) {
+  setbuf(stdout, NULL);
+
+  pool_init(&pool, WORKERS, 64);
+
+  for_test();
+  reduce_test();
+  kernel_test();
+  throughput_test();
+
+  pool_destroy(&pool);
+}
@@ -0,0 +1,384 @@
+#include "pool.h"
+
+#include <stdio.h>   // fprintf(), perror()
+#include <stdlib.h>  // malloc(), free(), exit()
+#include <string.h>  // memcpy()
+#include <sched.h>   // sched_yield()
+#include <unistd.h>  // sysconf()
+
+/* Number of times an idle worker looks for work before it goes to sleep, if
+   there are fewer workers than cores. */
+#define POOL_SPIN 256
+
+/* Initial capacity of the local queue of a worker, a power of two. */
+#define LOCAL_CAPACITY 64
+
+/* The worker executing the current task, NULL outside the pool. */
+static _Thread_local worker_t *self = NULL;
+
+/*
+  Sleeping and waking up follows the same pattern as in the ring buffer: the
+  sleeper announces itself (sleepers, waiters) and then checks the condition
+  (queued, pending, done) with the mutex held, the waker updates the condition
+  and then checks for sleepers. Both sides issue a full fence in between, so
+  either the sleeper sees the update or the waker sees the sleeper.
+*/
+
+/*******************************************************************************
+                                 Local queues
+*******************************************************************************/
+
+/*
+  Only the owner pushes to its local queue, and the array is allocated with
+  affinity_alloc(), so its pages are first touched, and placed, by the owner.
+*/
+
+static void local_init(worker_t *worker) {
+  ttas_init(&worker->lock);
+  worker->capacity = LOCAL_CAPACITY;
+  worker->tasks = affinity_alloc(LOCAL_CAPACITY * sizeof(task_t));
+  atomic_init(&worker->top, 0);
+  atomic_init(&worker->bottom, 0);
+}
+
+/*
+  The queue is protected by the lock of the worker. top and bottom are atomic
+  only so that the owner and thieves can peek at a queue without taking the
+  lock, all updates are made with the lock held.
+*/
+
+static void local_push(worker_t *worker, task_t *task) {
+  ttas_lock(&worker->lock);
+
+  int top = load_relaxed(&worker->top);
+  int bottom = load_relaxed(&worker->bottom);
+
+  if (bottom - top == worker->capacity) {
+    task_t *tasks = affinity_alloc(2 * worker->capacity * sizeof(task_t));
+
+    for (int i = top; i < bottom; i++) {
+      tasks[i & (2 * worker->capacity - 1)] = worker->tasks[i & (worker->capacity - 1)];
+    }
+
+    affinity_free(worker->tasks, worker->capacity * sizeof(task_t));
+    worker->tasks = tasks;
+    worker->capacity *= 2;
+  }
+
+  worker->tasks[bottom & (worker->capacity - 1)] = *task;
+  store_relaxed(&worker->bottom, bottom + 1);
+
+  ttas_unlock(&worker->lock);
+}
+
+static inline bool local_empty(worker_t *worker) {
+  return load_relaxed(&worker->bottom) == load_relaxed(&worker->top);
+}
+
+/* Takes the newest task, called by the owner. */
+static bool local_pop(worker_t *worker, task_t *task) {
+  bool found = false;
+
+  if (local_empty(worker)) return false;
+
+  ttas_lock(&worker->lock);
+
+  int bottom = load_relaxed(&worker->bottom);
+
+  if (bottom > load_relaxed(&worker->top)) {
+    *task = worker->tasks[(bottom - 1) & (worker->capacity - 1)];
+    store_relaxed(&worker->bottom, bottom - 1);
+    found = true;
+  }
+
+  ttas_unlock(&worker->lock);
+
+  return found;
+}
+
+/* Takes the oldest task, called by other workers. */
+static bool local_steal(worker_t *worker, task_t *task) {
+  bool found = false;
+
+  if (local_empty(worker)) return false;
+
+  ttas_lock(&worker->lock);
+
+  int top = load_relaxed(&worker->top);
+
+  if (load_relaxed(&worker->bottom) > top) {
+    *task = worker->tasks[top & (worker->capacity - 1)];
+    store_relaxed(&worker->top, top + 1);
+    found = true;
+  }
+
+  ttas_unlock(&worker->lock);
+
+  return found;
+}
+
+/*******************************************************************************
+                                  Executing
+*******************************************************************************/
+
+/* Looks for a task in the local queue, the submit queue and the local queues
+   of the other workers, in that order. */
+static bool find_task(pool_t *pool, worker_t *worker, task_t *task) {
+  bool found = (worker != NULL && local_pop(worker, task)) || ring_try_get(&pool->submit, task);
+
+  for (int i = 1; !found && i <= pool->nworkers; i++) {
+    int victim = ((worker ? worker->id : 0) + i) % pool->nworkers;
+    if (&pool->workers[victim] != worker) found = local_steal(&pool->workers[victim], task);
+  }
+
+  if (found) fetch_sub_relaxed(&pool->queued, 1);
+
+  return found;
+}
+
+static void wake_waiters(pool_t *pool) {
+  fence_seq_cst();
+
+  if (load_relaxed(&pool->waiters) > 0) {
+    pthread_mutex_lock(&pool->mutex);
+    pthread_cond_broadcast(&pool->done);
+    pthread_mutex_unlock(&pool->mutex);
+  }
+}
+
+static void run_task(pool_t *pool, task_t *task) {
+  void *result = task->fn(task->arg);
+
+  if (task->future != NULL) {
+    task->future->result = result;
+    store_release(&task->future->done, 1);
+  }
+
+  atomic_fetch_sub_explicit(&pool->pending, 1, memory_order_acq_rel);
+  wake_waiters(pool);
+}
+
+static void *worker_thread(void *arg) {
+  worker_t *worker = arg;
+  pool_t *pool = worker->pool;
+  task_t task;
+  int spins = 0;
+
+  self = worker;
+  affinity_pin(pool->affinity, worker->id);
+
+  while (true) {
+    if (find_task(pool, worker, &task)) {
+      run_task(pool, &task);
+      spins = 0;
+      continue;
+    }
+
+    if (load_acquire(&pool->shutdown)) break;
+
+    if (++spins < pool->spin) {
+      cpu_relax();
+      continue;
+    }
+
+    spins = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    fetch_add_relaxed(&pool->sleepers, 1);
+    fence_seq_cst();
+
+    while (load_relaxed(&pool->queued) <= 0 && !load_relaxed(&pool->shutdown)) {
+      pthread_cond_wait(&pool->work, &pool->mutex);
+    }
+
+    fetch_sub_relaxed(&pool->sleepers, 1);
+    pthread_mutex_unlock(&pool->mutex);
+  }
+
+  return NULL;
+}
+
+/* Waits until done(arg) returns true. Workers keep executing tasks while they
+   wait, anyone else sleeps on the done condition. */
+static void wait_until(pool_t *pool, bool (*done)(void *), void *arg) {
+  if (self != NULL && self->pool == pool) {
+    task_t task;
+
+    while (!done(arg)) {
+      if (find_task(pool, self, &task)) {
+        run_task(pool, &task);
+      } else {
+        sched_yield();
+      }
+    }
+    return;
+  }
+
+  if (done(arg)) return;
+
+  pthread_mutex_lock(&pool->mutex);
+  fetch_add_relaxed(&pool->waiters, 1);
+  fence_seq_cst();
+
+  while (!done(arg)) {
+    pthread_cond_wait(&pool->done, &pool->mutex);
+  }
+
+  fetch_sub_relaxed(&pool->waiters, 1);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+/*******************************************************************************
+                                  Interface
+*******************************************************************************/
+
+void pool_init(pool_t *pool, int nworkers, int queue_size) {
+  pool_init_affinity(pool, nworkers, queue_size, NULL);
+}
+
+void pool_init_affinity(pool_t *pool, int nworkers, int queue_size, const affinity_t *affinity) {
+  if (nworkers == 0) nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (nworkers < 1) {
+    fprintf(stderr, "Number of workers must be positive, got %d\n", nworkers);
+    exit(EXIT_FAILURE);
+  }
+
+  pool->nworkers = nworkers;
+  pool->spin = nworkers < sysconf(_SC_NPROCESSORS_ONLN) ? POOL_SPIN : 0;
+  pool->affinity = affinity;
+  ring_init(&pool->submit, queue_size, sizeof(task_t), RING_MPMC);
+
+  atomic_init(&pool->pending, 0);
+  atomic_init(&pool->queued, 0);
+  atomic_init(&pool->shutdown, 0);
+  atomic_init(&pool->sleepers, 0);
+  atomic_init(&pool->waiters, 0);
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  void *workers;
+
+  if (posix_memalign(&workers, CACHE_LINE, nworkers * sizeof(worker_t)) != 0) {
+    perror("Could not allocate workers");
+    exit(EXIT_FAILURE);
+  }
+
+  pool->workers = workers;
+
+  for (int i = 0; i < nworkers; i++) {
+    worker_t *worker = &pool->workers[i];
+
+    local_init(worker);
+    worker->pool = pool;
+    worker->id = i;
+
+    if (pthread_create(&worker->thread, NULL, worker_thread, worker) != 0) {
+      perror("pthread_create()");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+void pool_destroy(pool_t *pool) {
+  pool_wait_all(pool);
+
+  pthread_mutex_lock(&pool->mutex);
+  store_release(&pool->shutdown, 1);
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (int i = 0; i < pool->nworkers; i++) {
+    pthread_join(pool->workers[i].thread, NULL);
+    affinity_free(pool->workers[i].tasks, pool->workers[i].capacity * sizeof(task_t));
+  }
+
+  free(pool->workers);
+  pool->workers = NULL;
+
+  ring_destroy(&pool->submit);
+
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_cond_destroy(&pool->work);
+  pthread_cond_destroy(&pool->done);
+}
+
+static void submit(pool_t *pool, task_t *task) {
+  fetch_add_relaxed(&pool->pending, 1);
+
+  if (self != NULL && self->pool == pool) {
+    local_push(self, task);
+  } else {
+    ring_put(&pool->submit, task);
+  }
+
+  // Only counted once it can actually be taken, or idle workers would keep
+  // looking for a task still waiting for room in the submit queue. A worker
+  // may take it first and briefly make queued negative, that's fine.
+  fetch_add_relaxed(&pool->queued, 1);
+  fence_seq_cst();
+
+  if (load_relaxed(&pool->sleepers) > 0) {
+    pthread_mutex_lock(&pool->mutex);
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->mutex);
+  }
+}
+
+future_t *pool_submit(pool_t *pool, task_fn_t fn, void *arg) {
+  future_t *future = malloc(sizeof(future_t));
+
+  if (future == NULL) {
+    perror("Could not allocate future");
+    exit(EXIT_FAILURE);
+  }
+
+  future->pool = pool;
+  future->result = NULL;
+  atomic_init(&future->done, 0);
+
+  task_t task = {.fn = fn, .arg = arg, .future = future};
+  submit(pool, &task);
+
+  return future;
+}
+
+void pool_execute(pool_t *pool, task_fn_t fn, void *arg) {
+  task_t task = {.fn = fn, .arg = arg, .future = NULL};
+  submit(pool, &task);
+}
+
+static bool all_done(void *arg) {
+  return load_acquire(&((pool_t *) arg)->pending) == 0;
+}
+
+void pool_wait_all(pool_t *pool) {
+  if (self != NULL && self->pool == pool) {
+    fprintf(stderr, "pool_wait_all() can't be called from a task, use futures\n");
+    exit(EXIT_FAILURE);
+  }
+
+  wait_until(pool, all_done, pool);
+}
+
+bool future_done(future_t *future) {
+  return load_acquire(&future->done);
+}
+
+static bool future_done_arg(void *arg) {
+  return future_done(arg);
+}
+
+void *future_get(future_t *future) {
+  wait_until(future->pool, future_done_arg, future);
+  return future->result;
+}
+
+void future_destroy(future_t *future) {
+  free(future);
+}
+
+int pool_worker_id() {
+  return self != NULL ? self->id : -1;
+}
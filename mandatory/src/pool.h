@@ -0,0 +1,165 @@
+/**
+ * Thread pool.
+ *
+ * A fixed number of worker threads, created once by pool_init(), execute
+ * tasks submitted with pool_submit(). Creating a thread costs tens of
+ * microseconds, submitting a task to a running worker well below one, so a
+ * pool pays off as soon as the work is split into many short jobs.
+ *
+ * Tasks submitted from outside the pool go to a shared submit queue (a
+ * lock-free MPMC ring). Tasks submitted by a task running on a worker go to
+ * that worker's local queue, where the worker itself takes the newest task
+ * first and idle workers steal the oldest one. Idle workers spin for a while
+ * and then sleep until more work is submitted, unless there are at least as
+ * many workers as cores, in which case they sleep right away so as not to
+ * take the core from the thread submitting the work.
+ *
+ * A task is a function with the same signature as a pthread_create() start
+ * routine. Its return value can be collected from the future returned by
+ * pool_submit().
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h> // bool
+#include <pthread.h> // pthread_t, pthread_mutex_t, pthread_cond_t
+
+#include "ring_buffer.h" // ring_t
+#include "locks.h"       // ttas_lock_t
+#include "cache_line.h"  // CACHE_ALIGNED
+#include "atomics.h"     // atomic_int
+#include "affinity.h"    // affinity_t
+
+/* Same as a pthread_create() start routine. */
+typedef void *(*task_fn_t)(void *arg);
+
+typedef struct pool pool_t;
+
+/* The result of a task submitted with pool_submit(). */
+typedef struct {
+  pool_t     *pool;
+  atomic_int done;
+  void       *result;
+} future_t;
+
+typedef struct {
+  task_fn_t fn;
+  void      *arg;
+  future_t  *future; // NULL for tasks submitted with pool_execute().
+} task_t;
+
+/* A worker and its local queue of tasks, worked on from the bottom by the
+   worker and stolen from the top by other workers. */
+typedef struct {
+  CACHE_ALIGNED
+  ttas_lock_t lock;
+  task_t      *tasks;   // Circular array of capacity tasks.
+  int         capacity;
+  atomic_int  top;      // Oldest task.
+  atomic_int  bottom;   // One past the newest task.
+  pool_t      *pool;
+  int         id;
+  pthread_t   thread;
+} worker_t;
+
+struct pool {
+  int        nworkers;
+  int        spin;      // Times an idle worker looks for work before sleeping.
+  const affinity_t *affinity; // Placement of the workers, NULL if not pinned.
+  worker_t   *workers;
+  ring_t     submit;    // Tasks submitted from outside the pool.
+
+  CACHE_ALIGNED
+  atomic_int pending;   // Tasks submitted but not yet finished.
+  atomic_int queued;    // Tasks submitted but not yet started.
+  atomic_int shutdown;
+
+  /* Idle workers and threads waiting for futures or pool_wait_all(). */
+  CACHE_ALIGNED
+  atomic_int      sleepers;
+  atomic_int      waiters;
+  pthread_mutex_t mutex;
+  pthread_cond_t  work;  // Signaled when a task is submitted.
+  pthread_cond_t  done;  // Broadcast when a task finishes.
+};
+
+/* pool_init(pool, nworkers, queue_size)
+
+   Starts nworkers worker threads. At most queue_size tasks submitted from
+   outside the pool can be queued, pool_submit() blocks while the submit queue
+   is full. A nworkers of 0 means one worker per online CPU.
+*/
+void pool_init(pool_t *pool, int nworkers, int queue_size);
+
+/* pool_init_affinity(pool, nworkers, queue_size, affinity)
+
+   Same as pool_init() but worker i is pinned as thread i of affinity, which
+   must outlive the pool. The local queue of a worker is first touched by the
+   worker itself, so it is allocated on the NUMA node of the worker.
+*/
+void pool_init_affinity(pool_t *pool, int nworkers, int queue_size, const affinity_t *affinity);
+
+/* pool_destroy(pool)
+
+   Waits for all submitted tasks to finish and stops the workers.
+*/
+void pool_destroy(pool_t *pool);
+
+/* pool_submit(pool, fn, arg)
+
+   Submits fn(arg) for execution by a worker.
+
+   Return value
+
+   A future for the return value of fn, to be passed to future_get() and
+   freed with future_destroy().
+*/
+future_t *pool_submit(pool_t *pool, task_fn_t fn, void *arg);
+
+/* pool_execute(pool, fn, arg)
+
+   Same as pool_submit() but without a future, the return value of fn is
+   discarded.
+*/
+void pool_execute(pool_t *pool, task_fn_t fn, void *arg);
+
+/* pool_wait_all(pool)
+
+   Waits until every task submitted so far, and every task those tasks
+   submit, has finished. Must not be called from a task, since the task itself
+   would never finish, use futures to wait for tasks submitted by a task.
+*/
+void pool_wait_all(pool_t *pool);
+
+/* future_get(future)
+
+   Waits for the task of future to finish, executing other tasks in the
+   meantime if called from a task.
+
+   Return value
+
+   The return value of the task.
+*/
+void *future_get(future_t *future);
+
+/* future_done(future)
+
+   Return value
+
+   true if the task of future has finished, false otherwise.
+*/
+bool future_done(future_t *future);
+
+void future_destroy(future_t *future);
+
+/* pool_worker_id()
+
+   Return value
+
+   The number of the worker executing the calling task, between 0 and
+   nworkers - 1, or -1 if not called from a task.
+*/
+int pool_worker_id();
+
+#endif
@@ -0,0 +1,208 @@
+/**
+ * Unit test for the thread pool.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE  // sched_getcpu()
+#endif
+
+#include "pool.h"
+#include "timing.h"  // timing_start(), timing_stop()
+
+#include <stdio.h>   // printf(), setbuf(), stdout
+#include <stdlib.h>  // exit(), EXIT_FAILURE
+#include <stdint.h>  // intptr_t
+#include <pthread.h> // pthread_..
+#include <assert.h>  // assert()
+#ifdef __linux__
+#include <sched.h>   // sched_getcpu()
+#endif
+
+#define TEST_HEADER printf("\n==== %s ====\n\n", __FUNCTION__)
+
+#define WORKERS    4
+#define QUEUE_SIZE 16
+#define JOBS       10000
+
+void success() {
+  printf("\nTest SUCCESSFUL :-)\n\n");
+}
+
+pool_t pool;
+
+atomic_int counter;
+
+void *square(void *arg) {
+  intptr_t x = (intptr_t) arg;
+  return (void *) (x * x);
+}
+
+void *increment(void *arg) {
+  (void) arg;
+  fetch_add_relaxed(&counter, 1);
+  return NULL;
+}
+
+void submit_test() {
+  TEST_HEADER;
+
+  future_t *futures[JOBS];
+
+  assert(pool_worker_id() == -1);
+
+  for (intptr_t i = 0; i < JOBS; i++) {
+    futures[i] = pool_submit(&pool, square, (void *) i);
+  }
+
+  for (intptr_t i = 0; i < JOBS; i++) {
+    intptr_t result = (intptr_t) future_get(futures[i]);
+    assert(result == i * i);
+    assert(future_done(futures[i]));
+    future_destroy(futures[i]);
+  }
+
+  success();
+}
+
+void execute_test() {
+  TEST_HEADER;
+
+  atomic_init(&counter, 0);
+
+  for (int i = 0; i < JOBS; i++) {
+    pool_execute(&pool, increment, NULL);
+  }
+
+  pool_wait_all(&pool);
+  assert(load_relaxed(&counter) == JOBS);
+
+  success();
+}
+
+/* Sums the integers in [0, n) by splitting the range in two, submitting one
+   half and summing the other, which ends up in the local queue of the worker
+   and is either done by the worker itself or stolen by another. */
+void *sum(void *arg) {
+  intptr_t *range = arg;
+  intptr_t lo = range[0], hi = range[1];
+
+  assert(pool_worker_id() >= 0 && pool_worker_id() < WORKERS);
+
+  if (hi - lo <= 16) {
+    intptr_t s = 0;
+    for (intptr_t i = lo; i < hi; i++) s += i;
+    return (void *) s;
+  }
+
+  intptr_t left[2] = {lo, lo + (hi - lo) / 2};
+  intptr_t right[2] = {left[1], hi};
+
+  future_t *future = pool_submit(&pool, sum, left);
+  intptr_t s = (intptr_t) sum(right);
+  s += (intptr_t) future_get(future);
+  future_destroy(future);
+
+  return (void *) s;
+}
+
+void nested_test() {
+  TEST_HEADER;
+
+  intptr_t range[2] = {0, 100000};
+  future_t *future = pool_submit(&pool, sum, range);
+
+  intptr_t result = (intptr_t) future_get(future);
+  assert(result == (intptr_t) 100000 * 99999 / 2);
+  future_destroy(future);
+
+  success();
+}
+
+/* Compares the pool with creating and joining one thread per job. */
+void throughput_test() {
+  TEST_HEADER;
+
+  struct timespec ts;
+  pthread_t tid;
+
+  atomic_init(&counter, 0);
+
+  timing_start(&ts);
+  for (int i = 0; i < JOBS; i++) {
+    pool_execute(&pool, increment, NULL);
+  }
+  pool_wait_all(&pool);
+  double pool_time = timing_stop(&ts);
+
+  timing_start(&ts);
+  for (int i = 0; i < JOBS; i++) {
+    if (pthread_create(&tid, NULL, increment, NULL) != 0) {
+      perror("pthread_create()");
+      exit(EXIT_FAILURE);
+    }
+    pthread_join(tid, NULL);
+  }
+  double thread_time = timing_stop(&ts);
+
+  assert(load_relaxed(&counter) == 2 * JOBS);
+
+  printf("%d jobs, pool %.3e s, thread per job %.3e s\n", JOBS, pool_time, thread_time);
+
+  success();
+}
+
+void *where(void *arg) {
+  (void) arg;
+#ifdef __linux__
+  return (void *) (intptr_t) sched_getcpu();
+#else
+  return (void *) (intptr_t) -1;
+#endif
+}
+
+/* The workers of a pinned pool only run on the CPUs of its affinity. */
+void affinity_test() {
+  TEST_HEADER;
+
+  pool_t pinned;
+  affinity_t affinity;
+  future_t *futures[JOBS / 100];
+
+  bool ok = affinity_init(&affinity, "scatter");
+  assert(ok);
+  pool_init_affinity(&pinned, WORKERS, QUEUE_SIZE, &affinity);
+
+  for (int i = 0; i < JOBS / 100; i++) futures[i] = pool_submit(&pinned, where, NULL);
+
+  for (int i = 0; i < JOBS / 100; i++) {
+    intptr_t cpu = (intptr_t) future_get(futures[i]);
+    bool found = false;
+
+    for (int w = 0; w < WORKERS; w++) found |= cpu == affinity_cpu(&affinity, w);
+#ifdef __linux__
+    assert(found);
+#else
+    (void) found;
+#endif
+    future_destroy(futures[i]);
+  }
+
+  pool_destroy(&pinned);
+  affinity_destroy(&affinity);
+
+  success();
+}
+
+int main(void) {
+  setbuf(stdout, NULL);
+
+  pool_init(&pool, WORKERS, QUEUE_SIZE);
+
+  submit_test();
+  execute_test();
+  nested_test();
+  throughput_test();
+  affinity_test();
+
+  pool_destroy(&pool);
+}
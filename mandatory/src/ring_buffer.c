@@ -0,0 +1,350 @@
+#include "ring_buffer.h"
+
+#include <stdbool.h> // true, false
+#include <stdint.h>  // intptr_t
+#include <stdio.h>   // printf(), puts(), perror()
+#include <stdlib.h>  // posix_memalign(), free(), exit()
+#include <string.h>  // memcpy()
+
+/*
+  The ring is driven by two monotonically increasing counters, tail for
+  producers and head for consumers. A counter is mapped to a slot with
+  counter & mask, which is why the number of slots is a power of two.
+
+  A slot is stride bytes long and holds header bytes of bookkeeping (the
+  sequence number in MPMC mode, nothing in SPSC mode) followed by the element.
+
+  MPMC: every slot has a sequence number. A slot with seq == pos is free for
+  the producer claiming position pos, a slot with seq == pos + 1 holds data for
+  the consumer claiming position pos. After consuming, the slot is handed to the
+  producer one lap later by setting seq = pos + size. Producers and consumers
+  claim positions with a compare-and-swap on tail and head respectively.
+
+  SPSC: the single producer owns tail and the single consumer owns head, so a
+  plain store with release semantics publishes a slot and the sequence numbers
+  are not needed. The producer keeps a private copy of head in cached_head and
+  the consumer a private copy of tail in cached_tail. The copies are only
+  refreshed when they make the ring look full (empty), which is rare unless the
+  ring really is full (empty).
+*/
+
+/* Number of times to retry a full or empty ring before going to sleep. */
+#define RING_SPIN 64
+
+static size_t round_up_pow2(size_t n) {
+  size_t p = 1;
+  while (p < n) p <<= 1;
+  return p;
+}
+
+void ring_init(ring_t *ring, int size, size_t elem_size, ring_mode_t mode) {
+  if (size < 1) {
+    fprintf(stderr, "Ring size must be positive, got %d\n", size);
+    exit(EXIT_FAILURE);
+  }
+
+  if (elem_size == 0) {
+    fprintf(stderr, "Ring element size must be positive\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Largest power of two, up to 16, dividing the element size.
+  size_t align = 1;
+  while (align < 16 && elem_size % (align * 2) == 0) align *= 2;
+
+  if (mode == RING_MPMC) {
+    ring->header = align > sizeof(size_t) ? align : sizeof(size_t);
+    ring->stride = (ring->header + elem_size + ring->header - 1) & ~(ring->header - 1);
+  } else {
+    ring->header = 0;
+    ring->stride = elem_size;
+  }
+
+  ring->elem_size = elem_size;
+  ring->size = round_up_pow2(size);
+
+  // With a single slot a full slot, seq = pos + 1, would look free to the
+  // producer of position pos + 1.
+  if (mode == RING_MPMC && ring->size < 2) ring->size = 2;
+  ring->mask = ring->size - 1;
+
+  // Start the slots on a cache line of their own.
+  void *slots;
+
+  if (posix_memalign(&slots, CACHE_LINE, ring->size * ring->stride) != 0) {
+    perror("Could not allocate ring slots");
+    exit(EXIT_FAILURE);
+  }
+
+  ring->slots = slots;
+
+  if (mode == RING_MPMC) {
+    for (size_t i = 0; i < ring->size; i++) {
+      atomic_init((atomic_size_t *) (ring->slots + i * ring->stride), i);
+    }
+  }
+
+  ring->mode = mode;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  ring->cached_head = 0;
+  ring->cached_tail = 0;
+  atomic_init(&ring->waiting_producers, 0);
+  atomic_init(&ring->waiting_consumers, 0);
+  ring->not_full  = psem_init_named(0, "ring not_full");
+  ring->not_empty = psem_init_named(0, "ring not_empty");
+}
+
+void ring_destroy(ring_t *ring) {
+  free(ring->slots);
+  ring->slots = NULL;
+
+  psem_destroy(ring->not_full);
+  ring->not_full = NULL;
+  psem_destroy(ring->not_empty);
+  ring->not_empty = NULL;
+}
+
+void ring_print(ring_t *ring, ring_formatter_t formatter) {
+  puts("");
+  puts("---- Ring Buffer ----");
+  puts("");
+
+  printf("mode: %s\n", ring->mode == RING_SPSC ? "SPSC" : "MPMC");
+  printf("size: %zu\n", ring->size);
+  printf("elem: %zu bytes (%zu byte slots)\n", ring->elem_size, ring->stride);
+  printf("head: %zu\n", load_relaxed(&ring->head));
+  printf("tail: %zu\n", load_relaxed(&ring->tail));
+  puts("");
+
+  if (formatter != NULL) {
+    for (size_t i = 0; i < ring->size; i++) {
+      printf("slots[%zu]: ", i);
+      formatter(ring->slots + i * ring->stride + ring->header);
+      puts("");
+    }
+    puts("");
+  }
+
+  puts("---------------------");
+  puts("");
+}
+
+/*******************************************************************************
+                              Non-blocking operations
+
+  Putting and getting is done in two steps. First a slot is claimed, then,
+  after the element has been copied, the slot is published to the other side.
+*******************************************************************************/
+
+static inline unsigned char *slot_at(ring_t *ring, size_t pos) {
+  return ring->slots + (pos & ring->mask) * ring->stride;
+}
+
+static inline atomic_size_t *slot_seq(unsigned char *slot) {
+  return (atomic_size_t *) slot;
+}
+
+static unsigned char *mpmc_claim_put(ring_t *ring) {
+  size_t pos = load_relaxed(&ring->tail);
+
+  while (true) {
+    unsigned char *slot = slot_at(ring, pos);
+    size_t seq = load_acquire(slot_seq(slot));
+    intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+    if (diff == 0) {
+      // On failure pos is updated with the current tail.
+      if (cas_weak_relaxed(&ring->tail, &pos, pos + 1)) {
+        return slot;
+      }
+    } else if (diff < 0) {
+      // The slot still holds data from the previous lap, the ring is full.
+      return NULL;
+    } else {
+      pos = load_relaxed(&ring->tail);
+    }
+  }
+}
+
+static unsigned char *mpmc_claim_get(ring_t *ring) {
+  size_t pos = load_relaxed(&ring->head);
+
+  while (true) {
+    unsigned char *slot = slot_at(ring, pos);
+    size_t seq = load_acquire(slot_seq(slot));
+    intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+
+    if (diff == 0) {
+      if (cas_weak_relaxed(&ring->head, &pos, pos + 1)) {
+        return slot;
+      }
+    } else if (diff < 0) {
+      // No producer has filled the slot yet, the ring is empty.
+      return NULL;
+    } else {
+      pos = load_relaxed(&ring->head);
+    }
+  }
+}
+
+static unsigned char *spsc_claim_put(ring_t *ring) {
+  size_t tail = load_relaxed(&ring->tail);
+
+  // Only look at the consumer's cache line if the ring looks full.
+  if (tail - ring->cached_head == ring->size) {
+    ring->cached_head = load_acquire(&ring->head);
+    if (tail - ring->cached_head == ring->size) return NULL;
+  }
+
+  return slot_at(ring, tail);
+}
+
+static unsigned char *spsc_claim_get(ring_t *ring) {
+  size_t head = load_relaxed(&ring->head);
+
+  // Only look at the producer's cache line if the ring looks empty.
+  if (head == ring->cached_tail) {
+    ring->cached_tail = load_acquire(&ring->tail);
+    if (head == ring->cached_tail) return NULL;
+  }
+
+  return slot_at(ring, head);
+}
+
+static unsigned char *claim_put(ring_t *ring) {
+  return ring->mode == RING_SPSC ? spsc_claim_put(ring) : mpmc_claim_put(ring);
+}
+
+static unsigned char *claim_get(ring_t *ring) {
+  return ring->mode == RING_SPSC ? spsc_claim_get(ring) : mpmc_claim_get(ring);
+}
+
+/*
+  A claimed MPMC slot is owned by the claiming thread until it is published,
+  so the position it was claimed for can be recovered from its sequence
+  number: seq == pos for a slot claimed by a producer and seq == pos + 1 for a
+  slot claimed by a consumer.
+*/
+
+static void publish_put(ring_t *ring, unsigned char *slot) {
+  if (ring->mode == RING_SPSC) {
+    store_release(&ring->tail, load_relaxed(&ring->tail) + 1);
+  } else {
+    size_t pos = load_relaxed(slot_seq(slot));
+    store_release(slot_seq(slot), pos + 1);
+  }
+}
+
+static void publish_get(ring_t *ring, unsigned char *slot) {
+  if (ring->mode == RING_SPSC) {
+    store_release(&ring->head, load_relaxed(&ring->head) + 1);
+  } else {
+    size_t pos = load_relaxed(slot_seq(slot)) - 1;
+    store_release(slot_seq(slot), pos + ring->size);
+  }
+}
+
+/*******************************************************************************
+                                Blocking fallback
+*******************************************************************************/
+
+/*
+  A thread that finds the ring full (empty) announces itself in
+  waiting_producers (waiting_consumers), retries once and then sleeps on
+  not_full (not_empty). The other side checks the counter after every
+  successful operation and signals the semaphore if someone is waiting.
+
+  Both sides issue a full fence between their write (announcement or slot
+  update) and their read (slot state or counter), so either the sleeper sees
+  the update on its retry or the updater sees the sleeper. Extra signals only
+  cause a spurious wakeup, after which the sleeper simply tries again.
+*/
+
+static void wake(atomic_int *waiting, psem_t *sem) {
+  fence_seq_cst();
+
+  if (load_relaxed(waiting) > 0) {
+    psem_signal(sem);
+  }
+}
+
+/* Claims a slot with claim(), blocking on sem while no slot can be claimed. */
+static unsigned char *claim_or_wait(ring_t *ring,
+                                    unsigned char *(*claim)(ring_t *),
+                                    atomic_int *waiting,
+                                    psem_t *sem) {
+  unsigned char *slot;
+
+  while (true) {
+    for (int i = 0; i < RING_SPIN; i++) {
+      if ((slot = claim(ring)) != NULL) return slot;
+      cpu_relax();
+    }
+
+    fetch_add_relaxed(waiting, 1);
+    fence_seq_cst();
+
+    slot = claim(ring);
+
+    if (slot == NULL) {
+      psem_wait(sem);
+    }
+
+    fetch_sub_relaxed(waiting, 1);
+
+    if (slot != NULL) return slot;
+  }
+}
+
+void *ring_reserve(ring_t *ring) {
+  unsigned char *slot = claim_or_wait(ring, claim_put, &ring->waiting_producers, ring->not_full);
+  return slot + ring->header;
+}
+
+void ring_commit(ring_t *ring, void *elem) {
+  publish_put(ring, (unsigned char *) elem - ring->header);
+  wake(&ring->waiting_consumers, ring->not_empty);
+}
+
+void *ring_peek(ring_t *ring) {
+  unsigned char *slot = claim_or_wait(ring, claim_get, &ring->waiting_consumers, ring->not_empty);
+  return slot + ring->header;
+}
+
+void ring_release(ring_t *ring, void *elem) {
+  publish_get(ring, (unsigned char *) elem - ring->header);
+  wake(&ring->waiting_producers, ring->not_full);
+}
+
+void ring_put(ring_t *ring, const void *elem) {
+  void *slot = ring_reserve(ring);
+  memcpy(slot, elem, ring->elem_size);
+  ring_commit(ring, slot);
+}
+
+void ring_get(ring_t *ring, void *elem) {
+  void *slot = ring_peek(ring);
+  memcpy(elem, slot, ring->elem_size);
+  ring_release(ring, slot);
+}
+
+bool ring_try_put(ring_t *ring, const void *elem) {
+  unsigned char *slot = claim_put(ring);
+
+  if (slot == NULL) return false;
+
+  memcpy(slot + ring->header, elem, ring->elem_size);
+  ring_commit(ring, slot + ring->header);
+  return true;
+}
+
+bool ring_try_get(ring_t *ring, void *elem) {
+  unsigned char *slot = claim_get(ring);
+
+  if (slot == NULL) return false;
+
+  memcpy(elem, slot + ring->header, ring->elem_size);
+  ring_release(ring, slot + ring->header);
+  return true;
+}
@@ -0,0 +1,165 @@
+/**
+ * Lock-free bounded buffer (ring) for elements of any size.
+ *
+ * Elements are stored inline in the ring and copied in and out with memcpy(),
+ * so records of a few hundred bytes can be passed between threads without
+ * allocating memory per record. The element size is given to ring_init().
+ *
+ * Two flavours are provided:
+ *
+ *   RING_MPMC - any number of producers and consumers. Each slot carries a
+ *               sequence number telling producers and consumers whether the
+ *               slot is free or holds data for the current lap (Dmitry Vyukov's
+ *               bounded MPMC queue).
+ *
+ *   RING_SPSC - exactly one producer and one consumer. No sequence numbers and
+ *               no read-modify-write operations, only loads and stores of the
+ *               head and tail indices.
+ *
+ * Producers and consumers only touch the psem layer when the ring is full or
+ * empty.
+ *
+ * The producer and consumer indices are kept on separate cache lines, and in
+ * SPSC mode each side caches the other side's index so that it only has to
+ * read the other side's cache line when the ring looks full (empty).
+ */
+
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stddef.h>  // size_t
+#include <stdbool.h> // bool
+
+#include "psem.h"       // psem_t
+#include "cache_line.h" // CACHE_LINE, CACHE_ALIGNED
+#include "atomics.h"    // atomic_size_t, atomic_int
+
+typedef enum {RING_SPSC, RING_MPMC} ring_mode_t;
+
+/* Prints a single element, used by ring_print(). */
+typedef void (*ring_formatter_t)(const void *elem);
+
+typedef struct {
+  /* Read-only after ring_init(), shared by everyone. */
+  ring_mode_t   mode;
+  unsigned char *slots;
+  size_t        size;       // Number of slots, always a power of two.
+  size_t        mask;       // size - 1
+  size_t        elem_size;  // Size in bytes of one element.
+  size_t        header;     // MPMC: bytes before the element used for seq.
+  size_t        stride;     // Bytes between two consecutive slots.
+  psem_t        *not_full;
+  psem_t        *not_empty;
+
+  /* Producer side. */
+  CACHE_ALIGNED
+  atomic_size_t tail;         // Next slot to produce.
+  size_t        cached_head;  // SPSC: the producer's last known value of head.
+
+  /* Consumer side. */
+  CACHE_ALIGNED
+  atomic_size_t head;         // Next slot to consume.
+  size_t        cached_tail;  // SPSC: the consumer's last known value of tail.
+
+  /* Blocking fallback, only written when the ring is full or empty. */
+  CACHE_ALIGNED
+  atomic_int    waiting_producers;
+  atomic_int    waiting_consumers;
+} ring_t;
+
+/* ring_init(ring, size, elem_size, mode)
+
+   Initializes the ring with room for at least size elements of elem_size
+   bytes each. The number of slots is rounded up to the nearest power of two,
+   and to at least two slots in MPMC mode.
+   Elements are aligned to the largest power of two, up to 16, that divides
+   elem_size.
+*/
+void ring_init(ring_t *ring, int size, size_t elem_size, ring_mode_t mode);
+
+void ring_destroy(ring_t *ring);
+
+/* ring_print(ring, formatter)
+
+   Prints the state of the ring, using formatter to print the elements. If
+   formatter is NULL the elements are not printed.
+*/
+void ring_print(ring_t *ring, ring_formatter_t formatter);
+
+/* ring_put(ring, elem)
+
+   Copies elem_size bytes from elem into the ring, blocking while the ring is
+   full.
+*/
+void ring_put(ring_t *ring, const void *elem);
+
+/* ring_get(ring, elem)
+
+   Copies the oldest element out of the ring into elem, blocking while the
+   ring is empty.
+*/
+void ring_get(ring_t *ring, void *elem);
+
+/* ring_try_put(ring, elem)
+
+   Same as ring_put() but returns false instead of blocking if the ring is
+   full.
+*/
+bool ring_try_put(ring_t *ring, const void *elem);
+
+/* ring_try_get(ring, elem)
+
+   Same as ring_get() but returns false instead of blocking if the ring is
+   empty.
+*/
+bool ring_try_get(ring_t *ring, void *elem);
+
+/*******************************************************************************
+                               Zero-copy interface
+
+  Instead of copying elements in and out, producers and consumers can work on
+  the slots directly. ring_put() and ring_get() are ring_reserve() and
+  ring_peek() followed by a memcpy() and ring_commit() and ring_release().
+
+  In SPSC mode the producer (consumer) must commit (release) a slot before
+  reserving (peeking at) the next one. In MPMC mode a thread may hold several
+  slots, but elements are still handed out in order, so a slot that is held
+  for a long time stalls the other side when it reaches that slot.
+*******************************************************************************/
+
+/* ring_reserve(ring)
+
+   Claims the next free slot for the caller, blocking while the ring is full.
+
+   Return value
+
+   A pointer to elem_size bytes inside the ring where the caller builds the
+   element in place. The element is invisible to consumers until it is passed
+   to ring_commit().
+*/
+void *ring_reserve(ring_t *ring);
+
+/* ring_commit(ring, elem)
+
+   Publishes an element previously returned by ring_reserve() to consumers.
+*/
+void ring_commit(ring_t *ring, void *elem);
+
+/* ring_peek(ring)
+
+   Claims the oldest element for the caller, blocking while the ring is empty.
+
+   Return value
+
+   A pointer to the element inside the ring. The slot is not reused by
+   producers until it is passed to ring_release().
+*/
+void *ring_peek(ring_t *ring);
+
+/* ring_release(ring, elem)
+
+   Hands a slot previously returned by ring_peek() back to producers.
+*/
+void ring_release(ring_t *ring, void *elem);
+
+#endif
@@ -0,0 +1,305 @@
+/**
+ * Unit test for the lock-free ring buffer.
+ */
+
+#include "ring_buffer.h"
+
+#include <stdio.h>   // printf(), setbuf(), stdout
+#include <stdlib.h>  // exit(), EXIT_FAILURE
+#include <string.h>  // memset()
+#include <pthread.h> // pthread_..
+#include <assert.h>  // assert()
+
+#define TEST_HEADER printf("\n==== %s ====\n\n", __FUNCTION__)
+
+/* A record in the size range the ring is meant for. */
+typedef struct {
+  int  producer;
+  int  seq;
+  char payload[248];
+} record_t;
+
+void success() {
+  printf("\nTest SUCCESSFUL :-)\n\n");
+}
+
+void fill_record(record_t *record, int producer, int seq) {
+  record->producer = producer;
+  record->seq = seq;
+  memset(record->payload, 'a' + seq % 26, sizeof(record->payload));
+}
+
+void check_record(record_t *record, int producer, int seq) {
+  assert(record->producer == producer);
+  assert(record->seq == seq);
+
+  for (size_t i = 0; i < sizeof(record->payload); i++) {
+    assert(record->payload[i] == 'a' + seq % 26);
+  }
+}
+
+void print_int(const void *elem) {
+  printf("%d", *(const int *) elem);
+}
+
+void init_test() {
+  TEST_HEADER;
+
+  ring_t ring;
+
+  ring_init(&ring, 5, sizeof(record_t), RING_MPMC);
+
+  assert(ring.size == 8);
+  assert(ring.elem_size == sizeof(record_t));
+  assert(ring.header >= sizeof(size_t));
+  assert(ring.stride == ring.header + sizeof(record_t));
+  assert(ring.slots != NULL);
+
+  ring_destroy(&ring);
+
+  assert(ring.slots == NULL);
+
+  // Sequence numbers stay aligned for odd element sizes.
+  ring_init(&ring, 4, 3, RING_MPMC);
+  assert(ring.stride % sizeof(size_t) == 0);
+  ring_destroy(&ring);
+
+  // No sequence numbers in SPSC mode.
+  ring_init(&ring, 4, sizeof(record_t), RING_SPSC);
+  assert(ring.stride == sizeof(record_t));
+  ring_destroy(&ring);
+
+  // The sequence numbers need two slots, SPSC can do with one.
+  ring_init(&ring, 1, sizeof(int), RING_MPMC);
+  assert(ring.size == 2);
+  ring_destroy(&ring);
+
+  ring_init(&ring, 1, sizeof(int), RING_SPSC);
+  assert(ring.size == 1);
+  ring_destroy(&ring);
+
+  success();
+}
+
+void print_test() {
+  TEST_HEADER;
+
+  ring_t ring;
+
+  ring_init(&ring, 4, sizeof(int), RING_MPMC);
+
+  for (int i = 1; i <= 3; i++) {
+    int value = i * 111;
+    ring_put(&ring, &value);
+  }
+
+  ring_print(&ring, print_int);
+  ring_print(&ring, NULL);
+
+  ring_destroy(&ring);
+
+  success();
+}
+
+void wrap_test(ring_mode_t mode) {
+  ring_t ring;
+  record_t record;
+
+  ring_init(&ring, 4, sizeof(record_t), mode);
+
+  // Several laps around the ring, with the ring up to full each lap.
+  for (int lap = 0; lap < 5; lap++) {
+    for (int i = 0; i < 4; i++) {
+      fill_record(&record, lap, i);
+      ring_put(&ring, &record);
+    }
+
+    for (int i = 0; i < 4; i++) {
+      ring_get(&ring, &record);
+      check_record(&record, lap, i);
+    }
+  }
+
+  assert(ring.head == ring.tail);
+
+  ring_destroy(&ring);
+}
+
+void spsc_wrap_test() {
+  TEST_HEADER;
+  wrap_test(RING_SPSC);
+  success();
+}
+
+void mpmc_wrap_test() {
+  TEST_HEADER;
+  wrap_test(RING_MPMC);
+  success();
+}
+
+void try_test(ring_mode_t mode) {
+  ring_t ring;
+  int value;
+
+  bool ok;
+
+  ring_init(&ring, 2, sizeof(int), mode);
+
+  ok = ring_try_get(&ring, &value);
+  assert(!ok);
+
+  for (int i = 0; i < 2; i++) {
+    ok = ring_try_put(&ring, &i);
+    assert(ok);
+  }
+
+  value = 2;
+  ok = ring_try_put(&ring, &value);
+  assert(!ok);
+
+  for (int i = 0; i < 2; i++) {
+    ok = ring_try_get(&ring, &value);
+    assert(ok);
+    assert(value == i);
+  }
+
+  ok = ring_try_get(&ring, &value);
+  assert(!ok);
+
+  ring_destroy(&ring);
+}
+
+void spsc_try_test() {
+  TEST_HEADER;
+  try_test(RING_SPSC);
+  success();
+}
+
+void mpmc_try_test() {
+  TEST_HEADER;
+  try_test(RING_MPMC);
+  success();
+}
+
+void zero_copy_test(ring_mode_t mode) {
+  ring_t ring;
+
+  ring_init(&ring, 2, sizeof(record_t), mode);
+
+  for (int i = 0; i < 5; i++) {
+    record_t *out = ring_reserve(&ring);
+
+    // The record is built inside the ring.
+    assert((unsigned char *) out >= ring.slots);
+    assert((unsigned char *) out < ring.slots + ring.size * ring.stride);
+
+    fill_record(out, 0, i);
+    ring_commit(&ring, out);
+
+    record_t *in = ring_peek(&ring);
+
+    assert(in == out);
+    check_record(in, 0, i);
+
+    ring_release(&ring, in);
+  }
+
+  assert(ring.head == 5 && ring.tail == 5);
+
+  ring_destroy(&ring);
+}
+
+void spsc_zero_copy_test() {
+  TEST_HEADER;
+  zero_copy_test(RING_SPSC);
+  success();
+}
+
+void mpmc_zero_copy_test() {
+  TEST_HEADER;
+  zero_copy_test(RING_MPMC);
+  success();
+}
+
+#define PRODUCERS 4
+#define CONSUMERS 4
+#define ITEMS     10000
+
+typedef struct {
+  int    id;
+  ring_t *ring;
+} arg_t;
+
+void *producer(void *arg) {
+  arg_t *a = arg;
+  record_t record;
+
+  for (int i = 0; i < ITEMS; i++) {
+    fill_record(&record, a->id, i);
+    ring_put(a->ring, &record);
+  }
+
+  return NULL;
+}
+
+void *consumer(void *arg) {
+  arg_t *a = arg;
+  record_t record;
+  int last[PRODUCERS] = {-1, -1, -1, -1};
+
+  for (int i = 0; i < ITEMS * PRODUCERS / CONSUMERS; i++) {
+    ring_get(a->ring, &record);
+
+    // Records from one producer arrive in order.
+    assert(record.seq > last[record.producer]);
+    check_record(&record, record.producer, record.seq);
+    last[record.producer] = record.seq;
+  }
+
+  return NULL;
+}
+
+void concurrent_mpmc_test() {
+  TEST_HEADER;
+
+  ring_t ring;
+  pthread_t tid[PRODUCERS + CONSUMERS];
+  arg_t arg[PRODUCERS + CONSUMERS];
+
+  ring_init(&ring, 16, sizeof(record_t), RING_MPMC);
+
+  for (int i = 0; i < PRODUCERS + CONSUMERS; i++) {
+    arg[i].id = i < PRODUCERS ? i : i - PRODUCERS;
+    arg[i].ring = &ring;
+
+    if (pthread_create(&tid[i], NULL, i < PRODUCERS ? producer : consumer, &arg[i]) != 0) {
+      perror("pthread_create()");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  for (int i = 0; i < PRODUCERS + CONSUMERS; i++) {
+    pthread_join(tid[i], NULL);
+  }
+
+  assert(ring.head == (size_t) PRODUCERS * ITEMS);
+  assert(ring.tail == (size_t) PRODUCERS * ITEMS);
+
+  ring_destroy(&ring);
+
+  success();
+}
+
+int main(void) {
+  setbuf(stdout, NULL);
+
+  init_test();
+  print_test();
+  spsc_wrap_test();
+  mpmc_wrap_test();
+  spsc_try_test();
+  mpmc_try_test();
+  spsc_zero_copy_test();
+  mpmc_zero_copy_test();
+  concurrent_mpmc_test();
+}
@@ -0,0 +1,63 @@
+#include "sharded_counter.h"
+
+#include <stdio.h>   // fprintf(), perror()
+#include <stdlib.h>  // posix_memalign(), free(), exit()
+
+void sharded_counter_init(sharded_counter_t *counter, int nshards) {
+  if (nshards < 1) {
+    fprintf(stderr, "Number of shards must be positive, got %d\n", nshards);
+    exit(EXIT_FAILURE);
+  }
+
+  void *shards;
+
+  if (posix_memalign(&shards, CACHE_LINE, nshards * sizeof(counter_shard_t)) != 0) {
+    perror("Could not allocate counter shards");
+    exit(EXIT_FAILURE);
+  }
+
+  counter->shards = shards;
+  counter->nshards = nshards;
+
+  sharded_counter_reset(counter);
+}
+
+void sharded_counter_destroy(sharded_counter_t *counter) {
+  free(counter->shards);
+  counter->shards = NULL;
+  counter->nshards = 0;
+}
+
+void sharded_counter_add(sharded_counter_t *counter, int shard, long delta) {
+  // Relaxed is enough, the order of the additions doesn't matter. The locked
+  // add stays cheap as long as the cache line is owned by this core.
+  fetch_add_relaxed(&counter->shards[shard % counter->nshards].value, delta);
+}
+
+long sharded_counter_read(sharded_counter_t *counter) {
+  long sum = 0;
+
+  fence_seq_cst();
+
+  for (int i = 0; i < counter->nshards; i++) {
+    sum += load_acquire(&counter->shards[i].value);
+  }
+
+  return sum;
+}
+
+long sharded_counter_read_relaxed(sharded_counter_t *counter) {
+  long sum = 0;
+
+  for (int i = 0; i < counter->nshards; i++) {
+    sum += load_relaxed(&counter->shards[i].value);
+  }
+
+  return sum;
+}
+
+void sharded_counter_reset(sharded_counter_t *counter) {
+  for (int i = 0; i < counter->nshards; i++) {
+    store_relaxed(&counter->shards[i].value, 0);
+  }
+}
@@ -0,0 +1,70 @@
+/**
+ * Sharded counter.
+ *
+ * A counter updated by many threads is a single cache line that has to move
+ * to the core of every thread updating it, even with atomic instructions. A
+ * sharded counter gives every thread a slot of its own, on a cache line of its
+ * own, and adds up the slots when the counter is read. Updates never contend,
+ * reads cost one load per shard.
+ *
+ * This is a good fit for counters that are updated often and read rarely,
+ * such as statistics and metrics.
+ */
+
+#ifndef SHARDED_COUNTER_H
+#define SHARDED_COUNTER_H
+
+#include "cache_line.h" // CACHE_ALIGNED
+#include "atomics.h"    // atomic_long
+
+typedef struct {
+  CACHE_ALIGNED
+  atomic_long value;
+} counter_shard_t;
+
+typedef struct {
+  counter_shard_t *shards;
+  int             nshards;
+} sharded_counter_t;
+
+/* sharded_counter_init(counter, nshards)
+
+   Initializes the counter to zero with nshards shards, usually one per
+   thread updating the counter.
+*/
+void sharded_counter_init(sharded_counter_t *counter, int nshards);
+
+void sharded_counter_destroy(sharded_counter_t *counter);
+
+/* sharded_counter_add(counter, shard, delta)
+
+   Adds delta to the counter through shard number shard, which is taken modulo
+   the number of shards. Threads sharing a shard are safe, but only threads
+   with a shard of their own get uncontended updates.
+*/
+void sharded_counter_add(sharded_counter_t *counter, int shard, long delta);
+
+/* sharded_counter_read(counter)
+
+   Return value
+
+   The sum of all shards. Updates that happened before the call, in the sense
+   that the updating thread synchronized with the caller (for example by being
+   joined), are included. Updates racing with the read may or may not be.
+*/
+long sharded_counter_read(sharded_counter_t *counter);
+
+/* sharded_counter_read_relaxed(counter)
+
+   Same as sharded_counter_read() but without any memory barrier. The value
+   may be slightly out of date, which is fine for statistics.
+*/
+long sharded_counter_read_relaxed(sharded_counter_t *counter);
+
+/* sharded_counter_reset(counter)
+
+   Sets all shards to zero. Updates racing with the reset may be lost.
+*/
+void sharded_counter_reset(sharded_counter_t *counter);
+
+#endif
@@ -0,0 +1,101 @@
+/**
+ * Unit test for the sharded counter.
+ */
+
+#include "sharded_counter.h"
+
+#include <stdio.h>   // printf(), setbuf(), stdout
+#include <stdlib.h>  // exit(), EXIT_FAILURE
+#include <stdint.h>  // uintptr_t
+#include <pthread.h> // pthread_..
+#include <assert.h>  // assert()
+
+#define TEST_HEADER printf("\n==== %s ====\n\n", __FUNCTION__)
+
+#define THREADS    4
+#define ITERATIONS 100000
+
+void success() {
+  printf("\nTest SUCCESSFUL :-)\n\n");
+}
+
+sharded_counter_t counter;
+
+void init_test() {
+  TEST_HEADER;
+
+  sharded_counter_init(&counter, 3);
+
+  // Every shard on a cache line of its own.
+  assert(sizeof(counter_shard_t) % CACHE_LINE == 0);
+  assert((uintptr_t) counter.shards % CACHE_LINE == 0);
+  assert(sharded_counter_read(&counter) == 0);
+
+  // Shard numbers wrap around.
+  sharded_counter_add(&counter, 0, 5);
+  sharded_counter_add(&counter, 4, -2);
+  assert(counter.shards[1].value == -2);
+  assert(sharded_counter_read(&counter) == 3);
+  assert(sharded_counter_read_relaxed(&counter) == 3);
+
+  sharded_counter_reset(&counter);
+  assert(sharded_counter_read(&counter) == 0);
+
+  sharded_counter_destroy(&counter);
+  assert(counter.shards == NULL);
+
+  success();
+}
+
+void *adder(void *arg) {
+  int shard = (int) (uintptr_t) arg;
+
+  for (int i = 0; i < ITERATIONS; i++) {
+    sharded_counter_add(&counter, shard, 1);
+  }
+
+  return NULL;
+}
+
+/* Runs THREADS threads adding to the counter, sharing shards if there are
+   fewer shards than threads. */
+void concurrent_test(int nshards) {
+  pthread_t tid[THREADS];
+
+  sharded_counter_init(&counter, nshards);
+
+  for (int i = 0; i < THREADS; i++) {
+    if (pthread_create(&tid[i], NULL, adder, (void *) (uintptr_t) i) != 0) {
+      perror("pthread_create()");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  for (int i = 0; i < THREADS; i++) {
+    pthread_join(tid[i], NULL);
+  }
+
+  assert(sharded_counter_read(&counter) == (long) THREADS * ITERATIONS);
+
+  sharded_counter_destroy(&counter);
+}
+
+void private_shards_test() {
+  TEST_HEADER;
+  concurrent_test(THREADS);
+  success();
+}
+
+void shared_shards_test() {
+  TEST_HEADER;
+  concurrent_test(THREADS / 2);
+  success();
+}
+
+int main(void) {
+  setbuf(stdout, NULL);
+
+  init_test();
+  private_shards_test();
+  shared_shards_test();
+}
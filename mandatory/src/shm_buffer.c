@@ -0,0 +1,203 @@
+/*
+  Bounded buffer in named shared memory, see shm_buffer.h.
+
+  The algorithm is the one of bounded_buffer.c, in buffer_core.h. The only
+  difference is that everything is reached through the region instead of
+  through pointers, and that the semaphores are process-shared.
+*/
+
+#include "shm_buffer.h"
+#include "buffer_core.h" // buffer_core_t, core_put_reserved(), core_get_reserved()
+#include "atomics.h"     // load_acquire(), store_release()
+
+#include <fcntl.h>    // O_CREAT, O_EXCL, O_RDWR
+#include <stdatomic.h>
+#include <stdint.h>   // uint32_t
+#include <stdio.h>    // perror()
+#include <stdlib.h>   // exit(), EXIT_FAILURE
+#include <errno.h>    // errno, ENOENT
+#include <sys/mman.h> // shm_open(), shm_unlink(), mmap(), munmap()
+#include <sys/stat.h> // fstat()
+#include <unistd.h>   // ftruncate(), close()
+
+#define SHM_MAGIC 0x62756666 // "buff"
+
+struct shm_region {
+  atomic_uint    magic; // Set to SHM_MAGIC once the buffer is initialized.
+  buffer_state_t state;
+  psem_t         mutex;
+  psem_t         data;
+  psem_t         empty;
+  tuple_t        array[];
+};
+
+/* Maps length bytes of the shared memory object fd, or exits. */
+static shm_region_t *map(int fd, size_t length) {
+  void *region = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  if (region == MAP_FAILED) {
+    perror("mmap()");
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+
+  return region;
+}
+
+void shm_buffer_create(shm_buffer_t *buffer, const char *name, int size) {
+  size_t length = sizeof(shm_region_t) + size * sizeof(tuple_t);
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+
+  if (fd == -1) {
+    perror("shm_open()");
+    exit(EXIT_FAILURE);
+  }
+
+  // A new object is empty, ftruncate() fills it with zeros.
+  if (ftruncate(fd, length) == -1) {
+    perror("ftruncate()");
+    exit(EXIT_FAILURE);
+  }
+
+  shm_region_t *region = map(fd, length);
+
+  core_init(&region->state, size);
+  psem_init_shared(&region->mutex, 1);
+  psem_init_shared(&region->data, 0);
+  psem_init_shared(&region->empty, size);
+
+  // Publishes the initialized buffer to processes attaching concurrently.
+  store_release(&region->magic, SHM_MAGIC);
+
+  buffer->region = region;
+  buffer->length = length;
+}
+
+bool shm_buffer_attach(shm_buffer_t *buffer, const char *name) {
+  struct stat st;
+  int fd = shm_open(name, O_RDWR, 0);
+
+  if (fd == -1) {
+    if (errno == ENOENT) return false;
+    perror("shm_open()");
+    exit(EXIT_FAILURE);
+  }
+
+  if (fstat(fd, &st) == -1) {
+    perror("fstat()");
+    exit(EXIT_FAILURE);
+  }
+
+  // Not yet truncated to its size by the creator.
+  if ((size_t) st.st_size < sizeof(shm_region_t)) {
+    close(fd);
+    return false;
+  }
+
+  shm_region_t *region = map(fd, st.st_size);
+
+  if (load_acquire(&region->magic) != SHM_MAGIC) {
+    munmap(region, st.st_size);
+    return false;
+  }
+
+  buffer->region = region;
+  buffer->length = st.st_size;
+
+  return true;
+}
+
+void shm_buffer_detach(shm_buffer_t *buffer) {
+  if (munmap(buffer->region, buffer->length) == -1) {
+    perror("munmap()");
+    exit(EXIT_FAILURE);
+  }
+  buffer->region = NULL;
+}
+
+void shm_buffer_unlink(shm_buffer_t *buffer, const char *name) {
+  shm_region_t *region = buffer->region;
+
+  psem_destroy_shared(&region->mutex);
+  psem_destroy_shared(&region->data);
+  psem_destroy_shared(&region->empty);
+
+  shm_buffer_detach(buffer);
+
+  if (shm_unlink(name) == -1) {
+    perror("shm_unlink()");
+    exit(EXIT_FAILURE);
+  }
+}
+
+int shm_buffer_size(shm_buffer_t *buffer) {
+  return buffer->region->state.size;
+}
+
+/* The array and semaphores in this process's mapping of region, for the
+   algorithm in buffer_core.h. */
+static buffer_core_t core(shm_region_t *region) {
+  return (buffer_core_t){&region->state, region->array, &region->mutex, &region->data,
+                         &region->empty};
+}
+
+bool shm_buffer_put(shm_buffer_t *buffer, int a, int b) {
+  tuple_t tuple = {.a = a, .b = b};
+
+  psem_wait(&buffer->region->empty);
+
+  return core_put_reserved(core(buffer->region), &tuple, 1) == 1;
+}
+
+bool shm_buffer_get(shm_buffer_t *buffer, tuple_t *tuple) {
+  psem_wait(&buffer->region->data);
+
+  return core_get_reserved(core(buffer->region), tuple, 1) == 1;
+}
+
+bool shm_buffer_try_put(shm_buffer_t *buffer, int a, int b) {
+  tuple_t tuple = {.a = a, .b = b};
+
+  if (!psem_trywait(&buffer->region->empty)) return false;
+
+  return core_put_reserved(core(buffer->region), &tuple, 1) == 1;
+}
+
+bool shm_buffer_try_get(shm_buffer_t *buffer, tuple_t *tuple) {
+  if (!psem_trywait(&buffer->region->data)) return false;
+
+  return core_get_reserved(core(buffer->region), tuple, 1) == 1;
+}
+
+int shm_buffer_put_n(shm_buffer_t *buffer, const tuple_t *src, int n) {
+  shm_region_t *region = buffer->region;
+  int done = 0;
+
+  while (done < n) {
+    psem_wait(&region->empty);
+
+    int reserved = 1 + psem_trywait_n(&region->empty, n - done - 1);
+
+    if (core_put_reserved(core(region), src + done, reserved) == 0) break;
+
+    done += reserved;
+  }
+
+  return done;
+}
+
+int shm_buffer_get_n(shm_buffer_t *buffer, tuple_t *dst, int max) {
+  shm_region_t *region = buffer->region;
+
+  if (max < 1) return 0;
+
+  psem_wait(&region->data);
+
+  int reserved = 1 + psem_trywait_n(&region->data, max - 1);
+
+  return core_get_reserved(core(region), dst, reserved);
+}
+
+void shm_buffer_close(shm_buffer_t *buffer) {
+  core_close(core(buffer->region));
+}
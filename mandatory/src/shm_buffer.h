@@ -0,0 +1,91 @@
+/**
+ * Bounded buffer of tuples shared between processes.
+ *
+ * The same buffer as in bounded_buffer.h, but the ring of tuples, its indices
+ * and the three semaphores all live in one named shm_open() object that every
+ * process maps with mmap(). Tuples are copied straight from one process's
+ * memory into the other's, the kernel is only entered to block and wake up.
+ *
+ * A buffer_t can't simply be placed in shared memory since it points to its
+ * array and semaphores, and each process may map the region at a different
+ * address. The shared region therefore holds no pointers at all, and each
+ * process only keeps a shm_buffer_t handle to its own mapping.
+ *
+ * One process creates the buffer, then any number of processes attach to it
+ * by name. Each process detaches when done, and the buffer is removed with
+ * shm_buffer_unlink() once no process attaches to it any more.
+ */
+
+#ifndef SHM_BUFFER_H
+#define SHM_BUFFER_H
+
+#include "bounded_buffer.h" // tuple_t
+
+#include <stdbool.h> // bool
+#include <stddef.h>  // size_t
+
+typedef struct shm_region shm_region_t;
+
+typedef struct {
+  shm_region_t *region; // This process's mapping of the shared region.
+  size_t       length;  // Size of the mapping in bytes.
+} shm_buffer_t;
+
+/* shm_buffer_create(buffer, name, size)
+
+   Creates the shared memory object name, which must start with a '/' and not
+   already exist, holding an empty buffer of size tuples, and attaches buffer
+   to it. Terminates the program on failure.
+*/
+void shm_buffer_create(shm_buffer_t *buffer, const char *name, int size);
+
+/* shm_buffer_attach(buffer, name)
+
+   Attaches buffer to the buffer created as name by shm_buffer_create(),
+   possibly in another process.
+
+   Return value
+
+   true on success, false if there is no such buffer.
+*/
+bool shm_buffer_attach(shm_buffer_t *buffer, const char *name);
+
+/* shm_buffer_detach(buffer)
+
+   Unmaps the buffer from this process. The buffer itself is left as is for
+   the other processes.
+*/
+void shm_buffer_detach(shm_buffer_t *buffer);
+
+/* shm_buffer_unlink(buffer, name)
+
+   Destroys the semaphores of the buffer, detaches it and removes name. Call
+   from one process once every other process has detached.
+*/
+void shm_buffer_unlink(shm_buffer_t *buffer, const char *name);
+
+/* Capacity of the buffer in tuples. */
+int shm_buffer_size(shm_buffer_t *buffer);
+
+/* Same as buffer_put(), see bounded_buffer.h. */
+bool shm_buffer_put(shm_buffer_t *buffer, int a, int b);
+
+/* Same as buffer_get(). */
+bool shm_buffer_get(shm_buffer_t *buffer, tuple_t *tuple);
+
+/* Same as buffer_try_put(). */
+bool shm_buffer_try_put(shm_buffer_t *buffer, int a, int b);
+
+/* Same as buffer_try_get(). */
+bool shm_buffer_try_get(shm_buffer_t *buffer, tuple_t *tuple);
+
+/* Same as buffer_put_n(). */
+int shm_buffer_put_n(shm_buffer_t *buffer, const tuple_t *src, int n);
+
+/* Same as buffer_get_n(). */
+int shm_buffer_get_n(shm_buffer_t *buffer, tuple_t *dst, int max);
+
+/* Same as buffer_close(), wakes up the blocked processes too. */
+void shm_buffer_close(shm_buffer_t *buffer);
+
+#endif
@@ -0,0 +1,148 @@
+/**
+ * Unit test for the bounded buffer shared between processes.
+ */
+
+#include "shm_buffer.h"
+
+#include <stdio.h>    // printf(), snprintf(), setbuf(), stdout
+#include <stdlib.h>   // exit(), EXIT_SUCCESS, EXIT_FAILURE
+#include <unistd.h>   // fork(), getpid(), usleep()
+#include <sys/wait.h> // waitpid(), WIFEXITED(), WEXITSTATUS()
+#include <assert.h>   // assert()
+
+#define TEST_HEADER printf("\n==== %s ====\n\n", __FUNCTION__)
+
+#define BATCH 64
+#define N     (1600 * BATCH)
+
+void success() {
+  printf("\nTest SUCCESSFUL :-)\n\n");
+}
+
+char name[64];
+
+/* Waits for the child process pid and checks that it succeeded. */
+void join(pid_t pid) {
+  int status;
+  pid_t waited = waitpid(pid, &status, 0);
+
+  assert(waited == pid);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+}
+
+void attach_test() {
+  TEST_HEADER;
+
+  shm_buffer_t buffer, other;
+  bool ok;
+
+  ok = shm_buffer_attach(&other, name);
+  assert(!ok);
+
+  shm_buffer_create(&buffer, name, 10);
+  ok = shm_buffer_attach(&other, name);
+  assert(ok);
+  assert(shm_buffer_size(&other) == 10);
+
+  // Both mappings are the same memory.
+  ok = shm_buffer_put(&buffer, 1, 2);
+  assert(ok);
+  tuple_t tuple;
+  ok = shm_buffer_try_get(&other, &tuple);
+  assert(ok);
+  assert(tuple.a == 1 && tuple.b == 2);
+  ok = shm_buffer_try_get(&buffer, &tuple);
+  assert(!ok);
+
+  shm_buffer_detach(&other);
+  shm_buffer_unlink(&buffer, name);
+
+  ok = shm_buffer_attach(&other, name);
+  assert(!ok);
+
+  success();
+}
+
+/* A child process attaches by name and produces, the parent consumes. Every
+   tuple arrives, in order, through a buffer much smaller than N. */
+void transfer_test() {
+  TEST_HEADER;
+
+  shm_buffer_t buffer;
+
+  shm_buffer_create(&buffer, name, 16);
+
+  pid_t pid = fork();
+  assert(pid != -1);
+
+  if (pid == 0) {
+    shm_buffer_t child;
+    tuple_t batch[BATCH];
+
+    if (!shm_buffer_attach(&child, name)) exit(EXIT_FAILURE);
+
+    for (int i = 0; i < N; i += BATCH) {
+      for (int j = 0; j < BATCH; j++) batch[j] = (tuple_t) {.a = i + j, .b = -(i + j)};
+      if (shm_buffer_put_n(&child, batch, BATCH) != BATCH) exit(EXIT_FAILURE);
+    }
+    shm_buffer_close(&child);
+    shm_buffer_detach(&child);
+    exit(EXIT_SUCCESS);
+  }
+
+  tuple_t tuple;
+  int next = 0;
+
+  while (shm_buffer_get(&buffer, &tuple)) {
+    assert(tuple.a == next && tuple.b == -next);
+    next++;
+  }
+  assert(next == N);
+
+  join(pid);
+  shm_buffer_unlink(&buffer, name);
+
+  printf("%d tuples transferred\n", next);
+
+  success();
+}
+
+/* Closing the buffer in one process wakes a consumer blocked in another. */
+void close_test() {
+  TEST_HEADER;
+
+  shm_buffer_t buffer;
+  tuple_t tuple;
+
+  shm_buffer_create(&buffer, name, 4);
+
+  pid_t pid = fork();
+  assert(pid != -1);
+
+  if (pid == 0) {
+    shm_buffer_t child;
+
+    if (!shm_buffer_attach(&child, name)) exit(EXIT_FAILURE);
+    exit(shm_buffer_get(&child, &tuple) ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
+
+  usleep(100000);
+  shm_buffer_close(&buffer);
+
+  join(pid);
+  bool ok = shm_buffer_put(&buffer, 1, 1);
+  assert(!ok);
+  shm_buffer_unlink(&buffer, name);
+
+  success();
+}
+
+int main(void) {
+  setbuf(stdout, NULL);
+
+  snprintf(name, sizeof(name), "/shm_buffer_test.%d", (int) getpid());
+
+  attach_test();
+  transfer_test();
+  close_test();
+}
@@ -0,0 +1,117 @@
+#include "text.h"
+#include "parallel.h" // parallel_for(), parallel_reduce()
+
+#include <string.h>   // memcpy()
+
+#define VECTOR_BYTES 16
+
+typedef unsigned char bytes_t __attribute__((vector_size(VECTOR_BYTES)));
+
+/* Byte counters in a vector overflow after 255 vectors. */
+#define COUNT_BLOCK (255 * VECTOR_BYTES)
+
+/* memcpy() is the portable unaligned load and store, compiled to a single
+   vector move. */
+static inline bytes_t load(const char *p) {
+  bytes_t v;
+  memcpy(&v, p, VECTOR_BYTES);
+  return v;
+}
+
+static inline void store(char *p, bytes_t v) {
+  memcpy(p, &v, VECTOR_BYTES);
+}
+
+size_t text_count(const char *s, size_t n, char c) {
+  bytes_t needle = (bytes_t) {0} + (unsigned char) c;
+  size_t count = 0;
+  size_t i = 0;
+
+  while (n - i >= VECTOR_BYTES) {
+    size_t end = n - i > COUNT_BLOCK ? i + COUNT_BLOCK : n;
+    bytes_t counts = {0};
+
+    // A comparison is -1 (all ones) for equal bytes, so subtracting it counts.
+    for (; i + VECTOR_BYTES <= end; i += VECTOR_BYTES) {
+      counts -= (bytes_t) (load(s + i) == needle);
+    }
+
+    for (int k = 0; k < VECTOR_BYTES; k++) {
+      count += counts[k];
+    }
+  }
+
+  for (; i < n; i++) {
+    count += s[i] == c;
+  }
+
+  return count;
+}
+
+/* Adds delta to the bytes between first and first + 25, that is to the
+   letters of one case. Bytes below first wrap around and compare high. */
+static void shift_letters(char *s, size_t n, unsigned char first, unsigned char delta) {
+  size_t i = 0;
+
+  for (; i + VECTOR_BYTES <= n; i += VECTOR_BYTES) {
+    bytes_t v = load(s + i);
+    bytes_t letter = (bytes_t) (v - first < 26);
+    store(s + i, v + (letter & delta));
+  }
+
+  for (; i < n; i++) {
+    if ((unsigned char) (s[i] - first) < 26) s[i] += delta;
+  }
+}
+
+void text_to_upper(char *s, size_t n) {
+  shift_letters(s, n, 'a', (unsigned char) ('A' - 'a'));
+}
+
+void text_to_lower(char *s, size_t n) {
+  shift_letters(s, n, 'A', 'a' - 'A');
+}
+
+/*******************************************************************************
+                                  Parallel
+*******************************************************************************/
+
+typedef struct {
+  const char *s;
+  char       c;
+} count_arg_t;
+
+static void count_range(size_t begin, size_t end, void *arg, void *partial) {
+  count_arg_t *count = arg;
+  *(size_t *) partial += text_count(count->s + begin, end - begin, count->c);
+}
+
+static void add(void *result, const void *partial, void *arg) {
+  (void) arg;
+  *(size_t *) result += *(const size_t *) partial;
+}
+
+size_t text_count_parallel(pool_t *pool, const char *s, size_t n, char c) {
+  count_arg_t arg = {.s = s, .c = c};
+  size_t count = 0;
+
+  parallel_reduce(pool, n, 0, &count, sizeof(count), count_range, add, &arg);
+
+  return count;
+}
+
+static void upper_range(size_t begin, size_t end, void *arg) {
+  text_to_upper((char *) arg + begin, end - begin);
+}
+
+static void lower_range(size_t begin, size_t end, void *arg) {
+  text_to_lower((char *) arg + begin, end - begin);
+}
+
+void text_to_upper_parallel(pool_t *pool, char *s, size_t n) {
+  parallel_for(pool, n, 0, upper_range, s);
+}
+
+void text_to_lower_parallel(pool_t *pool, char *s, size_t n) {
+  parallel_for(pool, n, 0, lower_range, s);
+}
@@ -0,0 +1,40 @@
+/**
+ * Byte-wise text kernels.
+ *
+ * Counting a byte and converting ASCII case, written on 16 byte vectors with
+ * the GCC/Clang vector extensions, which compile to SSE2 on x86-64 and NEON
+ * on ARM64 without any intrinsics. Loads and stores are unaligned, the bytes
+ * after the last full vector are done one at a time.
+ *
+ * The _parallel versions split the text with parallel_for() and
+ * parallel_reduce() and run the same kernels on every chunk. Chunks start at
+ * multiples of CACHE_LINE, so for a cache line aligned text no two workers
+ * write the same cache line.
+ *
+ * Only ASCII letters are converted, every other byte, including UTF-8
+ * sequences, is left as is.
+ */
+
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <stddef.h> // size_t
+
+#include "pool.h"   // pool_t
+
+/* Number of bytes of text in s[0..n) equal to c. */
+size_t text_count(const char *s, size_t n, char c);
+
+/* Converts the ASCII letters in s[0..n) to upper case. */
+void text_to_upper(char *s, size_t n);
+
+/* Converts the ASCII letters in s[0..n) to lower case. */
+void text_to_lower(char *s, size_t n);
+
+size_t text_count_parallel(pool_t *pool, const char *s, size_t n, char c);
+
+void text_to_upper_parallel(pool_t *pool, char *s, size_t n);
+
+void text_to_lower_parallel(pool_t *pool, char *s, size_t n);
+
+#endif
@@ -66,6 +66,52 @@ timing_stop(struct timespec *ts_start)
                 (ts.tv_nsec - ts_start->tv_nsec) * 1E-9;
 }
 
+/* Nanoseconds per tick as a 32.32 fixed point number. Accessed with the
+ * __atomic builtins rather than C11 atomics since the higher grade part
+ * builds this file as C99. */
+uint64_t timing_ns_per_tick = 0;
+
+/* Length of the calibration interval. */
+#define CALIBRATION_NS 10000000
+
+uint64_t
+timing_now_ns()
+{
+        struct timespec ts;
+
+        checked_gettime(&ts);
+
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void
+timing_calibrate()
+{
+#if defined(__x86_64__) || defined(__aarch64__)
+        struct timespec delay = {.tv_sec = 0, .tv_nsec = CALIBRATION_NS};
+        uint64_t ns = timing_now_ns();
+        uint64_t ticks = timing_ticks();
+
+        /* Both counters keep running while we sleep. */
+        nanosleep(&delay, NULL);
+
+        ticks = timing_ticks() - ticks;
+        ns = timing_now_ns() - ns;
+
+        assert(ticks > 0);
+
+        __atomic_store_n(&timing_ns_per_tick, (ns << 32) / ticks, __ATOMIC_RELAXED);
+#else
+        __atomic_store_n(&timing_ns_per_tick, 1ULL << 32, __ATOMIC_RELAXED);
+#endif
+}
+
+double
+timing_ticks_per_ns()
+{
+        return 4294967296.0 / timing_ticks_to_ns(1ULL << 32);
+}
+
 /*
  * Local Variables:
  * mode: c
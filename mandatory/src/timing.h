@@ -10,6 +10,7 @@
 #define TIMING_H
 
 #include <time.h>
+#include <stdint.h>
 
 /**
  * Get the precision of the timer exposed by the underlying OS.
@@ -34,6 +35,99 @@ extern void timing_start(struct timespec *ts);
  */
 extern double timing_stop(struct timespec *ts_start);
 
+/**
+ * Cycle counter timing.
+ *
+ * clock_gettime() takes tens of nanoseconds, too much for timing a single
+ * lock acquisition or buffer operation. timing_ticks() reads the time stamp
+ * counter (x86-64) or the virtual counter (ARM64) directly, a few
+ * nanoseconds, and timing_ticks_to_ns() converts a number of ticks to
+ * nanoseconds with a factor measured against CLOCK_MONOTONIC by
+ * timing_calibrate(). On other platforms a tick is a nanosecond of
+ * CLOCK_MONOTONIC.
+ *
+ * The counters tick at a constant rate independent of the CPU frequency
+ * and are synchronized between cores on all current CPUs, so ticks read on
+ * different cores can be subtracted.
+ *
+ * Typical use:
+ *
+ *   uint64_t start = timing_ticks();
+ *   ...
+ *   uint64_t ns = timing_ticks_to_ns(timing_ticks() - start);
+ */
+
+/**
+ * The current time in nanoseconds of CLOCK_MONOTONIC.
+ */
+extern uint64_t timing_now_ns();
+
+/**
+ * Measures the tick rate. Called by timing_ticks_to_ns() the first time
+ * if not called before, call it at startup to keep the calibration, which
+ * takes about 10 ms, out of the measurements.
+ */
+extern void timing_calibrate();
+
+/**
+ * Ticks per nanosecond, that is the counter frequency in GHz.
+ */
+extern double timing_ticks_per_ns();
+
+/* Nanoseconds per tick as a 32.32 fixed point number, 0 until calibrated. */
+extern uint64_t timing_ns_per_tick;
+
+/**
+ * Reads the cycle counter.
+ *
+ * \return The current time in ticks, with an unspecified starting point.
+ */
+static inline uint64_t
+timing_ticks()
+{
+#if defined(__x86_64__)
+        /* The lfence keeps rdtsc from being executed before the code
+         * being timed. */
+        __builtin_ia32_lfence();
+        return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+        uint64_t ticks;
+
+        __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(ticks) :: "memory");
+        return ticks;
+#else
+        return timing_now_ns();
+#endif
+}
+
+/**
+ * Converts ticks to nanoseconds.
+ *
+ * \param ticks A number of ticks, usually the difference of two
+ * timing_ticks() calls.
+ * \return The same time in nanoseconds.
+ */
+static inline uint64_t
+timing_ticks_to_ns(uint64_t ticks)
+{
+        uint64_t ns_per_tick = __atomic_load_n(&timing_ns_per_tick, __ATOMIC_RELAXED);
+
+        if (ns_per_tick == 0) {
+                timing_calibrate();
+                ns_per_tick = __atomic_load_n(&timing_ns_per_tick, __ATOMIC_RELAXED);
+        }
+
+#ifdef __SIZEOF_INT128__
+        return ((unsigned __int128) ticks * ns_per_tick) >> 32;
+#else
+        /* The same product from 32-bit halves. */
+        uint64_t lo = ticks & 0xffffffff;
+
+        return (ticks >> 32) * ns_per_tick + lo * (ns_per_tick >> 32) +
+                ((lo * (ns_per_tick & 0xffffffff)) >> 32);
+#endif
+}
+
 #endif
 
 /*